@@ -638,6 +638,23 @@ SystemInterface
   return thumbdir + "/" + code + ".png";
 }
 
+std::string
+SystemInterface
+::GetDicomIndexAssociatedWithDirectory(const char *dir)
+{
+  // Get a string giving the index name
+  string code = this->FindUniqueCodeForFile(dir, true);
+
+  // Create the index directory in the settings directory
+  string appdir = this->GetApplicationDataDirectory();
+  string indexdir = appdir + "/DicomIndex";
+  if(!SystemTools::MakeDirectory(indexdir.c_str()))
+    throw IRISException("Unable to create DICOM index directory %s",
+                        indexdir.c_str());
+
+  return indexdir + "/" + code + ".txt";
+}
+
 void SystemInterface
 ::WriteThumbnail(
     const char *associated_file, ThumbnailImageType *thumbnail)
@@ -120,6 +120,9 @@ public:
   /** Get the thumbnail filename associated with an image file */
   std::string GetThumbnailAssociatedWithFile(const char *file);
 
+  /** Get the file used to index the DICOM headers in a directory */
+  std::string GetDicomIndexAssociatedWithDirectory(const char *dir);
+
   /** Write a thumbnail */
   void WriteThumbnail(const char *associated_file, ThumbnailImageType *thumbnail);
 
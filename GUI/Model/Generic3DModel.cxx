@@ -47,6 +47,7 @@ Generic3DModel::Generic3DModel()
 
   // Reset clear time
   m_ClearTime = 0;
+  m_MeshCacheTrimPending = false;
 }
 
 #include "itkImage.h"
@@ -253,6 +254,7 @@ void Generic3DModel::UpdateSegmentationMesh(itk::Command *progressCmd)
     imgData->GetMeshLayers()->UpdateActiveMeshLayer(progressCmd);
 
     m_MeshUpdating = false;
+    m_MeshCacheTrimPending = true;
 
     InvokeEvent(ModelUpdateEvent());
   }
@@ -268,6 +270,57 @@ void Generic3DModel::UpdateSegmentationMesh(itk::Command *progressCmd)
   }
 }
 
+void Generic3DModel::PrecomputeSegmentationMeshes(itk::Command *progressCmd)
+{
+  // Level set meshes are only computed for the current time point
+  if(m_Driver->IsSnakeModeLevelSetActive())
+    return;
+
+  ImageMeshLayers *layers = m_Driver->GetIRISImageData()->GetMeshLayers();
+  while(true)
+    {
+    // The lock is released between batches of time points, so that the mesh
+    // of the current time point can be updated or exported in the meantime
+      {
+      std::lock_guard<std::mutex> guard(m_Mutex);
+
+      // The user edited the segmentation or moved to a time point without a
+      // mesh, which takes priority over the other time points
+      if(layers->IsActiveMeshLayerDirty())
+        return;
+
+      try
+        {
+        if(!layers->PrecomputeActiveMeshLayer(progressCmd))
+          return;
+        }
+      catch(std::bad_alloc &)
+        {
+        throw IRISException("Out of memory during mesh computation");
+        }
+
+      m_MeshCacheTrimPending = true;
+      }
+
+    InvokeEvent(ModelUpdateEvent());
+    }
+}
+
+void Generic3DModel::TrimMeshCache()
+{
+  if(!m_MeshCacheTrimPending)
+    return;
+
+  // Do not wait for a mesh update in progress, it will be trimmed later
+  std::unique_lock<std::mutex> lock(m_Mutex, std::try_to_lock);
+  if(!lock.owns_lock())
+    return;
+
+  m_MeshCacheTrimPending = false;
+  if(!m_Driver->IsSnakeModeLevelSetActive())
+    m_Driver->GetIRISImageData()->GetMeshLayers()->TrimActiveMeshLayerCache();
+}
+
 bool Generic3DModel::IsMeshUpdating()
 {
   return m_MeshUpdating;
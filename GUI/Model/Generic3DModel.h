@@ -6,6 +6,7 @@
 #include "vtkSmartPointer.h"
 #include "SNAPEvents.h"
 #include <mutex>
+#include <atomic>
 
 class GlobalUIModel;
 class IRISApplication;
@@ -69,6 +70,15 @@ public:
   // Tell the model to update the segmentation mesh
   void UpdateSegmentationMesh(itk::Command *progressCmd);
 
+  // For a 4D segmentation, compute the meshes of the time points that follow
+  // the current one, a few at a time. Stops when the mesh of the current time
+  // point needs updating. Meant to run in the background mesh update thread
+  void PrecomputeSegmentationMeshes(itk::Command *progressCmd);
+
+  // Drop cached meshes of other time points that exceed the memory limit.
+  // Must be called from the GUI thread, since it removes mesh assemblies
+  void TrimMeshCache();
+
   // Reentrant function to check if mesh is being constructed in another thread
   bool IsMeshUpdating();
 
@@ -189,6 +199,9 @@ protected:
 
   // A mutex to allow background processing of mesh updates
   std::mutex m_Mutex;
+
+  // Set when meshes were computed, so the cache may need trimming
+  std::atomic<bool> m_MeshCacheTrimPending;
 };
 
 #endif // GENERIC3DMODEL_H
@@ -418,10 +418,23 @@ void ImageIOWizardModel::ProcessDicomDirectory(const std::string &filename,
   // Get the directory
   std::string dir = GetBrowseDirectory(filename);
 
+  // The headers found in the directory are indexed, so that opening the
+  // same directory again does not require reading all the files
+  std::string index_file;
+  try
+  {
+    index_file = m_Parent->GetSystemInterface()
+        ->GetDicomIndexAssociatedWithDirectory(dir.c_str());
+  }
+  catch (IRISException &)
+  {
+    // The index is optional
+  }
+
   // Get the registry
   try
   {
-    m_GuidedIO->ParseDicomDirectory(dir, progressCommand);
+    m_GuidedIO->ParseDicomDirectory(dir, progressCommand, index_file);
   }
   catch (IRISException &ei)
   {
@@ -1,6 +1,7 @@
 #include "ImageInfoModel.h"
 #include "LayerAssociation.h"
 #include "MetaDataAccess.h"
+#include "LabelImageWrapper.h"
 #include <cctype>
 #include <algorithm>
 
@@ -51,6 +52,9 @@ ImageInfoModel::ImageInfoModel()
   m_ImagePixelFormatDescriptionModel = wrapGetterSetterPairAsProperty(
         this, &Self::GetImagePixelFormatDescription);
 
+  m_ImageUndoMemoryModel = wrapGetterSetterPairAsProperty(
+        this, &Self::GetImageUndoMemory);
+
   // Create the property model for the filter
   m_MetadataFilterModel = ConcreteSimpleStringProperty::New();
 
@@ -72,6 +76,9 @@ void ImageInfoModel::SetParentModel(GlobalUIModel *parent)
 
   // Cursor update events are mapped to model update events
   Rebroadcast(m_ParentModel, CursorUpdateEvent(), ModelUpdateEvent());
+
+  // Segmentation edits change the undo memory of the layer
+  Rebroadcast(m_ParentModel->GetDriver(), SegmentationChangeEvent(), ModelUpdateEvent());
 }
 
 bool ImageInfoModel
@@ -245,6 +252,23 @@ bool ImageInfoModel::GetImagePixelFormatDescription(std::string &value)
   return true;
 }
 
+bool ImageInfoModel::GetImageUndoMemory(std::string &value)
+{
+  LabelImageWrapper *l = dynamic_cast<LabelImageWrapper*>(this->GetLayer());
+  if(!l) return false;
+
+  // Undo data held in memory, and in the swap file if any has been spilled
+  UndoMemoryBudget::Usage usage = l->GetUndoMemoryUsage();
+  char buffer[64];
+  if(usage.SpilledSize)
+    snprintf(buffer, sizeof(buffer), "%.1f MB (%.1f MB on disk)",
+             usage.MemoryInUse / 1048576.0, usage.SpilledSize / 1048576.0);
+  else
+    snprintf(buffer, sizeof(buffer), "%.1f MB", usage.MemoryInUse / 1048576.0);
+  value = buffer;
+  return true;
+}
+
 bool
 ImageInfoModel
 ::GetCurrentTimePointValueAndRange(
@@ -306,6 +330,8 @@ bool ImageInfoModel::CheckState(ImageInfoModel::UIState state)
     case ImageInfoModel::UIF_TIME_IS_DISPLAYED:
       return main && layer
           && (layer->GetNumberOfTimePoints() > 1 || main->GetNumberOfTimePoints() > 1);
+    case ImageInfoModel::UIF_LAYER_HAS_UNDO:
+      return dynamic_cast<LabelImageWrapper *>(this->GetLayer()) != NULL;
     }
   return false;
 }
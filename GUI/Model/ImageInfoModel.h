@@ -33,7 +33,8 @@ public:
   enum UIState {
     UIF_TIME_POINT_IS_EDITABLE,
     UIF_INTENSITY_IS_MULTIVALUED,
-    UIF_TIME_IS_DISPLAYED
+    UIF_TIME_IS_DISPLAYED,
+    UIF_LAYER_HAS_UNDO
   };
 
   // Implementation of virtual functions from parent class
@@ -60,6 +61,7 @@ public:
   irisGetMacro(ImageNumberOfTimePointsModel, AbstractSimpleUIntProperty *)
   irisGetMacro(ImageCurrentTimePointModel, AbstractRangedUIntProperty *)
   irisGetMacro(ImagePixelFormatDescriptionModel, AbstractSimpleStringProperty *)
+  irisGetMacro(ImageUndoMemoryModel, AbstractSimpleStringProperty *)
   irisGetMacro(ImageScalarIntensityUnderCursorModel, AbstractSimpleDoubleProperty *)
 
   /** This model reports whether the active layer is in reference space */
@@ -99,6 +101,7 @@ protected:
   SmartPtr<AbstractRangedUIntProperty> m_ImageCurrentTimePointModel;
   SmartPtr<AbstractSimpleDoubleProperty> m_ImageScalarIntensityUnderCursorModel;
   SmartPtr<AbstractSimpleStringProperty> m_ImagePixelFormatDescriptionModel;
+  SmartPtr<AbstractSimpleStringProperty> m_ImageUndoMemoryModel;
 
 
   bool GetImageIsInReferenceSpace(bool &value);
@@ -113,6 +116,7 @@ protected:
   bool GetImageNumberOfTimePoints(unsigned int &value);
   bool GetImageScalarIntensityUnderCursor(double &value);
   bool GetImagePixelFormatDescription(std::string &value);
+  bool GetImageUndoMemory(std::string &value);
 
   // Current time point model
   bool GetCurrentTimePointValueAndRange(unsigned int &value, NumericValueRange<unsigned int> *range);
@@ -1432,6 +1432,30 @@ bool SnakeWizardModel::PerformEvolutionStep()
   return false;
 }
 
+void SnakeWizardModel::SetEvolutionRunningInBackground(bool running)
+{
+  SNAPImageData *sid = m_Driver->GetSNAPImageData();
+  if(!sid->IsSegmentationActive())
+    return;
+
+  if(running)
+    sid->StartSegmentationInBackground(m_StepSizeModel->GetValue());
+  else
+    sid->StopSegmentationInBackground();
+
+  InvokeEvent(EvolutionIterationEvent());
+}
+
+bool SnakeWizardModel::UpdateBackgroundEvolution()
+{
+  // Swap in the latest level set, if there is a new one
+  if(m_Driver->GetSNAPImageData()->UpdateSnakeFromBackgroundSegmentation())
+    InvokeEvent(EvolutionIterationEvent());
+
+  // As in PerformEvolutionStep, convergence is not checked
+  return false;
+}
+
 int SnakeWizardModel::GetEvolutionIterationValue()
 {
   if(m_Driver->IsSnakeModeActive() &&
@@ -208,6 +208,18 @@ public:
    */
   bool PerformEvolutionStep();
 
+  /**
+   * Start or pause the evolution on a background thread. While it runs, the
+   * GUI should call UpdateBackgroundEvolution() periodically.
+   */
+  void SetEvolutionRunningInBackground(bool running);
+
+  /**
+   * Show the latest result of the background evolution. Returns true if the
+   * evolution has converged
+   */
+  bool UpdateBackgroundEvolution();
+
   /** Rewind the evolution */
   void RewindEvolution();
 
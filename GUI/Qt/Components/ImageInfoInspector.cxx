@@ -72,6 +72,8 @@ void ImageInfoInspector::SetModel(ImageInfoModel *model)
 
   makeCoupling(ui->outPixelFormat, m_Model->GetImagePixelFormatDescriptionModel());
 
+  makeCoupling(ui->outUndoMemory, m_Model->GetImageUndoMemoryModel());
+
   // makeCoupling(ui->inVoxT, m_Model->GetImageCurrentTimePointModel());
 
   makeCoupling(ui->outIntensityUnderCursor, m_Model->GetImageScalarIntensityUnderCursorModel(), tr_real);
@@ -97,6 +99,9 @@ void ImageInfoInspector::SetModel(ImageInfoModel *model)
   activateOnNotFlag(QList<QObject *>(
                       {ui->outIntensityUnderCursor, ui->lblIntensityUnderCursor }),
                     m_Model, ImageInfoModel::UIF_INTENSITY_IS_MULTIVALUED, QtWidgetActivator::HideInactive);
+
+  // Undo memory is only reported for segmentation layers
+  activateOnFlag(ui->widget_7, m_Model, ImageInfoModel::UIF_LAYER_HAS_UNDO, QtWidgetActivator::HideInactive);
 }
 
 void ImageInfoInspector::on_btnReorientImage_clicked()
@@ -16,6 +16,7 @@
 #include <QGraphicsScene>
 #include <QGraphicsDropShadowEffect>
 #include <QDateTime>
+#include <QTimer>
 
 
 #include "QtCursorOverride.h"
@@ -28,6 +29,7 @@
 #include "ColorMap.h"
 #include "ColorMapModel.h"
 #include "ImageIOWizard.h"
+#include "ImageWrapperBase.h"
 
 
 QIcon CreateColorBoxIcon(int w, int h, const QBrush &brush)
@@ -441,9 +443,35 @@ QString ShowSimpleOpenDialogWithHistory(
   return result.filename;
 }
 
+/** Wait for a background write of the layer, and report an error if it fails */
+static void FinishBackgroundWriteLater(ImageWrapperBase *wrapper, QWidget *parent, QString filename)
+{
+  SmartPtr<ImageWrapperBase> layer = wrapper;
+  QTimer *timer = new QTimer(parent);
+  QObject::connect(timer, &QTimer::timeout, [timer, layer, parent, filename]()
+    {
+    if(!layer->IsBackgroundWriteFinished())
+      return;
+
+    timer->stop();
+    timer->deleteLater();
+    try
+      {
+      layer->FinishBackgroundWrite();
+      }
+    catch(std::exception &exc)
+      {
+      ReportNonLethalException(
+            parent, exc, "Image IO Error",
+            QString("Failed to save image %1").arg(filename));
+      }
+    });
+  timer->start(100);
+}
+
 bool SaveImageLayer(GlobalUIModel *model, ImageWrapperBase *wrapper,
                     LayerRole role, bool force_interactive,
-                    QWidget *parent, bool currentTPOnly)
+                    QWidget *parent, bool currentTPOnly, bool background)
 {
   // Create a model for saving the segmentation image via a wizard
   SmartPtr<ImageIOWizardModel> wiz_model =
@@ -462,6 +490,7 @@ bool SaveImageLayer(GlobalUIModel *model, ImageWrapperBase *wrapper,
     try
       {
       QtCursorOverride curse(Qt::WaitCursor);
+      wiz_model->GetSaveDelegate()->SetSaveInBackground(background);
       wiz_model->SaveImage(wiz_model->GetSuggestedFilename());
       }
     catch(std::exception &exc)
@@ -471,6 +500,9 @@ bool SaveImageLayer(GlobalUIModel *model, ImageWrapperBase *wrapper,
             QString("Failed to save image %1").arg(
               from_utf8(wiz_model->GetSuggestedFilename())));
       }
+
+    if(background && wiz_model->GetSaveDelegate()->IsSaveSuccessful())
+      FinishBackgroundWriteLater(wrapper, parent, from_utf8(wiz_model->GetSuggestedFilename()));
     }
 
   return wiz_model->GetSaveDelegate()->IsSaveSuccessful();
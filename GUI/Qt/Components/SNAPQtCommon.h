@@ -133,11 +133,15 @@ QString ShowSimpleOpenDialogWithHistory(QWidget *parent, GlobalUIModel *model, Q
  * image layer either interactively or non-interactively depending on
  * whether the image layer has a filename set. Exceptions are handled
  * within the method. The method returns true if the image was actually
- * saved, and false if there was a problem, or user cancelled.
+ * saved, and false if there was a problem, or user cancelled. If background
+ * is set, an image that is saved without the dialog is written on another
+ * thread, and the method returns true once the write has started. Errors
+ * are then reported when the write finishes.
  */
 bool SaveImageLayer(GlobalUIModel *model, ImageWrapperBase *wrapper,
                     LayerRole role, bool force_interactive = false,
-                    QWidget *parent = NULL, bool currentTPOnly = false);
+                    QWidget *parent = NULL, bool currentTPOnly = false,
+                    bool background = false);
 
 
 /**
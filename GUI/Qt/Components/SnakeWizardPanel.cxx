@@ -340,18 +340,34 @@ void SnakeWizardPanel::on_stack_currentChanged(int page)
 
 void SnakeWizardPanel::on_btnPlay_toggled(bool checked)
 {
-  // This is where we toggle the snake evolution!
+  // This is where we toggle the snake evolution! The snake evolves on a
+  // background thread, and the timer picks up the intermediate results
   if(checked)
+    {
+    m_Model->SetEvolutionRunningInBackground(true);
     m_EvolutionTimer->start(10);
+    }
   else
+    {
     m_EvolutionTimer->stop();
+    m_Model->SetEvolutionRunningInBackground(false);
+    }
 }
 
 void SnakeWizardPanel::idleCallback()
 {
-  // Step the snake. If converged (returns true), stop playing
-  if(m_Model->PerformEvolutionStep())
+  // Show the latest state of the snake. If converged (returns true), stop playing
+  try
+  {
+    if(m_Model->UpdateBackgroundEvolution())
+      ui->btnPlay->setChecked(false);
+  }
+  catch(std::exception &exc)
+  {
+    // The evolution has already been stopped
     ui->btnPlay->setChecked(false);
+    QMessageBox::warning(this, "ITK-SNAP", exc.what(), QMessageBox::Ok);
+  }
 }
 
 void SnakeWizardPanel::on_btnSingleStep_clicked()
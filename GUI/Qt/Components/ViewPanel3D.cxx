@@ -201,6 +201,23 @@ void ViewPanel3D::UpdateMeshesInBackground()
   if(m_Model && m_Model->CheckState(Generic3DModel::UIF_MESH_DIRTY))
     {
     m_Model->UpdateSegmentationMesh(m_RenderProgressCommand);
+
+    // Go on to compute the meshes of the other time points of a 4D image, so
+    // that the 3D view does not stall when playing through them. If this
+    // fails, e.g., because memory runs out, it is not tried again in this
+    // session and the error is reported from the GUI thread
+    if(!m_PrecomputeDisabled)
+      {
+      try
+        {
+        m_Model->PrecomputeSegmentationMeshes(m_RenderProgressCommand);
+        }
+      catch(std::exception &exc)
+        {
+        m_PrecomputeDisabled = true;
+        m_PrecomputeError = exc.what();
+        }
+      }
     }
 }
 
@@ -258,6 +275,20 @@ void ViewPanel3D::onTimer()
 {
   if(!m_RenderFuture.isRunning())
     {
+    // Report a failure to precompute the meshes of other time points
+    if(!m_PrecomputeError.isEmpty())
+      {
+      QString error = m_PrecomputeError;
+      m_PrecomputeError.clear();
+      QMessageBox::warning(this, "Problem generating mesh",
+                           QString("Meshes for other time points will only be "
+                                   "generated when you visit them. %1").arg(error));
+      }
+
+    // Drop meshes that the background update pushed past the cache limit
+    if(m_Model)
+      m_Model->TrimMeshCache();
+
     // Does work need to be done?
     if(m_Model && ui->actionContinuous_Update->isChecked()
        && m_Model->CheckState(Generic3DModel::UIF_MESH_DIRTY))
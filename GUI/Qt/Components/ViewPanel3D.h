@@ -96,6 +96,12 @@ private:
   // Elapsed time since begin of render operation
   int m_RenderElapsedTicks;
 
+  // Set when precomputing the meshes of other time points failed, which
+  // stops it for the rest of the session. The error is written by the
+  // background thread and read by the timer once that thread has finished
+  bool m_PrecomputeDisabled = false;
+  QString m_PrecomputeError;
+
   typedef itk::MemberCommand<ViewPanel3D> CommandType;
   SmartPtr<CommandType> m_RenderProgressCommand;
 
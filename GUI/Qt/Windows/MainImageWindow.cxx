@@ -1984,11 +1984,11 @@ void MainImageWindow::on_actionVolumesAndStatistics_triggered()
   m_StatisticsDialog->Activate();
 }
 
-bool MainImageWindow::SaveSegmentation(bool interactive, bool currentTPOnly)
+bool MainImageWindow::SaveSegmentation(bool interactive, bool currentTPOnly, bool background)
 {
   return SaveImageLayer(
         m_Model, m_Model->GetDriver()->GetSelectedSegmentationLayer(),
-        LABEL_ROLE, interactive, this, currentTPOnly);
+        LABEL_ROLE, interactive, this, currentTPOnly, background);
 }
 
 void MainImageWindow::RaiseDialog(QDialog *dialog)
@@ -2003,7 +2003,8 @@ void MainImageWindow::RaiseDialog(QDialog *dialog)
 
 void MainImageWindow::on_actionSaveSegmentation_triggered()
 {
-  SaveSegmentation(false);
+  DefaultBehaviorSettings *dbs = m_Model->GetGlobalState()->GetDefaultBehaviorSettings();
+  SaveSegmentation(false, false, dbs->GetSaveSegmentationInBackground());
 }
 
 void MainImageWindow::on_actionSaveSegmentationAs_triggered()
@@ -128,7 +128,7 @@ public:
 
   // Save the segmentation (interactively or not). Return true if save was
   // successful
-  bool SaveSegmentation(bool interactive, bool currentTPOnly = false);
+  bool SaveSegmentation(bool interactive, bool currentTPOnly = false, bool background = false);
 
   /** Save the project (interactively or not) */
   bool SaveWorkspace(bool interactive);
@@ -107,6 +107,8 @@ void PreferencesDialog::SetModel(GlobalPreferencesModel *model)
   makeCoupling(ui->chkSyncPan, dbs->GetSyncPanModel());
   makeCoupling(ui->chkCheckForUpdates, m_Model->GetCheckForUpdateModel());
   makeCoupling(ui->chkAutoContrast, dbs->GetAutoContrastModel());
+  makeCoupling(ui->chkMemoryMapping, dbs->GetMemoryMapUncompressedImagesModel());
+  makeCoupling(ui->chkSaveInBackground, dbs->GetSaveSegmentationInBackgroundModel());
 
   // Hook up the display layout properties
   GlobalDisplaySettings *gds = m_Model->GetGlobalDisplaySettings();
@@ -203,6 +205,10 @@ void PreferencesDialog::SetModel(GlobalPreferencesModel *model)
   makeCoupling(ui->inDecimateTargetReduction, mo->GetDecimateTargetReductionModel());
   makeCoupling(ui->chkDecimatePreserveTopology, mo->GetDecimatePreserveTopologyModel());
 
+  makeCoupling(ui->chkDiscreteSurface, mo->GetUseDiscreteSurfaceExtractionModel());
+  makeCoupling(ui->inDiscreteSmoothIterations, mo->GetDiscreteSmoothingIterationsModel());
+  makeCoupling(ui->inDiscreteSmoothPassBand, mo->GetDiscreteSmoothingPassBandModel());
+
   // Tool page
   makeCoupling(ui->inPaintBrushMaxSize, dbs->GetPaintbrushDefaultMaximumSizeModel());
   makeCoupling(ui->inPaintBrushInitSize, dbs->GetPaintbrushDefaultInitialSizeModel());
@@ -36,6 +36,10 @@
 #include "GenericImageData.h"
 #include "IRISApplication.h"
 #include "ImageCollectionConstIteratorWithIndex.h"
+#include "itkMultiThreaderBase.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
+
+#include <mutex>
 
 #include <iostream>
 #include <iomanip>
@@ -43,8 +47,11 @@
 
 using namespace std;
 
+// Label image and its buffer of run-length encoded lines
+typedef LabelImageWrapper::ImageType LabelImageType;
+typedef LabelImageType::BufferType LabelBufferType;
+
 
-// TODO: improve efficiency by using filters to integrate label intensities
 void
 SegmentationStatistics
 ::Compute(IRISApplication *app)
@@ -89,43 +96,82 @@ SegmentationStatistics
   // Get the number of gray image layers
   size_t ngray = layers.size();
 
-  // Clear and initialize the statistics table
+  // Clear and initialize the statistics table. The background entry is always
+  // present in the table, even if there are no background voxels
   m_Stats.clear();
+  m_Stats[0].resize(ngray);
+
+  // The label image is run-length encoded, so rather than visiting it one voxel
+  // at a time, we walk the (count, label) segments of each RLLine directly. The
+  // lines are split between threads, each thread accumulating its own table of
+  // entries that is merged into the main table at the end
+  const LabelImageType *label_image = seg->GetImage();
+  LabelBufferType *label_buffer = label_image->GetBuffer();
+  itk::ImageRegion<3> region = label_image->GetBufferedRegion();
+
+  // A mutex to control updating the main statistics table
+  std::mutex stats_mutex;
+
+  // Parallel block
+  itk::MultiThreaderBase::Pointer mt = itk::MultiThreaderBase::New();
+  mt->ParallelizeImageRegion<2>(
+        label_buffer->GetBufferedRegion(),
+        [this, ngray, &layers, &region, label_buffer, &stats_mutex]
+        (const LabelBufferType::RegionType &line_region)
+    {
+    // Thread-local statistics table
+    EntryMap local_stats;
 
-  // Start the label image iteration
-  LabelImageWrapper::ConstIterator itLabel = seg->GetImageConstIterator();
-  itk::ImageRegion<3> region = itLabel.GetRegion();
-
-  // Cache the entry to avoid many calls to std::map
-  LabelType runLabel = 0;
-  Entry *cachedEntry = &m_Stats[runLabel];
-  cachedEntry->resize(ngray);
-  itk::Index<3> runStart = itLabel.GetIndex();
-  long runLength = 0;
+    // Cache the entry to avoid many calls to std::map
+    LabelType runLabel = 0;
+    Entry *cachedEntry = &local_stats[runLabel];
+    cachedEntry->resize(ngray);
 
-  // Aggregate the statistical data
-  for( ; !itLabel.IsAtEnd(); ++itLabel, ++runLength)
-    {
-    // Get the label and the corresponding entry (use cache to reduce time wasted in std::map)
-    LabelType label = itLabel.Value();
-    if(label != runLabel)
+    typedef itk::ImageRegionConstIteratorWithIndex<LabelBufferType> LineIterator;
+    for(LineIterator it(label_buffer, line_region); !it.IsAtEnd(); ++it)
       {
-      // Record the statistics from the last run
-      this->RecordRunLength(ngray, layers, region, runStart, runLength, cachedEntry);
-
-      // Change the cached entry
-      runLabel = label;
-      cachedEntry = &m_Stats[runLabel];
-      if(cachedEntry->count == 0)
-        cachedEntry->resize(ngray);
+      // Index of the first voxel in the line
+      itk::Index<3> runStart;
+      runStart[0] = region.GetIndex(0);
+      runStart[1] = it.GetIndex()[0];
+      runStart[2] = it.GetIndex()[1];
+
+      // Each segment of the line is a run of voxels with the same label
+      const LabelImageType::RLLine &line = it.Value();
+      for(size_t i = 0; i < line.size(); i++)
+        {
+        LabelType label = line[i].second;
+        if(label != runLabel)
+          {
+          runLabel = label;
+          cachedEntry = &local_stats[runLabel];
+          if(cachedEntry->count == 0)
+            cachedEntry->resize(ngray);
+          }
 
-      runStart = itLabel.GetIndex();
-      runLength = 0;
+        this->RecordRunLength(ngray, layers, region, runStart, line[i].first, cachedEntry);
+        runStart[0] += line[i].first;
+        }
       }
-    }
 
-  // Record the statistics from the last run
-  this->RecordRunLength(ngray, layers, region, runStart, runLength, cachedEntry);
+    // In a reentrant block, merge into the main statistics table
+    std::lock_guard<std::mutex> guard(stats_mutex);
+    for(EntryMap::iterator it = local_stats.begin(); it != local_stats.end(); ++it)
+      {
+      Entry &src = it->second;
+      if(src.count == 0)
+        continue;
+
+      Entry &trg = m_Stats[it->first];
+      if(trg.count == 0)
+        trg.resize(ngray);
+
+      trg.count += src.count;
+      trg.nvalid += src.nvalid;
+      trg.sum += src.sum;
+      trg.sumsq += src.sumsq;
+      }
+    }, nullptr);
 
   // Compute the size of a voxel, in mm^3
   const double *spacing = 
@@ -153,9 +199,9 @@ SegmentationStatistics
 }
 
 void SegmentationStatistics
-::RecordRunLength(size_t ngray, vector<ScalarImageWrapperBase *> &layers,
-                  itk::ImageRegion<3> &region, itk::Index<3> &runStart,
-                  long runLength, Entry *cachedEntry)
+::RecordRunLength(size_t ngray, const vector<ScalarImageWrapperBase *> &layers,
+                  const itk::ImageRegion<3> &region, const itk::Index<3> &runStart,
+                  long runLength, Entry *cachedEntry) const
 {
   // Record the statistics from the last run
   for(size_t j = 0; j < ngray; j++)
@@ -176,32 +222,47 @@ void SegmentationStatistics
   // Get selected segmentation layer
   LabelImageWrapper *liw = app->GetSelectedSegmentationLayer();
 
-  // Get the iterator from the segmentation
-  LabelImageWrapper::ConstIterator it = liw->GetImageConstIterator();
+  // Walk the run-length segments of the label image directly, splitting the
+  // lines between threads and merging the per-thread counts at the end
+  const LabelImageType *label_image = liw->GetImage();
+  LabelBufferType *label_buffer = label_image->GetBuffer();
 
-  // Iterate through image and update count
-  LabelType runLabel = 0;
-  unsigned long *cachedCnt = &result[runLabel];
-  unsigned long runLength = 0;
+  // A mutex to control updating the result
+  std::mutex count_mutex;
 
-  // Start counting
-  for (; !it.IsAtEnd(); ++it, ++runLength)
+  // Parallel block
+  itk::MultiThreaderBase::Pointer mt = itk::MultiThreaderBase::New();
+  mt->ParallelizeImageRegion<2>(
+        label_buffer->GetBufferedRegion(),
+        [label_buffer, &result, &count_mutex](const LabelBufferType::RegionType &line_region)
     {
-      LabelType label = it.Value();
-      if (label != runLabel)
-        {
-          // std::cout << "run length: " << runLength << endl;
-          *cachedCnt += runLength;
+    // Thread-local voxel counts
+    LabelVoxelCount local_count;
 
-          // Reset for new count
-          runLabel = label;
-          cachedCnt = &result[runLabel];
-          runLength = 0;
+    // Cache the count to avoid many calls to std::map
+    LabelType runLabel = 0;
+    unsigned long *cachedCnt = &local_count[runLabel];
+
+    typedef itk::ImageRegionConstIterator<LabelBufferType> LineIterator;
+    for(LineIterator it(label_buffer, line_region); !it.IsAtEnd(); ++it)
+      {
+      const LabelImageType::RLLine &line = it.Value();
+      for(size_t i = 0; i < line.size(); i++)
+        {
+        if(line[i].second != runLabel)
+          {
+          runLabel = line[i].second;
+          cachedCnt = &local_count[runLabel];
+          }
+        *cachedCnt += line[i].first;
         }
-    }
+      }
 
-  // Add last run Length
-  *cachedCnt += runLength;
+    // In a reentrant block, update the result
+    std::lock_guard<std::mutex> guard(count_mutex);
+    for(LabelVoxelCount::const_iterator it = local_count.begin(); it != local_count.end(); ++it)
+      result[it->first] += it->second;
+    }, nullptr);
 
   // Debug
   /*
@@ -108,13 +108,15 @@ private:
   // Column information
   std::vector<std::string> m_ImageStatisticsColumnNames;
   
+  // Integrate intensity statistics over a run of voxels. This is called
+  // concurrently from multiple threads, each with its own entry table
   void RecordRunLength(
       size_t ngray,
-      std::vector<ScalarImageWrapperBase *> &layers,
-      itk::ImageRegion<3> &region,
-      itk::Index<3> &runStart,
+      const std::vector<ScalarImageWrapperBase *> &layers,
+      const itk::ImageRegion<3> &region,
+      const itk::Index<3> &runStart,
       long runLength,
-      Entry *cachedEntry);
+      Entry *cachedEntry) const;
 };
 
 #endif
@@ -14,6 +14,9 @@ DefaultBehaviorSettings::DefaultBehaviorSettings()
 
   m_AutoContrastModel = NewSimpleProperty("AutoContrast", false);
 
+  m_MemoryMapUncompressedImagesModel = NewSimpleProperty("MemoryMapUncompressedImages", false);
+  m_SaveSegmentationInBackgroundModel = NewSimpleProperty("SaveSegmentationInBackground", false);
+
   // Permissions
   RegistryEnumMap<UpdateCheckingPermission> remUpdate;
   remUpdate.AddPair(UPDATE_NO, "No");
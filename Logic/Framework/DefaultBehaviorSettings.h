@@ -22,6 +22,14 @@ public:
   irisSimplePropertyAccessMacro(SyncPan, bool)
   irisSimplePropertyAccessMacro(AutoContrast, bool)
 
+  // Whether uncompressed images are mapped into memory when they are loaded,
+  // see GuidedNativeImageIO::SetUseMemoryMapping
+  irisSimplePropertyAccessMacro(MemoryMapUncompressedImages, bool)
+
+  // Whether segmentations are saved on a background thread, so that editing
+  // can go on, see ImageWrapperBase::WriteToFileInBackground
+  irisSimplePropertyAccessMacro(SaveSegmentationInBackground, bool)
+
   // Permissions
   enum UpdateCheckingPermission {
     UPDATE_YES, UPDATE_NO, UPDATE_UNKNOWN
@@ -53,6 +61,8 @@ protected:
   SmartPtr<ConcreteSimpleBooleanProperty> m_SyncZoomModel;
   SmartPtr<ConcreteSimpleBooleanProperty> m_SyncPanModel;
   SmartPtr<ConcreteSimpleBooleanProperty> m_AutoContrastModel;
+  SmartPtr<ConcreteSimpleBooleanProperty> m_MemoryMapUncompressedImagesModel;
+  SmartPtr<ConcreteSimpleBooleanProperty> m_SaveSegmentationInBackgroundModel;
 
   // Permissions
   SmartPtr<ConcretePropertyModel<UpdateCheckingPermission> > m_CheckForUpdatesModel;
@@ -1877,6 +1877,8 @@ IRISApplication
 
   // Create a native image IO object
   SmartPtr<GuidedNativeImageIO> io = GuidedNativeImageIO::New();
+  io->SetUseMemoryMapping(
+        m_GlobalState->GetDefaultBehaviorSettings()->GetMemoryMapUncompressedImages());
 
   // Configure io using delegate
   del->ConfigureImageIO(io);
@@ -3,6 +3,7 @@
 #include "GenericImageData.h"
 #include "HistoryManager.h"
 #include "IRISImageData.h"
+#include "DefaultBehaviorSettings.h"
 #include "ImageWrapperTraits.h"
 #include <itkImageIOBase.h>
 #include <itkImageBase.h>
@@ -336,7 +337,10 @@ void DefaultSaveImageDelegate
   try
     {
     m_SaveSuccessful = false;
-    m_Wrapper->WriteToFile(fname.c_str(), reg);
+    if(m_SaveInBackground)
+      m_Wrapper->WriteToFileInBackground(fname.c_str(), reg);
+    else
+      m_Wrapper->WriteToFile(fname.c_str(), reg);
     m_SaveSuccessful = true;
 
     m_Wrapper->SetFileName(fname);
@@ -366,6 +370,8 @@ AbstractReloadWrapperDelegate
 ::ValidateHeader(IRISWarningList &wl)
 {
   Registry dummyReg;
+  m_IO->SetUseMemoryMapping(
+        m_Driver->GetGlobalState()->GetDefaultBehaviorSettings()->GetMemoryMapUncompressedImages());
   m_IO->ReadNativeImageHeader(m_Filename.c_str(), dummyReg, nullptr);
   auto headerFile = m_IO->GetIOBase();
 
@@ -176,7 +176,7 @@ public:
   irisITKAbstractObjectMacro(AbstractSaveImageDelegate, itk::Object)
 
   virtual void Initialize(IRISApplication *driver)
-    { m_Driver = driver; m_SaveSuccessful = false; }
+    { m_Driver = driver; m_SaveSuccessful = false; m_SaveInBackground = false; }
 
   virtual void ValidateBeforeSaving(const std::string &fname,
                                     GuidedNativeImageIO *io,
@@ -202,12 +202,20 @@ public:
    */
   irisGetSetMacro(Category, std::string)
 
+  /**
+   * Whether SaveImage only starts writing the image on a background thread.
+   * The save is then completed by ImageWrapperBase::FinishBackgroundWrite.
+   * Delegates that can not save in the background ignore this.
+   */
+  irisGetSetMacro(SaveInBackground, bool)
+
 protected:
   AbstractSaveImageDelegate() {}
   virtual ~AbstractSaveImageDelegate() {}
 
   IRISApplication *m_Driver;
   bool m_SaveSuccessful;
+  bool m_SaveInBackground;
   std::string m_Category;
 };
 
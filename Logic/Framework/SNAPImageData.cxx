@@ -61,6 +61,7 @@
 
 #include "SlicePreviewFilterWrapper.h"
 #include "PreprocessingFilterConfigTraits.h"
+#include <algorithm>
 
 
 SNAPImageData
@@ -76,6 +77,12 @@ SNAPImageData
 
   m_CompressedAlternateLabelImage = NULL;
 
+  // Background segmentation is not running
+  m_EvolutionStopRequested = false;
+  m_EvolutionIterationsPerStep = 1;
+  m_SnapshotReady = false;
+  m_SnapshotIterations = m_DisplayedIterations = 0;
+
   // Initialize Mesh Layers storage
   m_MeshLayers = ImageMeshLayers::New();
   m_MeshLayers->Initialize(this);
@@ -87,6 +94,13 @@ SNAPImageData
 SNAPImageData
 ::~SNAPImageData() 
 {
+  // The background thread must be done with the driver before it is deleted
+  if(m_EvolutionThread.joinable())
+    {
+    m_EvolutionStopRequested = true;
+    m_EvolutionThread.join();
+    }
+
   if(m_LevelSetDriver)
     delete m_LevelSetDriver;
 
@@ -362,6 +376,7 @@ SNAPImageData
 ::InitalizeSnakeDriver(const SnakeParameters &p) 
 {
   // Create a new level set driver, deleting the current one if it's there
+  StopSegmentationInBackground();
   if (m_LevelSetDriver) { delete m_LevelSetDriver; }
     
   // This is a good place to check that the parameters are valid
@@ -419,6 +434,9 @@ SNAPImageData
   // Should be in level set mode
   assert(m_LevelSetDriver);
 
+  // Finish any background evolution first
+  StopSegmentationInBackground();
+
   // Pass through to the level set driver
 
   // Enter a thread-safe section
@@ -442,12 +460,154 @@ SNAPImageData
   this->InvokeEvent(LevelSetImageChangeEvent());
 }
 
+void
+SNAPImageData
+::StartSegmentationInBackground(unsigned int nIterations)
+{
+  // Should be in level set mode
+  assert(m_LevelSetDriver);
+
+  m_EvolutionIterationsPerStep = nIterations;
+  if(m_EvolutionThread.joinable())
+    return;
+
+  // Both snapshot buffers start out with the current level set, and the front
+  // buffer takes the place of the filter output in the snake wrapper, so that
+  // the filter can update its output while the views are being drawn
+  const LevelSetImageType *output = m_LevelSetDriver->GetOutput();
+  size_t n = output->GetPixelContainer()->Size();
+  SmartPtr<SnapshotType> *buffers[] = { &m_SnapshotFront, &m_SnapshotBack };
+  for(SmartPtr<SnapshotType> *buffer : buffers)
+    {
+    *buffer = SnapshotType::New();
+    (*buffer)->Reserve(n);
+    std::copy(output->GetBufferPointer(), output->GetBufferPointer() + n,
+              (*buffer)->GetBufferPointer());
+    }
+
+  m_LevelSetPipelineMutex.lock();
+  m_SnakeWrapper->SetPixelContainer(m_SnapshotFront);
+  m_LevelSetPipelineMutex.unlock();
+
+  m_SnapshotReady = false;
+  m_SnapshotIterations = m_DisplayedIterations = m_LevelSetDriver->GetElapsedIterations();
+  m_EvolutionError = nullptr;
+  m_EvolutionStopRequested = false;
+  m_EvolutionThread = std::thread(&SNAPImageData::BackgroundSegmentationLoop, this);
+}
+
+void
+SNAPImageData
+::BackgroundSegmentationLoop()
+{
+  try
+    {
+    while(!m_EvolutionStopRequested)
+      {
+      // Run a block of iterations. The parameters may be changed between blocks.
+      std::lock_guard<std::mutex> guard(m_LevelSetDriverMutex);
+      m_LevelSetDriver->Run(m_EvolutionIterationsPerStep);
+
+      // Publish the result in the back buffer. The driver lock is still held,
+      // since changing the parameters may replace the level set filter along
+      // with its output.
+      const LevelSetImageType *output = m_LevelSetDriver->GetOutput();
+      std::lock_guard<std::mutex> snapshot_guard(m_SnapshotMutex);
+      std::copy(output->GetBufferPointer(),
+                output->GetBufferPointer() + m_SnapshotBack->Size(),
+                m_SnapshotBack->GetBufferPointer());
+      m_SnapshotIterations = m_LevelSetDriver->GetElapsedIterations();
+      m_SnapshotReady = true;
+      }
+    }
+  catch(...)
+    {
+    std::lock_guard<std::mutex> guard(m_SnapshotMutex);
+    m_EvolutionError = std::current_exception();
+    }
+}
+
+bool
+SNAPImageData
+::UpdateSnakeFromBackgroundSegmentation()
+{
+  if(!m_EvolutionThread.joinable())
+    return false;
+
+  // Errors on the background thread stop the evolution and are reported here
+  std::exception_ptr error;
+    {
+    std::lock_guard<std::mutex> guard(m_SnapshotMutex);
+    error = m_EvolutionError;
+    }
+  if(error)
+    {
+    StopSegmentationInBackground();
+    std::rethrow_exception(error);
+    }
+
+    {
+    std::lock_guard<std::mutex> guard(m_SnapshotMutex);
+    if(!m_SnapshotReady)
+      return false;
+
+    // The mesh pipeline may be computing a mesh from the front buffer in
+    // another thread, and holds the pipeline lock until it is done with it.
+    // In that case the buffers are swapped on a later call, since the old
+    // front buffer is overwritten by the next block of iterations.
+    std::unique_lock<std::mutex> pipeline_lock(m_LevelSetPipelineMutex, std::try_to_lock);
+    if(!pipeline_lock.owns_lock())
+      return false;
+
+    std::swap(m_SnapshotFront, m_SnapshotBack);
+    m_SnakeWrapper->SetPixelContainer(m_SnapshotFront);
+    pipeline_lock.unlock();
+
+    m_DisplayedIterations = m_SnapshotIterations;
+    m_SnapshotReady = false;
+    }
+
+  // Fire the update event
+  this->InvokeEvent(LevelSetImageChangeEvent());
+  return true;
+}
+
+void
+SNAPImageData
+::StopSegmentationInBackground()
+{
+  if(!m_EvolutionThread.joinable())
+    return;
+
+  // Wait for the current block of iterations to finish
+  m_EvolutionStopRequested = true;
+  m_EvolutionThread.join();
+
+  // Show the filter output in the snake wrapper again and release the buffers
+  m_LevelSetPipelineMutex.lock();
+  m_SnakeWrapper->SetPixelContainer(m_LevelSetDriver->GetOutput()->GetPixelContainer());
+  m_LevelSetPipelineMutex.unlock();
+
+  m_SnapshotFront = NULL;
+  m_SnapshotBack = NULL;
+  m_SnapshotReady = false;
+
+  // An error in the last block of iterations is only reported by
+  // UpdateSnakeFromBackgroundSegmentation, since this is also called when
+  // the user pauses, rewinds or leaves the evolution
+  m_EvolutionError = nullptr;
+
+  // Fire the update event
+  this->InvokeEvent(LevelSetImageChangeEvent());
+}
+
 bool
 SNAPImageData
 ::IsEvolutionConverged()
 {
   // Make the method reentrant
   std::lock_guard<std::mutex> guard(m_LevelSetPipelineMutex);
+  std::lock_guard<std::mutex> driver_guard(m_LevelSetDriverMutex);
 
   return m_LevelSetDriver->IsEvolutionConverged();
 }
@@ -459,6 +619,9 @@ SNAPImageData
   // Should be in level set mode
   assert(m_LevelSetDriver);
 
+  // Stop any background evolution first
+  StopSegmentationInBackground();
+
   // Enter a thread-safe section
   m_LevelSetPipelineMutex.lock();
 
@@ -485,6 +648,9 @@ SNAPImageData
   // Should be in level set mode
   assert(m_LevelSetDriver);
 
+  // Stop any background evolution first
+  StopSegmentationInBackground();
+
   // Enter a thread-safe section
   m_LevelSetPipelineMutex.lock();
 
@@ -505,7 +671,10 @@ SNAPImageData
   // Should be in level set mode
   assert(m_LevelSetDriver);
 
-  // Pass through to the level set driver
+  // Pass through to the level set driver. If the segmentation is running in
+  // the background, the parameters take effect with the next block of
+  // iterations.
+  std::lock_guard<std::mutex> guard(m_LevelSetDriverMutex);
   m_LevelSetDriver->SetSnakeParameters(parameters);
 }
 
@@ -513,6 +682,10 @@ unsigned int
 SNAPImageData::
 GetElapsedSegmentationIterations() const
 {
+  // While running in the background, report the iterations that are shown
+  if(m_EvolutionThread.joinable())
+    return m_DisplayedIterations;
+
   return m_LevelSetDriver->GetElapsedIterations();
 }
 
@@ -653,6 +826,9 @@ void SNAPImageData::CopyLayerMetadata(
 
 void SNAPImageData::UnloadAll()
 {
+  // The background segmentation uses the snake wrapper
+  StopSegmentationInBackground();
+
   // Unload all the data
   this->UnloadOverlays();
   this->UnloadMainImage();
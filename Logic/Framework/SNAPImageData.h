@@ -48,6 +48,10 @@
 #include "SNAPLevelSetDriver.h"
 
 #include <vector>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
 
 #include "SNAPLevelSetFunction.h"
 #include "itkImageAdaptor.h"
@@ -163,6 +167,36 @@ public:
   /** Run the segmentation for a fixed number of iterations */
   void RunSegmentation(unsigned int nIterations);
 
+  /**
+   * Start running the segmentation on a background thread, nIterations at a
+   * time, until StopSegmentationInBackground() is called. After each block of
+   * iterations the level set is copied into a back buffer, which is swapped
+   * with the buffer shown by the snake wrapper when the GUI thread calls
+   * UpdateSnakeFromBackgroundSegmentation(). If the segmentation is already
+   * running, this only changes the number of iterations per block.
+   */
+  void StartSegmentationInBackground(unsigned int nIterations);
+
+  /**
+   * Stop the background segmentation once the current block of iterations is
+   * done, and show its final state in the snake wrapper. The segmentation can
+   * be resumed, rewound or terminated afterwards. Does not throw; errors on
+   * the background thread are reported by UpdateSnakeFromBackgroundSegmentation.
+   */
+  void StopSegmentationInBackground();
+
+  /** Check if the segmentation is running on a background thread */
+  bool IsSegmentationRunningInBackground() const
+    { return m_EvolutionThread.joinable(); }
+
+  /**
+   * Show the latest level set computed on the background thread. This must be
+   * called on the GUI thread. Returns true if the snake image has changed. If
+   * the background thread failed, the evolution is stopped and the exception
+   * thrown there is rethrown.
+   */
+  bool UpdateSnakeFromBackgroundSegmentation();
+
   /** Revert the segmentation to the beginning */
   void RestartSegmentation();
 
@@ -288,6 +322,26 @@ protected:
   // causing the level set pipeline to update at once.
   std::mutex m_LevelSetPipelineMutex;
 
+  // Body of the thread that runs the segmentation in the background
+  void BackgroundSegmentationLoop();
+
+  // Background segmentation thread and the state shared with it. The level
+  // set driver is only used by the thread while m_LevelSetDriverMutex is held.
+  std::thread m_EvolutionThread;
+  std::atomic<bool> m_EvolutionStopRequested;
+  std::atomic<unsigned int> m_EvolutionIterationsPerStep;
+  std::mutex m_LevelSetDriverMutex;
+
+  // Double buffered snapshots of the level set. The front buffer is shown by
+  // the snake wrapper, the back buffer is filled by the background thread
+  // under m_SnapshotMutex.
+  typedef LevelSetImageType::PixelContainer SnapshotType;
+  SmartPtr<SnapshotType> m_SnapshotFront, m_SnapshotBack;
+  std::mutex m_SnapshotMutex;
+  bool m_SnapshotReady;
+  unsigned int m_SnapshotIterations, m_DisplayedIterations;
+  std::exception_ptr m_EvolutionError;
+
   // Are we in example mode
   bool m_LabelImageInExampleMode;
 
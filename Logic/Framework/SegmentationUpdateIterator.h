@@ -74,7 +74,7 @@ public:
       m_Region(region),
       m_ActiveLabel(active_label),
       m_DrawOver(draw_over),
-      m_Iterator(seg_wrapper->GetModifiableImage(), region),
+      m_Image(seg_wrapper->GetModifiableImage()),
       m_ChangedVoxels(0)
   {
     // Create the delta
@@ -83,10 +83,22 @@ public:
 
     // Set the voxel delta to zero
     m_VoxelDelta = 0;
+
+    // The labels are edited one line at a time. Each line of the region is
+    // decoded into a buffer, edited there, and written back to the RLE image
+    // in bulk when the iterator moves on to the next line
+    m_Index = region.GetIndex();
+    m_LineStart = region.GetIndex(0) - m_Image->GetBufferedRegion().GetIndex(0);
+    m_LineBuffer.resize(region.GetSize(0));
+    m_LineModified = false;
+    m_AtEnd = (region.GetNumberOfPixels() == 0);
+    if(!m_AtEnd)
+      this->LoadLine();
   }
 
   ~SegmentationUpdateIterator()
   {
+    this->FlushLine();
     if(m_Delta)
       delete m_Delta;
   }
@@ -101,13 +113,34 @@ public:
     if(m_VoxelDelta != 0)
       m_ChangedVoxels++;
 
-    // Update the internal iterator
-    ++m_Iterator;
+    // Move to the next voxel in the line
+    if(++m_LinePos < m_LineBuffer.size())
+      {
+      m_Index[0]++;
+      return;
+      }
+
+    // We reached the end of the line, write it back to the image
+    this->FlushLine();
+
+    // Move to the next line in the region
+    m_Index[0] = m_Region.GetIndex(0);
+    if(++m_Index[1] > m_Region.GetUpperIndex()[1])
+      {
+      m_Index[1] = m_Region.GetIndex(1);
+      if(++m_Index[2] > m_Region.GetUpperIndex()[2])
+        {
+        m_AtEnd = true;
+        return;
+        }
+      }
+
+    this->LoadLine();
   }
 
   const IndexType GetIndex()
   {
-    return m_Iterator.GetIndex();
+    return m_Index;
   }
 
   /**
@@ -115,7 +148,7 @@ public:
    */
   virtual void PaintLabel(LabelType new_label)
   {
-    LabelType lOld = m_Iterator.Get();
+    LabelType lOld = m_LineBuffer[m_LinePos];
 
     if(m_DrawOver.CoverageMode == PAINT_OVER_ALL ||
        (m_DrawOver.CoverageMode == PAINT_OVER_ONE && lOld == m_DrawOver.DrawOverLabel) ||
@@ -124,7 +157,7 @@ public:
       if(lOld != new_label)
         {
         m_VoxelDelta += new_label - lOld;
-        m_Iterator.Set(new_label);
+        this->SetCurrentLabel(new_label);
         m_ChangedVoxels++;
         }
       }
@@ -144,7 +177,7 @@ public:
    */
   void PaintAsForegroundPreserveClear()
   {
-    LabelType lOld = m_Iterator.Get();
+    LabelType lOld = m_LineBuffer[m_LinePos];
     if(lOld == 0)
       return;
 
@@ -155,7 +188,7 @@ public:
       if(lOld != m_ActiveLabel)
         {
         m_VoxelDelta += m_ActiveLabel - lOld;
-        m_Iterator.Set(m_ActiveLabel);
+        this->SetCurrentLabel(m_ActiveLabel);
         m_ChangedVoxels++;
         }
       }
@@ -166,12 +199,12 @@ public:
    */
   void PaintAsBackground()
   {
-    LabelType lOld = m_Iterator.Get();
+    LabelType lOld = m_LineBuffer[m_LinePos];
 
     if(m_ActiveLabel != 0 && lOld == m_ActiveLabel)
       {
       m_VoxelDelta += 0 - lOld;
-      m_Iterator.Set(0);
+      this->SetCurrentLabel(0);
       m_ChangedVoxels++;
       }
   }
@@ -182,12 +215,12 @@ public:
    */
   void ReplaceLabel(LabelType target_label, LabelType new_label)
   {
-    LabelType lOld = m_Iterator.Get();
+    LabelType lOld = m_LineBuffer[m_LinePos];
 
     if(lOld == target_label)
       {
       m_VoxelDelta += new_label - lOld;
-      m_Iterator.Set(new_label);
+      this->SetCurrentLabel(new_label);
       m_ChangedVoxels++;
       }
   }
@@ -201,7 +234,7 @@ public:
    */
   void PaintLabelWithExtraProtection(LabelType protect_label, LabelType new_label)
   {
-    LabelType lOld = m_Iterator.Get();
+    LabelType lOld = m_LineBuffer[m_LinePos];
   
     // Test for protection or empty operation
     if(lOld == protect_label || lOld == new_label)
@@ -213,7 +246,7 @@ public:
        (m_DrawOver.CoverageMode == PAINT_OVER_VISIBLE && lOld != 0))
       {
       m_VoxelDelta += new_label - lOld;
-      m_Iterator.Set(new_label);
+      this->SetCurrentLabel(new_label);
       m_ChangedVoxels++;
       }
   }
@@ -221,7 +254,7 @@ public:
 
   bool IsAtEnd()
   {
-    return m_Iterator.IsAtEnd();
+    return m_AtEnd;
   }
 
   /**
@@ -232,6 +265,7 @@ public:
    */
   bool Finalize(const char *undo_string = nullptr)
   {
+    this->FlushLine();
     m_Delta->FinishEncoding();
     if(m_ChangedVoxels > 0)
       {
@@ -283,14 +317,58 @@ protected:
   // RLE encoding of the segmentation update - for storing undo/redo points
   UndoDelta *m_Delta;
 
-  // Iterator used internally
-  LabelIteratorType m_Iterator;
+  // The label image being updated
+  LabelImageType *m_Image;
+
+  // Index of the current voxel
+  IndexType m_Index;
+
+  // Labels of the current line of the region, edited by the paint methods
+  std::vector<LabelType> m_LineBuffer;
+
+  // Offset of the region from the start of each line, position of the current
+  // voxel in the line buffer, and whether the line buffer has been edited
+  itk::IndexValueType m_LineStart;
+  size_t m_LinePos;
+  bool m_LineModified;
+
+  // Whether the iteration is finished
+  bool m_AtEnd;
 
   // Delta at the current location
   LabelType m_VoxelDelta;
 
   // Number of voxels actually modified
   unsigned long m_ChangedVoxels;
+
+  // Set the label of the current voxel in the line buffer
+  void SetCurrentLabel(LabelType label)
+  {
+    m_LineBuffer[m_LinePos] = label;
+    m_LineModified = true;
+  }
+
+  // Decode the current line of the region into the line buffer
+  void LoadLine()
+  {
+    const LabelImageType::RLLine &line =
+        m_Image->GetBuffer()->GetPixel(LabelImageType::truncateIndex(m_Index));
+    LabelImageType::GetLineSpan(line, m_LineStart, m_LineBuffer.size(), m_LineBuffer.data());
+    m_LinePos = 0;
+    m_LineModified = false;
+  }
+
+  // Write the line buffer back into the image, rebuilding the RLE line in one pass
+  void FlushLine()
+  {
+    if(m_LineModified)
+      {
+      LabelImageType::RLLine &line =
+          m_Image->GetBuffer()->GetPixel(LabelImageType::truncateIndex(m_Index));
+      m_Image->SetLineSpan(line, m_LineStart, m_LineBuffer.size(), m_LineBuffer.data());
+      m_LineModified = false;
+      }
+  }
 };
 
 
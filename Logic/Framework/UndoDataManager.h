@@ -39,19 +39,28 @@
 #include <list>
 
 #include <RLEImage.h>
+#include "UndoMemoryBudget.h"
 
 /**
  * The Delta class represents a difference between two images used in
  * the Undo system. It only supports linear traversal of images and
  * stores differences in an RLE (run length encoding) format.
+ *
+ * Deltas that are not likely to be needed soon can be packed into a compact
+ * format (varint-encoded runs, compressed with deflate) and further spilled
+ * into the swap file managed by UndoMemoryBudget. A delta must be unpacked
+ * before its RLEs can be accessed.
  */
 template <typename TPixel>
 class UndoDelta
 {
 public:
   typedef itk::ImageRegion<3> RegionType;
+  typedef RLEImage<TPixel> ImageType;
 
   UndoDelta();
+  UndoDelta(const UndoDelta &other);
+  ~UndoDelta();
 
   void SetRegion(const RegionType &region)
   { this->m_Region = region; }
@@ -63,8 +72,8 @@ public:
 
   void FinishEncoding();
 
-  size_t GetNumberOfRLEs()
-  { return m_Array.size(); }
+  size_t GetNumberOfRLEs() const
+  { return m_Storage == RAW ? m_Array.size() : m_NumberOfRLEs; }
 
   TPixel GetRLEValue(size_t i)
   { return m_Array[i].second; }
@@ -77,6 +86,38 @@ public:
 
   UndoDelta & operator = (const UndoDelta &other);
 
+  /**
+   * Apply the delta to a run-length encoded image. If reverse is true, the
+   * delta is subtracted from the image (undo), otherwise it is added (redo).
+   * The delta is split into scanlines, with runs of zero delta skipped in bulk,
+   * and each affected RLLine is rewritten in a single merge pass. The lines are
+   * independent of each other and are processed in parallel.
+   */
+  void ApplyToImage(ImageType *image, bool reverse) const;
+
+  /** Convert the RLE array into the packed format, releasing the array */
+  void Pack();
+
+  /** Restore the RLE array from the packed format or from the swap file */
+  void Unpack();
+
+  /** Move the packed data into the swap file, packing first if needed */
+  void Spill();
+
+  /** Is the delta in packed (or spilled) format */
+  bool IsPacked() const { return m_Storage != RAW; }
+
+  /** Has the delta been moved to the swap file */
+  bool IsSpilled() const { return m_Storage == SPILLED; }
+
+  /** Number of bytes of memory occupied by the delta's data */
+  size_t GetMemoryInUse() const
+  { return m_Array.capacity() * sizeof(RLEPair) + m_Packed.capacity(); }
+
+  /** Number of bytes occupied by the delta in the swap file */
+  size_t GetSpilledSize() const
+  { return m_Storage == SPILLED ? m_PackedSize : 0; }
+
 protected:
   typedef std::pair<size_t, TPixel> RLEPair;
   typedef std::vector<RLEPair> RLEArray;
@@ -84,6 +125,15 @@ protected:
   size_t m_CurrentLength;
   TPixel m_LastValue;
 
+  // How the RLE data is currently stored
+  enum StorageMode { RAW, PACKED, SPILLED };
+  StorageMode m_Storage;
+
+  // Packed data: number of RLEs, size of the varint stream before deflate,
+  // size of the deflated data, and its offset in the swap file when spilled
+  std::vector<unsigned char> m_Packed;
+  size_t m_NumberOfRLEs, m_VarintSize, m_PackedSize, m_SwapOffset;
+
   // The delta is associated with an image region
   RegionType m_Region;
 
@@ -97,7 +147,7 @@ protected:
  * \class UndoDataManager
  * \brief Manages data (delta updates) for undo/redo in itk-snap
  */
-template<typename TPixel> class UndoDataManager
+template<typename TPixel> class UndoDataManager : public UndoDataManagerBase
 {
 public:
 
@@ -120,16 +170,37 @@ public:
   class Commit
   {
   public:
-    Commit(const DList &list, const char *name);
+    Commit(const DList &list, const char *name, unsigned long sequence);
     void DeleteDeltas();
     size_t GetNumberOfRLEs() const;
     const DList &GetDeltas() const { return m_Deltas; }
+
+    /** Sequence number of the commit, increasing across all managers */
+    unsigned long GetSequenceNumber() const { return m_Sequence; }
+
+    /** Pack, unpack or spill all the deltas in the commit */
+    void Pack();
+    void Unpack();
+    void Spill();
+
+    bool IsPacked() const;
+    bool IsSpilled() const;
+    size_t GetMemoryInUse() const;
+    size_t GetSpilledSize() const;
+
   protected:
     DList m_Deltas;
     std::string m_Name;
+    unsigned long m_Sequence;
   };
 
-  UndoDataManager(size_t nMinCommits, size_t nMaxTotalSize);
+  /**
+   * Create an undo manager. The owner is the object (e.g., the segmentation
+   * layer) on whose behalf the undo data is stored, and is only used to report
+   * memory usage through UndoMemoryBudget.
+   */
+  UndoDataManager(size_t nMinCommits, size_t nMaxTotalSize, const void *owner = NULL);
+  ~UndoDataManager();
 
   /** Add a delta to the staging list. The staging list must be committed */
   void AddDeltaToStaging(Delta *delta);
@@ -149,6 +220,13 @@ public:
   size_t GetNumberOfCommits()
     { return m_CommitList.size(); }
 
+  /** Memory accounting, used by the UndoMemoryBudget */
+  virtual size_t GetMemoryInUse() const ITK_OVERRIDE;
+  virtual size_t GetPackedMemoryInUse() const ITK_OVERRIDE;
+  virtual size_t GetSpilledSize() const ITK_OVERRIDE;
+  virtual unsigned long GetOldestSpillableCommit() const ITK_OVERRIDE;
+  virtual void SpillOldestCommit() ITK_OVERRIDE;
+
 private:
 
   // Current staging list - where deltas are added
@@ -163,6 +241,9 @@ private:
   CList m_CommitList;
   CIterator m_Position;
   size_t m_TotalSize, m_MinCommits, m_MaxTotalSize;
+
+  // Pack all the commits except the one given, which is kept ready for use
+  void PackCommitsExcept(CIterator keep);
 };
 
 #endif // __UndoDataManager_h_
@@ -32,6 +32,11 @@
   PURPOSE.  See the above copyright notices for more information. 
 
 =========================================================================*/
+#include "itkMultiThreaderBase.h"
+#include "itk_zlib.h"
+#include "IRISException.h"
+#include <algorithm>
+#include <type_traits>
 
 template<typename TPixel> unsigned long UndoDelta<TPixel>::m_UniqueIDCounter = 0;
 
@@ -41,6 +46,26 @@ UndoDelta<TPixel>
 {
   m_CurrentLength = 0;
   m_UniqueID = m_UniqueIDCounter++;
+  m_Storage = RAW;
+  m_NumberOfRLEs = m_VarintSize = m_PackedSize = m_SwapOffset = 0;
+}
+
+template<typename TPixel>
+UndoDelta<TPixel>
+::UndoDelta(const UndoDelta<TPixel> &other)
+  : UndoDelta()
+{
+  // The copy gets its own unique ID and, if the other delta is spilled, its
+  // own packed data (see operator =)
+  *this = other;
+}
+
+template<typename TPixel>
+UndoDelta<TPixel>
+::~UndoDelta()
+{
+  if(m_Storage == SPILLED)
+    UndoMemoryBudget::GetInstance().ReleaseSwap(m_PackedSize);
 }
 
 template<typename TPixel>
@@ -79,22 +104,317 @@ UndoDelta<TPixel> &
 UndoDelta<TPixel>
 ::operator = (const UndoDelta<TPixel> &other)
 {
+  if(m_Storage == SPILLED)
+    UndoMemoryBudget::GetInstance().ReleaseSwap(m_PackedSize);
+
   m_Array = other.m_Array;
   m_CurrentLength = other.m_CurrentLength;
   m_LastValue = other.m_LastValue;
   m_Region = other.m_Region;
+  m_NumberOfRLEs = other.m_NumberOfRLEs;
+  m_VarintSize = other.m_VarintSize;
+  m_PackedSize = other.m_PackedSize;
+  m_SwapOffset = 0;
+
+  // A spilled delta is copied as a packed delta, so that the two deltas do not
+  // share a block in the swap file
+  m_Packed = other.m_Packed;
+  if(other.m_Storage == SPILLED)
+    {
+    m_Packed.resize(m_PackedSize);
+    UndoMemoryBudget::GetInstance().ReadFromSwap(other.m_SwapOffset, m_Packed);
+    m_Storage = PACKED;
+    }
+  else
+    {
+    m_Storage = other.m_Storage;
+    }
+
   return *this;
 }
 
+template<typename TPixel>
+void
+UndoDelta<TPixel>
+::Pack()
+{
+  if(m_Storage != RAW)
+    return;
+
+  // Encode the RLEs as varints. The values are differences between labels, so
+  // they are zig-zag encoded in order for small negative values to be short
+  typedef typename std::make_signed<TPixel>::type SignedPixel;
+  std::vector<unsigned char> varint;
+  varint.reserve(m_Array.size() * 3);
+  for(typename RLEArray::const_iterator it = m_Array.begin(); it != m_Array.end(); ++it)
+    {
+    long long sv = (SignedPixel) it->second;
+    unsigned long long field[2] =
+      { (unsigned long long) it->first, (unsigned long long) ((sv << 1) ^ (sv >> 63)) };
+    for(int k = 0; k < 2; k++)
+      {
+      unsigned long long v = field[k];
+      while(v >= 0x80)
+        {
+        varint.push_back((unsigned char) (v | 0x80));
+        v >>= 7;
+        }
+      varint.push_back((unsigned char) v);
+      }
+    }
+
+  // Compress the varint stream
+  uLongf packed_size = compressBound(varint.size());
+  m_Packed.resize(packed_size);
+  if(compress2(m_Packed.data(), &packed_size, varint.data(), varint.size(), Z_BEST_SPEED) != Z_OK)
+    throw IRISException("Failed to compress undo data");
+  m_Packed.resize(packed_size);
+  m_Packed.shrink_to_fit();
+
+  m_NumberOfRLEs = m_Array.size();
+  m_VarintSize = varint.size();
+  m_PackedSize = packed_size;
+
+  // Release the RLE array
+  RLEArray().swap(m_Array);
+  m_Storage = PACKED;
+}
+
+template<typename TPixel>
+void
+UndoDelta<TPixel>
+::Spill()
+{
+  if(m_Storage == SPILLED)
+    return;
+
+  this->Pack();
+  m_SwapOffset = UndoMemoryBudget::GetInstance().WriteToSwap(m_Packed);
+  std::vector<unsigned char>().swap(m_Packed);
+  m_Storage = SPILLED;
+}
+
+template<typename TPixel>
+void
+UndoDelta<TPixel>
+::Unpack()
+{
+  if(m_Storage == RAW)
+    return;
+
+  // Page the packed data back from the swap file
+  if(m_Storage == SPILLED)
+    {
+    m_Packed.resize(m_PackedSize);
+    UndoMemoryBudget::GetInstance().ReadFromSwap(m_SwapOffset, m_Packed);
+    UndoMemoryBudget::GetInstance().ReleaseSwap(m_PackedSize);
+    }
+
+  // Decompress the varint stream
+  std::vector<unsigned char> varint(m_VarintSize);
+  uLongf varint_size = m_VarintSize;
+  if(uncompress(varint.data(), &varint_size, m_Packed.data(), m_Packed.size()) != Z_OK
+     || varint_size != m_VarintSize)
+    throw IRISException("Failed to decompress undo data");
+
+  // Decode the RLEs
+  typedef typename std::make_signed<TPixel>::type SignedPixel;
+  m_Array.resize(m_NumberOfRLEs);
+  const unsigned char *p = varint.data();
+  for(size_t i = 0; i < m_NumberOfRLEs; i++)
+    {
+    unsigned long long field[2];
+    for(int k = 0; k < 2; k++)
+      {
+      unsigned long long v = 0;
+      int shift = 0;
+      while(*p & 0x80)
+        {
+        v |= ((unsigned long long) (*p++ & 0x7f)) << shift;
+        shift += 7;
+        }
+      v |= ((unsigned long long) *p++) << shift;
+      field[k] = v;
+      }
+
+    long long sv = (long long) (field[1] >> 1) ^ -((long long) (field[1] & 1));
+    m_Array[i] = std::make_pair((size_t) field[0], (TPixel) (SignedPixel) sv);
+    }
+
+  std::vector<unsigned char>().swap(m_Packed);
+  m_Storage = RAW;
+}
+
+
+template<typename TPixel>
+void
+UndoDelta<TPixel>
+::ApplyToImage(ImageType *image, bool reverse) const
+{
+  typedef typename ImageType::RLLine RLLine;
+  typedef typename ImageType::RLSegment RLSegment;
+  typedef typename ImageType::BufferType BufferType;
+
+  // Dimensions of the delta region. The delta traverses the region in scanline
+  // order, so every nx consecutive values in the delta map to a single RLLine
+  size_t nx = m_Region.GetSize(0);
+  size_t ny = m_Region.GetSize(1);
+  size_t nlines = ny * m_Region.GetSize(2);
+  if(nx == 0 || nlines == 0)
+    return;
+
+  // Offset of the region from the start of each RLLine
+  size_t x0 = m_Region.GetIndex(0) - image->GetBufferedRegion().GetIndex(0);
+
+  // For each line that has a non-zero delta, record its position in the region
+  // and the position in the RLE array (run and offset into the run) at which
+  // the delta for that line begins
+  struct LineStart { size_t line, run, offset; };
+  std::vector<LineStart> lines;
+
+  // Sequential pass over the RLEs to split them into lines
+  size_t run = 0, offset = 0, q = 0;
+  while(q < nlines && run < m_Array.size())
+    {
+    size_t avail = m_Array[run].first - offset;
+
+    // A zero run that covers one or more whole lines is skipped in bulk
+    if(m_Array[run].second == 0 && avail >= nx)
+      {
+      size_t nskip = std::min(avail / nx, nlines - q);
+      q += nskip;
+      offset += nskip * nx;
+      if(offset == m_Array[run].first)
+        {
+        ++run;
+        offset = 0;
+        }
+      continue;
+      }
+
+    // Otherwise walk the runs in this line, checking for non-zero values
+    LineStart ls = { q, run, offset };
+    bool nonzero = false;
+    for(size_t k = nx; k > 0 && run < m_Array.size(); )
+      {
+      size_t take = std::min(k, (size_t) m_Array[run].first - offset);
+      if(m_Array[run].second != 0)
+        nonzero = true;
+      k -= take;
+      offset += take;
+      if(offset == m_Array[run].first)
+        {
+        ++run;
+        offset = 0;
+        }
+      }
+
+    if(nonzero)
+      lines.push_back(ls);
+    ++q;
+    }
+
+  // Get the buffer of RLLines
+  BufferType *buffer = image->GetBuffer();
+  typename BufferType::IndexType buffer_start = ImageType::truncateIndex(m_Region.GetIndex());
+
+  // Rewrite the affected lines in parallel
+  itk::MultiThreaderBase::Pointer mt = itk::MultiThreaderBase::New();
+  mt->ParallelizeArray(0, lines.size(), [&](itk::SizeValueType i)
+    {
+    const LineStart &ls = lines[i];
+
+    // Find the RLLine corresponding to this line
+    typename BufferType::IndexType bidx = buffer_start;
+    bidx[0] += ls.line % ny;
+    bidx[1] += ls.line / ny;
+    RLLine &line = buffer->GetPixel(bidx);
+
+    // The new line, built by merging the old line with the delta
+    RLLine out;
+    out.reserve(line.size() + 2);
+
+    // Append a run to the new line, merging with the last run if possible
+    auto emit = [&out](size_t n, TPixel value)
+      {
+      if(n == 0)
+        return;
+      if(out.size() && out.back().second == value)
+        out.back().first += n;
+      else
+        out.push_back(RLSegment(n, value));
+      };
+
+    // Position in the old line: current segment and pixels remaining in it
+    size_t s = 0, srem = line[0].first;
+    auto advance_line = [&line, &s, &srem](size_t n)
+      {
+      srem -= n;
+      if(srem == 0 && ++s < line.size())
+        srem = line[s].first;
+      };
+
+    // Copy the part of the line before the region
+    for(size_t k = x0; k > 0; )
+      {
+      size_t take = std::min(k, srem);
+      emit(take, line[s].second);
+      advance_line(take);
+      k -= take;
+      }
+
+    // Apply the delta within the region
+    size_t drun = ls.run, doff = ls.offset;
+    for(size_t k = nx; k > 0 && drun < m_Array.size(); )
+      {
+      size_t take = std::min(k, std::min(srem, (size_t) m_Array[drun].first - doff));
+      TPixel d = m_Array[drun].second;
+      TPixel v = line[s].second;
+      emit(take, reverse ? (TPixel)(v - d) : (TPixel)(v + d));
+      advance_line(take);
+      k -= take;
+      doff += take;
+      if(doff == m_Array[drun].first)
+        {
+        ++drun;
+        doff = 0;
+        }
+      }
+
+    // Copy the part of the line after the region
+    while(s < line.size())
+      {
+      emit(srem, line[s].second);
+      advance_line(srem);
+      }
+
+    line.swap(out);
+    }, nullptr);
+
+  // The lines were rewritten directly, bypassing the image's own methods
+  image->Modified();
+}
+
 
 template<typename TPixel>
 UndoDataManager<TPixel>
-::UndoDataManager(size_t nMinCommits, size_t nMaxTotalSize)
+::UndoDataManager(size_t nMinCommits, size_t nMaxTotalSize, const void *owner)
 {
   this->m_MinCommits = nMinCommits;
   this->m_MaxTotalSize = nMaxTotalSize;
   this->m_TotalSize = 0;
   m_Position = m_CommitList.begin();
+
+  // Share the global undo memory budget
+  UndoMemoryBudget::GetInstance().Register(this, owner);
+}
+
+template<typename TPixel>
+UndoDataManager<TPixel>
+::~UndoDataManager()
+{
+  UndoMemoryBudget::GetInstance().Unregister(this);
+  this->Clear();
 }
 
 template<typename TPixel>
@@ -141,7 +461,8 @@ UndoDataManager<TPixel>
     }
 
   // Create a commit that we will be adding
-  Commit new_commit(m_StagingList, text);
+  Commit new_commit(m_StagingList, text,
+                    UndoMemoryBudget::GetInstance().GetNextCommitSequenceNumber());
 
   // Empty the staging list
   m_StagingList.clear();
@@ -171,6 +492,12 @@ UndoDataManager<TPixel>
   m_Position = m_CommitList.end();
   m_TotalSize += n_new_rles;
 
+  // Only the newest commit, which is the one most likely to be undone, is kept
+  // in raw form. Older commits are packed, and spilled to disk if the global
+  // undo memory budget is exceeded
+  this->PackCommitsExcept(--m_CommitList.end());
+  UndoMemoryBudget::GetInstance().Enforce();
+
   // Return the number of RLEs
   return n_new_rles;
 }
@@ -194,6 +521,11 @@ UndoDataManager<TPixel>
   // Move the position one delta to the beginning
   m_Position--;
 
+  // Make sure the commit is unpacked and pack the others
+  m_Position->Unpack();
+  this->PackCommitsExcept(m_Position);
+  UndoMemoryBudget::GetInstance().Enforce();
+
   // Return the current delta
   return *m_Position;
 }
@@ -214,6 +546,11 @@ UndoDataManager<TPixel>
   // Can't be at the beginning
   assert(IsRedoPossible());
 
+  // Make sure the commit is unpacked and pack the others
+  m_Position->Unpack();
+  this->PackCommitsExcept(m_Position);
+  UndoMemoryBudget::GetInstance().Enforce();
+
   // Return the delta at the current position
   const Commit &commit = *m_Position;
 
@@ -227,10 +564,151 @@ UndoDataManager<TPixel>
 
 
 template<typename TPixel>
-UndoDataManager<TPixel>::Commit::Commit(const DList &list, const char *name)
+void
+UndoDataManager<TPixel>
+::PackCommitsExcept(CIterator keep)
+{
+  for(CIterator it = m_CommitList.begin(); it != m_CommitList.end(); ++it)
+    if(it != keep && !it->IsPacked())
+      it->Pack();
+}
+
+template<typename TPixel>
+size_t
+UndoDataManager<TPixel>
+::GetMemoryInUse() const
+{
+  size_t n = 0;
+  for(CConstIterator it = m_CommitList.begin(); it != m_CommitList.end(); ++it)
+    n += it->GetMemoryInUse();
+  return n;
+}
+
+template<typename TPixel>
+size_t
+UndoDataManager<TPixel>
+::GetPackedMemoryInUse() const
+{
+  size_t n = 0;
+  for(CConstIterator it = m_CommitList.begin(); it != m_CommitList.end(); ++it)
+    if(it->IsPacked())
+      n += it->GetMemoryInUse();
+  return n;
+}
+
+template<typename TPixel>
+size_t
+UndoDataManager<TPixel>
+::GetSpilledSize() const
+{
+  size_t n = 0;
+  for(CConstIterator it = m_CommitList.begin(); it != m_CommitList.end(); ++it)
+    n += it->GetSpilledSize();
+  return n;
+}
+
+template<typename TPixel>
+unsigned long
+UndoDataManager<TPixel>
+::GetOldestSpillableCommit() const
+{
+  for(CConstIterator it = m_CommitList.begin(); it != m_CommitList.end(); ++it)
+    if(it->IsPacked() && !it->IsSpilled())
+      return it->GetSequenceNumber();
+  return 0;
+}
+
+template<typename TPixel>
+void
+UndoDataManager<TPixel>
+::SpillOldestCommit()
+{
+  for(CIterator it = m_CommitList.begin(); it != m_CommitList.end(); ++it)
+    {
+    if(it->IsPacked() && !it->IsSpilled())
+      {
+      it->Spill();
+      return;
+      }
+    }
+}
+
+template<typename TPixel>
+UndoDataManager<TPixel>::Commit::Commit(const DList &list, const char *name,
+                                        unsigned long sequence)
 {
   m_Deltas = list;
   m_Name = name;
+  m_Sequence = sequence;
+}
+
+template<typename TPixel>
+void
+UndoDataManager<TPixel>::Commit::Pack()
+{
+  for(DIterator dit = m_Deltas.begin(); dit != m_Deltas.end(); ++dit)
+    if(*dit)
+      (*dit)->Pack();
+}
+
+template<typename TPixel>
+void
+UndoDataManager<TPixel>::Commit::Unpack()
+{
+  for(DIterator dit = m_Deltas.begin(); dit != m_Deltas.end(); ++dit)
+    if(*dit)
+      (*dit)->Unpack();
+}
+
+template<typename TPixel>
+void
+UndoDataManager<TPixel>::Commit::Spill()
+{
+  for(DIterator dit = m_Deltas.begin(); dit != m_Deltas.end(); ++dit)
+    if(*dit)
+      (*dit)->Spill();
+}
+
+template<typename TPixel>
+bool
+UndoDataManager<TPixel>::Commit::IsPacked() const
+{
+  for(DConstIterator dit = m_Deltas.begin(); dit != m_Deltas.end(); ++dit)
+    if(*dit && !(*dit)->IsPacked())
+      return false;
+  return true;
+}
+
+template<typename TPixel>
+bool
+UndoDataManager<TPixel>::Commit::IsSpilled() const
+{
+  for(DConstIterator dit = m_Deltas.begin(); dit != m_Deltas.end(); ++dit)
+    if(*dit && !(*dit)->IsSpilled())
+      return false;
+  return true;
+}
+
+template<typename TPixel>
+size_t
+UndoDataManager<TPixel>::Commit::GetMemoryInUse() const
+{
+  size_t n = 0;
+  for(DConstIterator dit = m_Deltas.begin(); dit != m_Deltas.end(); ++dit)
+    if(*dit)
+      n += (*dit)->GetMemoryInUse();
+  return n;
+}
+
+template<typename TPixel>
+size_t
+UndoDataManager<TPixel>::Commit::GetSpilledSize() const
+{
+  size_t n = 0;
+  for(DConstIterator dit = m_Deltas.begin(); dit != m_Deltas.end(); ++dit)
+    if(*dit)
+      n += (*dit)->GetSpilledSize();
+  return n;
 }
 
 template<typename TPixel>
@@ -0,0 +1,158 @@
+#include "UndoMemoryBudget.h"
+#include "IRISException.h"
+
+UndoMemoryBudget::UndoMemoryBudget()
+{
+  m_MemoryLimit = 256 * 1024 * 1024;
+  m_CommitCounter = 0;
+  m_SwapFile = NULL;
+  m_SwapFileSize = 0;
+  m_SwapLiveSize = 0;
+}
+
+UndoMemoryBudget::~UndoMemoryBudget()
+{
+  // The swap file is created with tmpfile() and is removed when closed
+  if(m_SwapFile)
+    fclose(m_SwapFile);
+}
+
+void UndoMemoryBudget::SetMemoryLimit(size_t bytes)
+{
+  std::lock_guard<std::recursive_mutex> guard(m_Mutex);
+  m_MemoryLimit = bytes;
+  this->Enforce();
+}
+
+size_t UndoMemoryBudget::GetMemoryLimit() const
+{
+  std::lock_guard<std::recursive_mutex> guard(m_Mutex);
+  return m_MemoryLimit;
+}
+
+void UndoMemoryBudget::Register(UndoDataManagerBase *manager, const void *owner)
+{
+  std::lock_guard<std::recursive_mutex> guard(m_Mutex);
+  m_Managers[manager] = owner;
+}
+
+void UndoMemoryBudget::Unregister(UndoDataManagerBase *manager)
+{
+  std::lock_guard<std::recursive_mutex> guard(m_Mutex);
+  m_Managers.erase(manager);
+}
+
+void UndoMemoryBudget::Enforce()
+{
+  std::lock_guard<std::recursive_mutex> guard(m_Mutex);
+
+  // Total memory in use by all managers
+  size_t total = 0;
+  for(auto it : m_Managers)
+    total += it.first->GetMemoryInUse();
+
+  // Spill the oldest commits across all managers until we are under budget
+  while(total > m_MemoryLimit)
+    {
+    UndoDataManagerBase *oldest = NULL;
+    unsigned long oldest_seq = 0;
+    for(auto it : m_Managers)
+      {
+      unsigned long seq = it.first->GetOldestSpillableCommit();
+      if(seq > 0 && (oldest == NULL || seq < oldest_seq))
+        {
+        oldest = it.first;
+        oldest_seq = seq;
+        }
+      }
+
+    // Nothing left to spill, the remaining commits are all unpacked
+    if(!oldest)
+      break;
+
+    size_t before = oldest->GetMemoryInUse();
+    oldest->SpillOldestCommit();
+    total -= before - oldest->GetMemoryInUse();
+    }
+}
+
+UndoMemoryBudget::Usage
+UndoMemoryBudget::GetUsage(const void *owner) const
+{
+  std::lock_guard<std::recursive_mutex> guard(m_Mutex);
+  Usage usage;
+  for(auto it : m_Managers)
+    {
+    if(it.second == owner)
+      {
+      usage.MemoryInUse += it.first->GetMemoryInUse();
+      usage.PackedMemoryInUse += it.first->GetPackedMemoryInUse();
+      usage.SpilledSize += it.first->GetSpilledSize();
+      usage.NumberOfManagers++;
+      }
+    }
+  return usage;
+}
+
+UndoMemoryBudget::Usage
+UndoMemoryBudget::GetTotalUsage() const
+{
+  std::lock_guard<std::recursive_mutex> guard(m_Mutex);
+  Usage usage;
+  for(auto it : m_Managers)
+    {
+    usage.MemoryInUse += it.first->GetMemoryInUse();
+    usage.PackedMemoryInUse += it.first->GetPackedMemoryInUse();
+    usage.SpilledSize += it.first->GetSpilledSize();
+    usage.NumberOfManagers++;
+    }
+  return usage;
+}
+
+size_t UndoMemoryBudget::WriteToSwap(const std::vector<unsigned char> &data)
+{
+  std::lock_guard<std::recursive_mutex> guard(m_Mutex);
+
+  // Create the swap file on first use
+  if(!m_SwapFile)
+    {
+    m_SwapFile = tmpfile();
+    if(!m_SwapFile)
+      throw IRISException("Unable to create a temporary file for undo data");
+    m_SwapFileSize = 0;
+    }
+
+  // Blocks are always appended to the end of the file
+  size_t offset = m_SwapFileSize;
+  if(fseek(m_SwapFile, (long) offset, SEEK_SET) != 0
+     || fwrite(data.data(), 1, data.size(), m_SwapFile) != data.size())
+    throw IRISException("Unable to write undo data to the temporary file");
+
+  m_SwapFileSize += data.size();
+  m_SwapLiveSize += data.size();
+  return offset;
+}
+
+void UndoMemoryBudget::ReadFromSwap(size_t offset, std::vector<unsigned char> &data)
+{
+  std::lock_guard<std::recursive_mutex> guard(m_Mutex);
+  if(!m_SwapFile
+     || fseek(m_SwapFile, (long) offset, SEEK_SET) != 0
+     || fread(data.data(), 1, data.size(), m_SwapFile) != data.size())
+    throw IRISException("Unable to read undo data from the temporary file");
+}
+
+void UndoMemoryBudget::ReleaseSwap(size_t size)
+{
+  std::lock_guard<std::recursive_mutex> guard(m_Mutex);
+  m_SwapLiveSize -= size;
+
+  // Once no block in the swap file is in use, the file is discarded so that
+  // it does not keep growing over a long session
+  if(m_SwapLiveSize == 0 && m_SwapFile)
+    {
+    fclose(m_SwapFile);
+    m_SwapFile = NULL;
+    m_SwapFileSize = 0;
+    }
+}
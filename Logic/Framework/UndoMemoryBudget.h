@@ -0,0 +1,132 @@
+#ifndef UNDOMEMORYBUDGET_H
+#define UNDOMEMORYBUDGET_H
+
+#include <cstdio>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <vector>
+
+/**
+ * Interface through which the UndoMemoryBudget talks to the (templated) undo
+ * managers. Each undo manager reports how much memory its commits occupy and
+ * can be asked to move its oldest commit out of memory into the swap file.
+ */
+class UndoDataManagerBase
+{
+public:
+  virtual ~UndoDataManagerBase() {}
+
+  /** Number of bytes of undo data held in memory (raw and packed) */
+  virtual size_t GetMemoryInUse() const = 0;
+
+  /** Number of bytes of undo data held in memory in packed form */
+  virtual size_t GetPackedMemoryInUse() const = 0;
+
+  /** Number of bytes of undo data written to the swap file */
+  virtual size_t GetSpilledSize() const = 0;
+
+  /** Sequence number of the oldest commit that is packed but still in memory,
+   * or 0 if there are no such commits */
+  virtual unsigned long GetOldestSpillableCommit() const = 0;
+
+  /** Write the oldest packed in-memory commit to the swap file */
+  virtual void SpillOldestCommit() = 0;
+};
+
+/**
+ * \class UndoMemoryBudget
+ * \brief A global memory budget shared by all undo managers in the application.
+ *
+ * Every time point of every segmentation layer has its own undo manager. The
+ * managers register with this singleton, which keeps the total memory used by
+ * undo data under a single limit. When the limit is exceeded, the oldest
+ * packed commits (across all managers) are written to a temporary swap file,
+ * from which they are paged back in when needed for undo or redo.
+ *
+ * Undo managers may be created, destroyed and used on different threads, so
+ * all methods are thread-safe. The registered managers and the swap file are
+ * guarded by a single (recursive) mutex, which is held while managers are
+ * asked to spill their commits.
+ */
+class UndoMemoryBudget
+{
+public:
+
+  /** Memory usage summary for a single owner or for all owners */
+  struct Usage
+  {
+    size_t MemoryInUse = 0;
+    size_t PackedMemoryInUse = 0;
+    size_t SpilledSize = 0;
+    unsigned int NumberOfManagers = 0;
+  };
+
+  ~UndoMemoryBudget();
+  UndoMemoryBudget(const UndoMemoryBudget &other) = delete;
+  void operator=(const UndoMemoryBudget &other) = delete;
+
+  static UndoMemoryBudget &GetInstance()
+  {
+    static UndoMemoryBudget instance;
+    return instance;
+  }
+
+  /** Set the limit (in bytes) on undo data kept in memory by all managers */
+  void SetMemoryLimit(size_t bytes);
+
+  /** Get the limit (in bytes) on undo data kept in memory by all managers */
+  size_t GetMemoryLimit() const;
+
+  /** Register an undo manager. The owner (e.g., the segmentation layer) is
+   * used to report memory usage per layer */
+  void Register(UndoDataManagerBase *manager, const void *owner);
+
+  /** Unregister an undo manager, e.g., when it is deleted */
+  void Unregister(UndoDataManagerBase *manager);
+
+  /** Spill commits to disk until the in-memory undo data fits the budget */
+  void Enforce();
+
+  /** Get a new sequence number for a commit. Sequence numbers start at 1 */
+  unsigned long GetNextCommitSequenceNumber() { return ++m_CommitCounter; }
+
+  /** Memory usage of all managers registered by an owner */
+  Usage GetUsage(const void *owner) const;
+
+  /** Memory usage of all registered managers */
+  Usage GetTotalUsage() const;
+
+  /** Append a block of data to the swap file, returning its offset */
+  size_t WriteToSwap(const std::vector<unsigned char> &data);
+
+  /** Read a block of data from the swap file. The data vector must already
+   * have the size of the block */
+  void ReadFromSwap(size_t offset, std::vector<unsigned char> &data);
+
+  /** Indicate that a block in the swap file is no longer used */
+  void ReleaseSwap(size_t size);
+
+private:
+  UndoMemoryBudget();
+
+  // Registered managers and their owners
+  typedef std::map<UndoDataManagerBase *, const void *> ManagerMap;
+  ManagerMap m_Managers;
+
+  // The memory limit
+  size_t m_MemoryLimit;
+
+  // Commit counter
+  std::atomic<unsigned long> m_CommitCounter;
+
+  // Swap file, created on demand, and the number of live bytes in it
+  FILE *m_SwapFile;
+  size_t m_SwapFileSize, m_SwapLiveSize;
+
+  // Mutex protecting the managers, the limit and the swap file. It is
+  // recursive because spilling a commit writes to the swap file.
+  mutable std::recursive_mutex m_Mutex;
+};
+
+#endif // UNDOMEMORYBUDGET_H
@@ -49,6 +49,7 @@
 #include "itkGE5ImageIO.h"
 #include "itkMINCImageIO.h"
 #include "itkNiftiImageIO.h"
+#include "itkByteSwapper.h"
 #include "itkSiemensVisionImageIO.h"
 #include "itkVTKImageIO.h"
 #include "itkVoxBoCUBImageIO.h"
@@ -67,6 +68,7 @@
 #include "itkNumericTraits.h"
 #include <itkTimeProbe.h>
 #include "itksys/MD5.h"
+#include "itksys/SystemTools.hxx"
 #include "ExtendedGDCMSerieHelper.h"
 #include "itkComposeImageFilter.h"
 #include "itkStreamingImageFilter.h"
@@ -74,6 +76,8 @@
 #include "MultiFrameDicomSeriesSorter.h"
 #include "itkStringTools.h"
 #include "AllPurposeProgressAccumulator.h"
+#include "ParallelDataHash.h"
+#include "ParallelGzipIO.h"
 
 #include <itk_zlib.h>
 #include "itkImportImageFilter.h"
@@ -972,10 +976,266 @@ GuidedNativeImageIO
 }
 
 
+namespace
+{
+
+// Check that the voxels of a single-file NIfTI-1 image can be used as they are
+// stored, i.e., without byte swapping or intensity scaling, and find where
+// they start in the file. Other files are left to the IO object.
+bool GetNiftiVoxelOffset(const unsigned char *hdr, size_t component_size,
+                         size_t size, size_t &offset)
+{
+  int sizeof_hdr;
+  short dim[8], bitpix;
+  float vox_offset, scl_slope, scl_inter;
+  memcpy(&sizeof_hdr, hdr, 4);
+  memcpy(dim, hdr + 40, 16);
+  memcpy(&bitpix, hdr + 72, 2);
+  memcpy(&vox_offset, hdr + 108, 4);
+  memcpy(&scl_slope, hdr + 112, 4);
+  memcpy(&scl_inter, hdr + 116, 4);
+
+  if(sizeof_hdr != 348 || memcmp(hdr + 344, "n+1", 4) != 0)
+    return false;
+  if((scl_slope != 0.0f && scl_slope != 1.0f) || scl_inter != 0.0f)
+    return false;
+  if(vox_offset < 348 || bitpix != 8 * (short) component_size)
+    return false;
+  if(dim[0] < 1 || dim[0] > 7)
+    return false;
+
+  size_t n_bytes = bitpix / 8;
+  for(int i = 1; i <= dim[0]; i++)
+    n_bytes *= std::max((short) 1, dim[i]);
+  if(n_bytes != size)
+    return false;
+
+  offset = (size_t) vox_offset;
+  return true;
+}
+
+}
+
+bool
+GuidedNativeImageIO
+::ReadCompressedNiftiData(void *buffer, size_t size)
+{
+  // Only scalar single-file NIfTI images are handled, the voxels of vector
+  // images are reordered by the IO object
+  if(m_FileFormat != FORMAT_NIFTI || m_IOBase->GetNumberOfComponents() != 1
+     || size != m_IOBase->GetImageSizeInBytes())
+    return false;
+
+  ParallelGzipReader reader;
+  if(!reader.Open(m_IOBase->GetFileName()))
+    return false;
+
+  try
+    {
+    unsigned char hdr[348];
+    size_t offset;
+    reader.Read(0, sizeof(hdr), hdr);
+    if(!GetNiftiVoxelOffset(hdr, m_IOBase->GetComponentSize(), size, offset))
+      return false;
+
+    reader.Read(offset, size, buffer);
+    return true;
+    }
+  catch(IRISException &)
+    {
+    // Let the IO object read the file and report the problem
+    return false;
+    }
+}
+
+bool
+GuidedNativeImageIO
+::FindNativeImageData(Registry &folder, size_t size, std::string &data_file,
+                      size_t &offset, bool &gzipped)
+{
+  // Data that is folded or transposed after reading can not be used in place
+  if(m_NDimBeforeFolding > 4 || size != m_IOBase->GetImageSizeInBytes())
+    return false;
+
+  bool little_endian = itk::ByteSwapper<int>::SystemIsLittleEndian();
+  size_t comp_size = m_IOBase->GetComponentSize();
+  data_file = m_IOBase->GetFileName();
+  offset = 0;
+  gzipped = false;
+
+  if(m_FileFormat == FORMAT_NIFTI)
+    {
+    // Vector images are stored one component after another
+    if(m_IOBase->GetNumberOfComponents() != 1)
+      return false;
+
+    unsigned char hdr[348];
+    ParallelGzipReader reader;
+    if(reader.Open(data_file.c_str()))
+      {
+      try
+        {
+        reader.Read(0, sizeof(hdr), hdr);
+        gzipped = true;
+        }
+      catch(IRISException &)
+        {
+        return false;
+        }
+      }
+    else
+      {
+      FILE *f = fopen(data_file.c_str(), "rb");
+      if(!f)
+        return false;
+      bool have_hdr = fread(hdr, 1, sizeof(hdr), f) == sizeof(hdr);
+      fclose(f);
+      if(!have_hdr)
+        return false;
+      }
+
+    if(!GetNiftiVoxelOffset(hdr, comp_size, size, offset))
+      return false;
+    }
+  else if(m_FileFormat == FORMAT_MHA)
+    {
+    itk::MetaImageIO *mio = dynamic_cast<itk::MetaImageIO *>(m_IOBase.GetPointer());
+    MetaImage *meta = mio ? mio->GetMetaImagePointer() : NULL;
+    if(!meta || meta->CompressedData() || meta->BinaryDataByteOrderMSB() == little_endian)
+      return false;
+
+    // Data split over a list of files can not be mapped
+    std::string edf = meta->ElementDataFileName();
+    if(edf.empty() || edf.find("LIST") == 0 || edf.find('%') != std::string::npos)
+      return false;
+
+    bool local = (edf == "LOCAL");
+    if(!local)
+      {
+      data_file = itksys::SystemTools::FileIsFullPath(edf)
+          ? edf : itksys::SystemTools::GetFilenamePath(data_file) + "/" + edf;
+      }
+
+    // Local data follows the header at the end of the file. So does the data
+    // in a separate file, unless its header size is given.
+    if(!local && meta->HeaderSize() >= 0)
+      {
+      offset = meta->HeaderSize();
+      }
+    else
+      {
+      size_t file_size = itksys::SystemTools::FileLength(data_file);
+      if(file_size < size)
+        return false;
+      offset = file_size - size;
+      }
+    }
+  else if(m_FileFormat == FORMAT_RAW)
+    {
+    bool big_endian = m_IOBase->GetByteOrder() == itk::IOByteOrderEnum::BigEndian;
+    if(big_endian == little_endian)
+      return false;
+    offset = (size_t) folder["HeaderSize"][0];
+    }
+  else
+    {
+    return false;
+    }
+
+  // The voxels must be aligned in memory
+  return offset % comp_size == 0;
+}
+
+MemoryMappedFile *
+GuidedNativeImageIO
+::MapNativeImageData(Registry &folder, size_t size)
+{
+  std::string data_file;
+  size_t offset;
+  bool gzipped;
+  if(!m_UseMemoryMapping || !this->FindNativeImageData(folder, size, data_file, offset, gzipped)
+     || gzipped)
+    return NULL;
+
+  return MemoryMappedFile::Map(data_file.c_str(), offset, size);
+}
+
+MemoryMappedFile *
+GuidedNativeImageIO
+::CopyNativeImageDataToScratchFile(Registry &folder, size_t size)
+{
+  // Only 4D images are worth this, since ImageWrapper can then keep just
+  // some of their time points in memory
+  if(m_ScratchFileThreshold == 0 || size < m_ScratchFileThreshold
+     || m_NDimBeforeFolding != 4 || m_IOBase->GetDimensions(3) < 2
+     || m_Load4DAsMultiComponent)
+    return NULL;
+
+  std::string data_file;
+  size_t offset;
+  bool gzipped;
+  if(!this->FindNativeImageData(folder, size, data_file, offset, gzipped))
+    return NULL;
+
+  // The data is read in a single sequential pass
+  gzFile gz = NULL;
+  FILE *f = NULL;
+  if(gzipped)
+    gz = gzopen(data_file.c_str(), "rb");
+  else
+    f = fopen(data_file.c_str(), "rb");
+  if(!gz && !f)
+    return NULL;
+
+  auto read_bytes = [&](char *buffer, size_t n)
+  {
+    for(size_t done = 0; done < n; )
+      {
+      size_t chunk = std::min(n - done, ((size_t) 1) << 30);
+      long k = gz ? (long) gzread(gz, buffer + done, (unsigned) chunk)
+                  : (long) fread(buffer + done, 1, chunk, f);
+      if(k <= 0)
+        throw IRISException("Error: unable to read image data from %s", data_file.c_str());
+      done += k;
+      }
+  };
+
+  auto read = [&](size_t pos, size_t n, char *buffer)
+  {
+    // Skip the header before the first piece
+    if(pos == 0)
+      {
+      std::vector<char> header(offset);
+      read_bytes(header.data(), offset);
+      }
+    read_bytes(buffer, n);
+  };
+
+  MemoryMappedFile *mf = NULL;
+  try
+    {
+    mf = MemoryMappedFile::MapScratchCopy(size, read);
+    }
+  catch(...)
+    {
+    if(gz)
+      gzclose(gz);
+    else
+      fclose(f);
+    throw;
+    }
+
+  if(gz)
+    gzclose(gz);
+  else
+    fclose(f);
+  return mf;
+}
+
 template<class TScalar>
 void
 GuidedNativeImageIO
-::DoReadNative(const char *FileName, Registry &, itk::Command *progressCmd)
+::DoReadNative(const char *FileName, Registry &folder, itk::Command *progressCmd)
 {
 	if (!progressCmd)
 		progressCmd = DoNothingCommandSingleton::GetInstance().GetCommand();
@@ -1379,12 +1639,36 @@ GuidedNativeImageIO
     typename NativeImageType::Pointer image = NativeImageType::New();
 
     UpdateImageHeader<NativeImageType>(image);
-    image->Allocate();
 
-    regularImageReadingProgSrc->AddProgress(0.1);
+    // Uncompressed images stored in the native layout are mapped into memory.
+    // Large 4D images that are not mapped from their own file are copied into
+    // a scratch file that is mapped instead
+    size_t n_elements = image->GetBufferedRegion().GetNumberOfPixels()
+        * image->GetNumberOfComponentsPerPixel();
+    MemoryMappedFile *mapping = this->MapNativeImageData(folder, n_elements * sizeof(TScalar));
+    if(!mapping)
+      mapping = this->CopyNativeImageDataToScratchFile(folder, n_elements * sizeof(TScalar));
+    if(mapping)
+      {
+      typedef typename NativeImageType::PixelContainer::ElementIdentifier ElementIdType;
+      typedef MappedImageContainer<ElementIdType, TScalar> MappedContainerType;
+      typename MappedContainerType::Pointer container = MappedContainerType::New();
+      container->SetMappedFile(mapping, n_elements);
+      image->SetPixelContainer(container);
+
+      regularImageReadingProgSrc->AddProgress(0.1);
+      }
+    else
+      {
+      image->Allocate();
+
+      regularImageReadingProgSrc->AddProgress(0.1);
 
-    // Read the image into the buffer
-		m_IOBase->Read(image->GetBufferPointer());
+      // Read the image into the buffer. Gzipped NIfTI files are inflated on
+      // several threads when possible.
+      if(!this->ReadCompressedNiftiData(image->GetBufferPointer(), n_elements * sizeof(TScalar)))
+        m_IOBase->Read(image->GetBufferPointer());
+      }
 
     // For seq.nrrd, convert the component dimension to the sequence dimension
     if (m_FileFormat == FORMAT_NRRD_SEQ && m_NCompBeforeFolding > 1 &&
@@ -1510,12 +1794,134 @@ GuidedNativeImageIO
   // Save the image
   typedef itk::ImageFileWriter<TImageType> WriterType;
   typename WriterType::Pointer writer = WriterType::New();
-  
-  writer->SetFileName(FileName);
-  if(m_IOBase)
-    writer->SetImageIO(m_IOBase);
   writer->SetInput(image);
-  writer->Update();
+  this->UpdateWriter(writer.GetPointer(), FileName);
+}
+
+bool
+GuidedNativeImageIO
+::IsCompressedNiftiFileName(const char *FileName) const
+{
+  // ITK compresses NIfTI files on a single thread, so we compress these
+  // ourselves
+  std::string fn_lower = itksys::SystemTools::LowerCase(FileName);
+  return m_FileFormat == FORMAT_NIFTI && fn_lower.size() > 7
+      && fn_lower.compare(fn_lower.size() - 7, 7, ".nii.gz") == 0;
+}
+
+void
+GuidedNativeImageIO
+::RemoveHeaderStub(const std::string &fn_stub)
+{
+  itksys::SystemTools::RemoveFile(fn_stub);
+}
+
+bool
+GuidedNativeImageIO
+::WriteCompressedNiftiData(const std::string &fn_stub, const char *FileName,
+                           const std::vector<size_t> &dims, size_t n_components,
+                           const void *data, size_t n_bytes)
+{
+  // Read the header and any extensions that ITK wrote for the stub image
+  std::vector<unsigned char> hdr(348);
+  FILE *f = fopen(fn_stub.c_str(), "rb");
+  bool ok = f && fread(hdr.data(), 1, hdr.size(), f) == hdr.size();
+
+  int sizeof_hdr = 0;
+  short dim[8], datatype, bitpix;
+  float vox_offset = 0.0f;
+  if(ok)
+    {
+    memcpy(&sizeof_hdr, hdr.data(), 4);
+    memcpy(dim, hdr.data() + 40, 16);
+    memcpy(&datatype, hdr.data() + 70, 2);
+    memcpy(&bitpix, hdr.data() + 72, 2);
+    memcpy(&vox_offset, hdr.data() + 108, 4);
+    ok = sizeof_hdr == 348 && memcmp(hdr.data() + 344, "n+1", 4) == 0
+        && vox_offset >= 352 && vox_offset < (1 << 24)
+        && dim[0] >= 1 && dim[0] <= 7 && bitpix > 0 && bitpix % 8 == 0;
+    }
+  if(ok)
+    {
+    size_t n_hdr = (size_t) vox_offset;
+    hdr.resize(n_hdr);
+    ok = fread(hdr.data() + 348, 1, n_hdr - 348, f) == n_hdr - 348;
+    }
+
+  if(f)
+    fclose(f);
+  this->RemoveHeaderStub(fn_stub);
+  if(!ok)
+    return false;
+
+  // The axes of the image are the first dimensions of the header. ITK may
+  // drop trailing axes of size one, and stores the components of vectors
+  // along the fifth dimension
+  size_t n_dim = (size_t) dim[0], n_voxels = 1;
+  for(size_t d = 0; d < dims.size(); d++)
+    {
+    if(d < n_dim)
+      {
+      if(dims[d] > 0x7fff || dim[d + 1] != (short) std::min(dims[d], (size_t) 2))
+        return false;
+      dim[d + 1] = (short) dims[d];
+      }
+    else if(dims[d] != 1)
+      {
+      return false;
+      }
+    n_voxels *= dims[d];
+    }
+
+  // RGB and complex data types hold all the components of a voxel, which are
+  // stored together. Otherwise each component is stored after the other
+  bool interleaved = (datatype == 32 || datatype == 128 || datatype == 1792
+                      || datatype == 2048 || datatype == 2304);
+  size_t comp_size = bitpix / 8;
+  if(interleaved)
+    {
+    if(comp_size % n_components || n_voxels * comp_size != n_bytes)
+      return false;
+    }
+  else
+    {
+    if(n_components > 1 && (n_dim < 5 || (size_t) dim[5] != n_components))
+      return false;
+    if(n_voxels * n_components * comp_size != n_bytes)
+      return false;
+    }
+
+  memcpy(hdr.data() + 40, dim, 16);
+
+  ParallelGzipWriter writer;
+  writer.Open(FileName);
+  writer.Write(hdr.data(), hdr.size());
+
+  const char *p = (const char *) data;
+  if(interleaved || n_components == 1)
+    {
+    writer.Write(p, n_bytes);
+    }
+  else
+    {
+    // Gather one component of a run of voxels at a time
+    size_t vox_size = n_components * comp_size, n_run = 1 << 20;
+    std::vector<char> buffer(n_run * comp_size);
+    for(size_t c = 0; c < n_components; c++)
+      {
+      for(size_t i = 0; i < n_voxels; i += n_run)
+        {
+        size_t n = std::min(n_run, n_voxels - i);
+        const char *src = p + i * vox_size + c * comp_size;
+        for(size_t j = 0; j < n; j++, src += vox_size)
+          memcpy(buffer.data() + j * comp_size, src, comp_size);
+        writer.Write(buffer.data(), n * comp_size);
+        }
+      }
+    }
+
+  writer.Close();
+  return true;
 }
 
 
@@ -1560,6 +1966,31 @@ GuidedNativeImageIO
   return std::string(hex_code);
 }
 
+std::string
+GuidedNativeImageIO
+::GetNativeImageHash()
+{
+  DispatchBase *dispatch = this->CreateDispatch(this->GetComponentTypeInNativeImage());
+  std::string hash = dispatch->GetNativeHash(this);
+  delete dispatch;
+
+  return hash;
+}
+
+template<typename TNative>
+std::string
+GuidedNativeImageIO
+::DoGetNativeHash()
+{
+  typedef itk::VectorImage<TNative, 4> InputImageType;
+  InputImageType *input = reinterpret_cast<InputImageType *>(this->GetNativeImage());
+  assert(input);
+
+  return ParallelDataHash::ComputeHex(
+        input->GetBufferPointer(),
+        input->GetPixelContainer()->Size() * sizeof(TNative));
+}
+
 
 
 
@@ -1902,6 +2333,19 @@ CastNativeImage<TOutputImage,TCastFunctor>
     return;
     }
 
+  // A memory mapped buffer can not be reallocated, so the data is cast into
+  // a new buffer, paging in the file as we go
+  typedef MappedImageContainer<typename InPixCon::ElementIdentifier, TNative> MappedPixCon;
+  if(dynamic_cast<MappedPixCon *>(ipc))
+    {
+    m_Output->Allocate();
+    TNative *pn = ipc->GetBufferPointer();
+    OutputComponentType *pt = m_Output->GetPixelContainer()->GetBufferPointer();
+    for(size_t i = 0; i < ipc->Size(); i++)
+      m_Functor(pn + i, pt + i);
+    return;
+    }
+
   // We are going to map data from native to target format in place in order
   // to save memory. This way, SNAP will never use extra memory when loading
   // an image. Some trickery is needed though.
@@ -2075,10 +2519,174 @@ const gdcm::Tag GuidedNativeImageIO::m_tagSliceThickness(0x0018, 0x0050);
 
 #include "gdcmDirectory.h"
 #include "gdcmImageReader.h"
+#include "itkMultiThreaderBase.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+namespace
+{
+
+/**
+ * Header values read from a DICOM file, along with the size and modification
+ * time of the file, which are used to tell if the values are still current
+ */
+struct DicomFileHeader
+{
+  unsigned long Size = 0;
+  long ModifiedTime = 0;
+  bool Valid = false;
+  std::vector<std::string> Values;
+};
+
+/**
+ * A persistent index of the header values of the files in a DICOM directory.
+ * The index is a text file with one line per file. Files that could not be
+ * read as DICOM are stored too, so that they are not read again. The index
+ * is only used if it was written for the same list of tags.
+ */
+class DicomHeaderIndex
+{
+public:
+  DicomHeaderIndex(const std::string &filename, const std::vector<gdcm::Tag> &tags)
+    : m_FileName(filename), m_Modified(false)
+  {
+    std::ostringstream oss;
+    oss << "ITK-SNAP DICOM Header Index 1";
+    for(const gdcm::Tag &tag : tags)
+      oss << " " << tag;
+    m_Signature = oss.str();
+    m_NumberOfTags = tags.size();
+  }
+
+  void Load()
+  {
+    std::ifstream fin(m_FileName.c_str());
+    std::string line;
+    if(!fin.good() || !std::getline(fin, line) || line != m_Signature)
+      return;
+
+    while(std::getline(fin, line))
+      {
+      // Fields are: filename, size, mtime, valid flag, tag values
+      std::vector<std::string> fields;
+      size_t pos = 0, next;
+      while((next = line.find('\t', pos)) != std::string::npos)
+        {
+        fields.push_back(line.substr(pos, next - pos));
+        pos = next + 1;
+        }
+      fields.push_back(line.substr(pos));
+      if(fields.size() != 4 + m_NumberOfTags)
+        continue;
+
+      DicomFileHeader &h = m_Entries[fields[0]];
+      h.Size = std::strtoul(fields[1].c_str(), NULL, 10);
+      h.ModifiedTime = std::strtol(fields[2].c_str(), NULL, 10);
+      h.Valid = (fields[3] == "1");
+      h.Values.assign(fields.begin() + 4, fields.end());
+      }
+  }
+
+  void Save(const std::vector<std::string> &filenames) const
+  {
+    // Write to a temporary file first, so that an interrupted write does
+    // not leave a truncated index behind
+    std::string tmp = m_FileName + ".tmp";
+      {
+      std::ofstream fout(tmp.c_str());
+      if(!fout.good())
+        return;
+
+      fout << m_Signature << "\n";
+      for(const std::string &fn : filenames)
+        {
+        auto it = m_Entries.find(fn);
+        if(it == m_Entries.end())
+          continue;
+
+        const DicomFileHeader &h = it->second;
+        fout << fn << "\t" << h.Size << "\t" << h.ModifiedTime << "\t" << (h.Valid ? 1 : 0);
+        for(size_t i = 0; i < m_NumberOfTags; i++)
+          fout << "\t" << (i < h.Values.size() ? h.Values[i] : std::string());
+        fout << "\n";
+        }
+      if(!fout.good())
+        return;
+      }
+
+    itksys::SystemTools::RemoveFile(m_FileName);
+    itksys::SystemTools::RenameFile(tmp.c_str(), m_FileName.c_str());
+  }
+
+  // Look up a file. The entry is only returned if the file has not changed
+  bool Find(const std::string &fn, const DicomFileHeader &stat, DicomFileHeader &out) const
+  {
+    auto it = m_Entries.find(fn);
+    if(it == m_Entries.end()
+       || it->second.Size != stat.Size || it->second.ModifiedTime != stat.ModifiedTime)
+      return false;
+    out = it->second;
+    return true;
+  }
+
+  void Insert(const std::string &fn, const DicomFileHeader &h)
+  {
+    m_Entries[fn] = h;
+    m_Modified = true;
+  }
+
+  bool IsModified() const { return m_Modified; }
+
+  size_t GetNumberOfEntries() const { return m_Entries.size(); }
+
+private:
+  std::string m_FileName, m_Signature;
+  size_t m_NumberOfTags;
+  std::unordered_map<std::string, DicomFileHeader> m_Entries;
+  bool m_Modified;
+};
+
+// Read the selected tags from a DICOM file. Reading stops at the last of the
+// selected tags, so the pixel data is never read.
+void ReadDicomFileHeader(const std::string &fn, const std::set<gdcm::Tag> &tags_all,
+                         const std::vector<gdcm::Tag> &tags, DicomFileHeader &h)
+{
+  gdcm::Reader reader;
+  reader.SetFileName(fn.c_str());
+
+  // Try reading this file. Fail quietly.
+  h.Valid = false;
+  try { h.Valid = reader.ReadSelectedTags(tags_all, true); }
+  catch(...) {}
+
+  h.Values.clear();
+  if(!h.Valid)
+    return;
+
+  gdcm::StringFilter sf;
+  sf.SetFile(reader.GetFile());
+  for(const gdcm::Tag &tag : tags)
+    {
+    // Tabs and line breaks would corrupt the index
+    std::string value = sf.ToString(tag);
+    std::replace(value.begin(), value.end(), '\t', ' ');
+    std::replace(value.begin(), value.end(), '\n', ' ');
+    std::replace(value.begin(), value.end(), '\r', ' ');
+    h.Values.push_back(value);
+    }
+}
+
+}
 
 void
 GuidedNativeImageIO
-::ParseDicomDirectory(const std::string &dir, itk::Command *progressCommand)
+::ParseDicomDirectory(const std::string &dir, itk::Command *progressCommand,
+                      const std::string &index_file)
 {
   // We will parse the DICOM directory manually to avoid extra time opening
   // files and also to allow progress reporting
@@ -2104,6 +2712,13 @@ GuidedNativeImageIO
   tags_all.insert(m_tagDesc);
   tags_all.insert(m_tagSeriesInstanceUID);
 
+  // The order in which the tag values are stored for each file
+  std::vector<gdcm::Tag> tags_stored;
+  tags_stored.push_back(m_tagSeriesInstanceUID);
+  tags_stored.push_back(m_tagDesc);
+  tags_stored.insert(tags_stored.end(), tags_refine.begin(), tags_refine.end());
+  enum { VAL_UID = 0, VAL_DESC, VAL_REFINE };
+
   //--Dev: Add to read list
   std::set<std::string> sliceLocSet;
   std::map<std::string, std::set<std::string>> sliceMap;
@@ -2118,98 +2733,173 @@ GuidedNativeImageIO
   // Load the directory - this should be quick
   dirList.Load(dir, false);
   gdcm::Directory::FilenamesType const &filenames = dirList.GetFilenames();
-  for(gdcm::Directory::FilenamesType::const_iterator it = filenames.begin();
-    it != filenames.end(); ++it)
-    {
-    // Process each filename in the directory
-    gdcm::Reader reader;
-    reader.SetFileName(it->c_str());
 
-    // Try reading this file. Fail quietly.
-    bool read = false;
-    try { read = reader.ReadSelectedTags(tags_all, true); }
-    catch(...) {}
+  // Load the index of headers read previously
+  DicomHeaderIndex index(index_file, tags_stored);
+  if(index_file.size())
+    index.Load();
+
+  // The headers are read by a pool of threads. Reading headers is limited
+  // by file access rather than by the CPU, especially on network storage,
+  // so we use at least a few threads even on small machines
+  size_t n_files = filenames.size();
+  std::vector<DicomFileHeader> headers(n_files);
+  std::vector<char> ready(n_files, 0), from_index(n_files, 0);
+  std::atomic<size_t> next(0);
+  std::mutex mutex;
+  std::condition_variable cv;
+
+  auto work = [&]()
+    {
+    size_t i;
+    while((i = next++) < n_files)
+      {
+      const std::string &fn = filenames[i];
+      DicomFileHeader &h = headers[i];
+      h.Size = itksys::SystemTools::FileLength(fn);
+      h.ModifiedTime = itksys::SystemTools::ModifiedTime(fn);
+      if(index.Find(fn, h, h))
+        from_index[i] = 1;
+      else
+        ReadDicomFileHeader(fn, tags_all, tags_stored, h);
 
-    // If nothing read, keep going
-    if(!read)
-      continue;
+        {
+        std::lock_guard<std::mutex> lock(mutex);
+        ready[i] = 1;
+        }
+      cv.notify_one();
+      }
+    };
+
+  unsigned int n_threads = std::max(
+        8u, (unsigned int) itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads());
+  n_threads = std::min(n_threads, (unsigned int) n_files);
+  std::vector<std::thread> threads;
+  for(unsigned int t = 0; t < n_threads; t++)
+    threads.push_back(std::thread(work));
+
+  // Group the files in the order in which they are listed, so that the
+  // result does not depend on the timing of the threads
+  try
+    {
+    for(size_t i = 0; i < n_files; i++)
+      {
+      // Wait for the header, keeping the caller's progress reporting alive
+        {
+        std::unique_lock<std::mutex> lock(mutex);
+        while(!ready[i])
+          {
+          if(!cv.wait_for(lock, std::chrono::milliseconds(100), [&]() { return ready[i] != 0; }))
+            {
+            lock.unlock();
+            if(progressCommand)
+              progressCommand->Execute(this, itk::ProgressEvent());
+            lock.lock();
+            }
+          }
+        }
 
-    // Create a string filter to get tags
-    gdcm::StringFilter sf;
-    sf.SetFile(reader.GetFile());
+      const DicomFileHeader &h = headers[i];
 
-    // Start with the ID being the UID
-    std::string uid = sf.ToString(m_tagSeriesInstanceUID);
-    std::string full_id = uid;
+      // If nothing read, keep going
+      if(!h.Valid || h.Values.size() != tags_stored.size())
+        continue;
 
-    // Iterate over the tags in the refine list
-		for(size_t iTag = 0u; iTag < tags_refine.size(); iTag++)
-      {
-      // Read the tag value
-      std::string s = sf.ToString(tags_refine[iTag]);
+      // Start with the ID being the UID
+      std::string uid = h.Values[VAL_UID];
+      std::string full_id = uid;
 
-      // This code is from gdcmSerieHelper
-      if( full_id == uid && !s.empty() )
+      // Iterate over the tags in the refine list
+      for(size_t iTag = 0u; iTag < tags_refine.size(); iTag++)
         {
-        full_id += "."; // add separator
+        // Read the tag value
+        const std::string &s = h.Values[VAL_REFINE + iTag];
+
+        // This code is from gdcmSerieHelper
+        if( full_id == uid && !s.empty() )
+          {
+          full_id += "."; // add separator
+          }
+        full_id += s;
         }
-      full_id += s;
-      }
 
-    // Eliminate non-alnum characters, including whitespace...
-    //   that may have been introduced by concats.
-    for(size_t i=0; i<full_id.size(); i++)
-      {
-      while(i<full_id.size()
-        && !( full_id[i] == '.'
-          || (full_id[i] >= 'a' && full_id[i] <= 'z')
-          || (full_id[i] >= '0' && full_id[i] <= '9')
-          || (full_id[i] >= 'A' && full_id[i] <= 'Z')))
+      // Eliminate non-alnum characters, including whitespace...
+      //   that may have been introduced by concats.
+      for(size_t k=0; k<full_id.size(); k++)
         {
-        full_id.erase(i, 1);
+        while(k<full_id.size()
+          && !( full_id[k] == '.'
+            || (full_id[k] >= 'a' && full_id[k] <= 'z')
+            || (full_id[k] >= '0' && full_id[k] <= '9')
+            || (full_id[k] >= 'A' && full_id[k] <= 'Z')))
+          {
+          full_id.erase(k, 1);
+          }
         }
-      }
 
-    // The info for the current series
-    DicomDirectoryParseResult::DicomSeriesInfo &series_info
-        = m_LastDicomParseResult.SeriesMap[full_id];
+      // The info for the current series
+      DicomDirectoryParseResult::DicomSeriesInfo &series_info
+          = m_LastDicomParseResult.SeriesMap[full_id];
 
-    // The registry for the current series
-    Registry &r = series_info.MetaData;
+      // The registry for the current series
+      Registry &r = series_info.MetaData;
 
-    // Have we found this ID before?
-    if(r.IsEmpty())
-      {
-      r["SeriesId"] << full_id;
+      // Have we found this ID before?
+      if(r.IsEmpty())
+        {
+        r["SeriesId"] << full_id;
 
-      // Read series description
-      r["SeriesDescription"] << sf.ToString(m_tagDesc);
-      r["SeriesNumber"] << sf.ToString(m_tagSeriesNumber);
+        // Read series description
+        r["SeriesDescription"] << h.Values[VAL_DESC];
+        r["SeriesNumber"] << h.Values[VAL_REFINE + 0];
 
-      // Read the dimensions
-      r["Rows"] << std::atoi(sf.ToString(m_tagRows).c_str());
-      r["Columns"] << std::atoi(sf.ToString(m_tagCols).c_str());
-      r["NumberOfImages"] << 1;
-      }
-    else
-      {
-      // Increement the number of images
-      r["NumberOfImages"] << r["NumberOfImages"][0] + 1;
-      }
+        // Read the dimensions
+        r["Rows"] << std::atoi(h.Values[VAL_REFINE + 3].c_str());
+        r["Columns"] << std::atoi(h.Values[VAL_REFINE + 4].c_str());
+        r["NumberOfImages"] << 1;
+        }
+      else
+        {
+        // Increement the number of images
+        r["NumberOfImages"] << r["NumberOfImages"][0] + 1;
+        }
 
-    // Update the dimensions string
-    ostringstream oss;
-    oss << r["Rows"][0] << " x " << r["Columns"][0] << " x " << r["NumberOfImages"][0];
-    r["Dimensions"] << oss.str();
+      // Update the dimensions string
+      ostringstream oss;
+      oss << r["Rows"][0] << " x " << r["Columns"][0] << " x " << r["NumberOfImages"][0];
+      r["Dimensions"] << oss.str();
 
-    // Update the filelist
-    series_info.FileList.push_back(*it);
+      // Update the filelist
+      series_info.FileList.push_back(filenames[i]);
 
-    // Indicate some progress
-    if(progressCommand)
-      progressCommand->Execute(this, itk::ProgressEvent());
+      // Indicate some progress
+      if(progressCommand)
+        progressCommand->Execute(this, itk::ProgressEvent());
+      }
+    }
+  catch(...)
+    {
+    // Let the threads run out before passing on the exception
+    next = n_files;
+    for(auto &t : threads)
+      t.join();
+    throw;
     }
 
+  for(auto &t : threads)
+    t.join();
+
+  // Add the headers that were read from the files to the index. This is
+  // done after the threads are finished, since they look up the index
+  for(size_t i = 0; i < n_files; i++)
+    if(!from_index[i])
+      index.Insert(filenames[i], headers[i]);
+
+  // Save the index if any headers were read from the files, or if some of
+  // the indexed files are no longer in the directory
+  if(index_file.size() && (index.IsModified() || index.GetNumberOfEntries() != n_files))
+    index.Save(filenames);
+
   // Complain if no series have been found
   if(m_LastDicomParseResult.SeriesMap.size() == 0)
     throw IRISException(
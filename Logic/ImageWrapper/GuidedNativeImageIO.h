@@ -39,11 +39,13 @@
 #include "itkSmartPointer.h"
 #include "itkImage.h"
 #include "itkImageIOBase.h"
+#include "itkImageFileWriter.h"
 #include "itkVectorImage.h"
 #include "itkCommand.h"
 #include "itkEventObject.h"
 #include "gdcmTag.h"
 #include "MultiFrameDicomSeriesSorter.h"
+#include "MemoryMappedFile.h"
 
 
 namespace itk
@@ -208,10 +210,16 @@ public:
   void SaveNativeImage(const char *FileName, Registry &folder);
 
   /**
-   * Get an MD5 hash string of the native image data
+   * Get an MD5 hash string of the native image data. This is slow for large
+   * images, use GetNativeImageHash unless the MD5 digest itself is needed.
    */
   std::string GetNativeImageMD5Hash();
 
+  /**
+   * Get a hash string of the native image data, computed by ParallelDataHash
+   */
+  std::string GetNativeImageHash();
+
   /**
    * Discard the native image. Use this once you've cast the native image to 
    * the format of interest.
@@ -233,6 +241,100 @@ public:
   template<class TImageType>
     void SaveImage(const char *FileName, Registry &folder, TImageType *image);
 
+  /**
+   * Run an ITK image writer with the IO object created by CreateImageIO.
+   * Gzipped NIfTI files are compressed straight from the voxels in memory on
+   * several threads, into BGZF blocks that any gzip reader can read (see
+   * WriteCompressedNifti). Other files are written by the writer.
+   */
+  template<class TWriter>
+    void UpdateWriter(TWriter *writer, const char *FileName)
+  {
+    // Files that images are mapped from are not overwritten in place. The
+    // image is written elsewhere and moved over them once it is complete
+    std::string fn_staged = MemoryMappedFile::StageWrite(FileName);
+
+    if(m_IOBase)
+      writer->SetImageIO(m_IOBase);
+
+    try
+      {
+      typedef typename TWriter::InputImageType InputImageType;
+      InputImageType *image = const_cast<InputImageType *>(writer->GetInput());
+      if(!this->WriteCompressedNifti(image, fn_staged.c_str()))
+        {
+        writer->SetFileName(fn_staged);
+        writer->Update();
+        }
+      MemoryMappedFile::CommitStagedWrite(fn_staged, FileName);
+      }
+    catch(...)
+      {
+      MemoryMappedFile::DiscardStagedWrite(fn_staged, FileName);
+      throw;
+      }
+  }
+
+  /**
+   * Write a gzipped NIfTI file from the voxels of an image in memory, with
+   * ParallelGzipWriter. The header is the one that ITK writes for a stub
+   * image with the same geometry and at most two voxels along each axis,
+   * with the dimensions of the image filled in. Returns false, without
+   * writing anything, if the file is not a gzipped NIfTI file or if its
+   * header can not be made this way. The file is then left to ITK.
+   */
+  template<class TImage>
+    bool WriteCompressedNifti(TImage *image, const char *FileName)
+  {
+    if(!this->IsCompressedNiftiFileName(FileName))
+      return false;
+
+    image->UpdateOutputInformation();
+    image->SetRequestedRegionToLargestPossibleRegion();
+    image->Update();
+
+    typename TImage::RegionType region = image->GetLargestPossibleRegion();
+    if(image->GetBufferedRegion() != region)
+      return false;
+
+    // Axes of size one stay so in the stub, so that ITK gives its header the
+    // same number of dimensions as that of the image
+    typename TImage::Pointer stub = TImage::New();
+    stub->CopyInformation(image);
+    stub->SetMetaDataDictionary(image->GetMetaDataDictionary());
+    typename TImage::RegionType stub_region = region;
+    std::vector<size_t> dims(TImage::ImageDimension);
+    for(unsigned int d = 0; d < TImage::ImageDimension; d++)
+      {
+      dims[d] = region.GetSize(d);
+      stub_region.SetSize(d, std::min(dims[d], (size_t) 2));
+      }
+    stub->SetRegions(stub_region);
+    stub->Allocate();
+
+    std::string fn_stub = std::string(FileName) + ".header.nii";
+    try
+      {
+      typedef itk::ImageFileWriter<TImage> WriterType;
+      typename WriterType::Pointer writer = WriterType::New();
+      writer->SetInput(stub);
+      writer->SetFileName(fn_stub);
+      if(m_IOBase)
+        writer->SetImageIO(m_IOBase);
+      writer->Update();
+      }
+    catch(...)
+      {
+      this->RemoveHeaderStub(fn_stub);
+      throw;
+      }
+
+    size_t n_bytes = image->GetPixelContainer()->Size() * sizeof(*image->GetBufferPointer());
+    return this->WriteCompressedNiftiData(
+          fn_stub, FileName, dims, image->GetNumberOfComponentsPerPixel(),
+          image->GetBufferPointer(), n_bytes);
+  }
+
   /** Parse registry to get file format */
   static FileFormat GetFileFormat(Registry &folder, FileFormat dflt = FORMAT_COUNT);
 
@@ -270,9 +372,15 @@ public:
    *   - SeriesFiles (an array with filenames)
    *
    * To obtain the result of the parsing call GetLastDicomParseRegistry()
+   *
+   * The headers of the files are read in parallel. If an index file is
+   * given, the header values are also stored in this file, and are reused
+   * the next time the directory is parsed for files whose size and
+   * modification time have not changed.
    */
   void ParseDicomDirectory(
-      const std::string &dir, itk::Command *progressCommand = NULL);
+      const std::string &dir, itk::Command *progressCommand = NULL,
+      const std::string &index_file = std::string());
 
   /**
    * Get the result of the last parse operation. This should be safe to
@@ -299,6 +407,29 @@ public:
     m_LoadMultiComponentAs4D = !value;
   }
 
+  /**
+   * Whether uncompressed images whose layout on disk matches the native image
+   * (NIfTI, MetaImage and raw files in the machine's byte order) are mapped
+   * into memory rather than read. The voxels of a mapped image are only read
+   * from disk when they are accessed. Off by default, since other programs
+   * that overwrite or truncate the file while it is mapped make the image
+   * data invalid, or make accessing it crash the program.
+   */
+  void SetUseMemoryMapping(bool value) { m_UseMemoryMapping = value; }
+  bool GetUseMemoryMapping() const { return m_UseMemoryMapping; }
+
+  /**
+   * Size in bytes above which 4D images that are not mapped from their own
+   * file are read into a scratch file, which is then mapped into memory.
+   * This applies to compressed NIfTI files too, and lets ImageWrapper keep
+   * only some of the time points in memory (see SetTimePointMemoryBudget).
+   * The voxels must be stored in the layout of the native image, as for
+   * memory mapping. Zero turns this off. The default matches the default
+   * time point memory budget of ImageWrapper.
+   */
+  void SetScratchFileThreshold(size_t value) { m_ScratchFileThreshold = value; }
+  size_t GetScratchFileThreshold() const { return m_ScratchFileThreshold; }
+
   /**
    * If header already exists, return it. Otherwise read the header and return it.
    * This is needed because sometimes an io object is passed to a method, and it may not be
@@ -323,9 +454,55 @@ protected:
   /** Templated function that reads a scalar image in its native datatype */
   template <typename TScalar> void DoSaveNative(const char *fname, Registry &folder);
 
+  /**
+   * Read the voxels of a gzipped NIfTI file into the buffer using several
+   * threads. Returns false if the file is not suited for this, in which case
+   * the data should be read by the IO object.
+   */
+  bool ReadCompressedNiftiData(void *buffer, size_t size);
+
+  /**
+   * Map the voxels of an uncompressed image into memory, if they are stored
+   * in the layout of the native image. Returns NULL otherwise.
+   */
+  MemoryMappedFile *MapNativeImageData(Registry &folder, size_t size);
+
+  /**
+   * Copy the voxels of a large 4D image into a scratch file and map it, if
+   * they are stored in the layout of the native image. Returns NULL if the
+   * image is too small or is stored differently.
+   */
+  MemoryMappedFile *CopyNativeImageDataToScratchFile(Registry &folder, size_t size);
+
+  /**
+   * Find the file and offset of voxels stored in the layout of the native
+   * image, and whether the file is gzipped. Returns false for other layouts.
+   */
+  bool FindNativeImageData(Registry &folder, size_t size, std::string &data_file,
+                           size_t &offset, bool &gzipped);
+
+  /** Whether FileName is saved as a gzipped NIfTI file */
+  bool IsCompressedNiftiFileName(const char *FileName) const;
+
+  /**
+   * Write the header of the stub file written by WriteCompressedNifti, with
+   * the dimensions of the image, and the voxels to a gzipped NIfTI file. The
+   * stub file is removed. Returns false if the header does not describe the
+   * voxels, or if the dimensions do not fit into a NIfTI-1 header.
+   */
+  bool WriteCompressedNiftiData(const std::string &fn_stub, const char *FileName,
+                                const std::vector<size_t> &dims, size_t n_components,
+                                const void *data, size_t n_bytes);
+
+  /** Remove the stub file written by WriteCompressedNifti */
+  void RemoveHeaderStub(const std::string &fn_stub);
+
   /** Templated function that computes an MD5 hash from the stored image */
   template <typename TScalar> std::string DoGetNativeMD5Hash();
 
+  /** Templated function that computes a fast hash from the stored image */
+  template <typename TScalar> std::string DoGetNativeHash();
+
 	/** convert 4D itk image into 4D itk vector image */
 	template <typename TScalar> void ConvertToVectorImage(
 			itk::VectorImage<TScalar, 4> *output, itk::Image<TScalar, 4> *input) const;
@@ -341,6 +518,7 @@ protected:
 														itk::Command *progressCmd = nullptr) = 0;
 		virtual void SaveNative(GuidedNativeImageIO *self, const char *fname, Registry &folder) = 0;
     virtual std::string GetNativeMD5Hash(GuidedNativeImageIO *self) = 0;
+    virtual std::string GetNativeHash(GuidedNativeImageIO *self) = 0;
     virtual ~DispatchBase() {}
   };
 
@@ -353,6 +531,8 @@ protected:
 			{ self->DoSaveNative<TScalar>(fname, folder); }
     virtual std::string GetNativeMD5Hash(GuidedNativeImageIO *self)
       { return self->DoGetNativeMD5Hash<TScalar>(); }
+    virtual std::string GetNativeHash(GuidedNativeImageIO *self)
+      { return self->DoGetNativeHash<TScalar>(); }
   };
 
   /** 
@@ -457,6 +637,10 @@ protected:
   bool m_LoadMultiComponentAs4D = false;
   bool m_Load4DAsMultiComponent = false;
 
+  /** Whether to map uncompressed images into memory */
+  bool m_UseMemoryMapping = false;
+  size_t m_ScratchFileThreshold = ((size_t) 1) << 31;
+
 };
 
 
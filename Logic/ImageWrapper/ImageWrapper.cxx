@@ -49,6 +49,7 @@
 #include "itkCommand.h"
 #include "ImageCoordinateGeometry.h"
 #include <itkImageFileWriter.h>
+#include <itkImageDuplicator.h>
 #include <itkResampleImageFilter.h>
 #include <itkIdentityTransform.h>
 #include <itkFlipImageFilter.h>
@@ -189,6 +190,12 @@ public:
                         image->GetNameOfClass());
   }
 
+  template <class TSavedImage> static SmartPtr<TSavedImage> CopyImage(TSavedImage *image)
+  {
+    throw IRISException("CopyImage unsupported for class %s",
+                        image->GetNameOfClass());
+  }
+
   static void WriteAsFloat(ImageType *image,
                            const char *itkNotUsed(fname),
                            Registry &itkNotUsed(hints),
@@ -239,6 +246,11 @@ public:
                         image_4d->GetNameOfClass());
   }
 
+  static const MemoryMappedFile *GetMappedFile(Image4DType *itkNotUsed(image_4d))
+  {
+    return NULL;
+  }
+
   static PatchOffsetTable GetPatchOffsetTable(TImage *image, const itk::Size<3> &)
   {
     throw IRISException("GetPatchOffsetTable unsupported for class %s", image->GetNameOfClass());
@@ -298,15 +310,23 @@ public:
   {
     SmartPtr<GuidedNativeImageIO> io = GuidedNativeImageIO::New();
     io->CreateImageIO(fname, hints, false);
-    itk::ImageIOBase *base = io->GetIOBase();
 
     typedef itk::ImageFileWriter<TSavedImage> WriterType;
     typename WriterType::Pointer writer = WriterType::New();
-    writer->SetFileName(fname);
-    if(base)
-      writer->SetImageIO(base);
     writer->SetInput(image);
-    writer->Update();
+    io->UpdateWriter(writer.GetPointer(), fname);
+  }
+
+  template <class TSavedImage> static SmartPtr<TSavedImage> CopyImage(TSavedImage *image)
+  {
+    typedef itk::ImageDuplicator<TSavedImage> DuplicatorType;
+    typename DuplicatorType::Pointer duplicator = DuplicatorType::New();
+    duplicator->SetInputImage(image);
+    duplicator->Update();
+
+    SmartPtr<TSavedImage> copy = duplicator->GetOutput();
+    copy->SetMetaDataDictionary(image->GetMetaDataDictionary());
+    return copy;
   }
 
   template <class TInterpolateFunction>
@@ -414,6 +434,15 @@ public:
     image_4d->SetPixelContainer(container);
   }
 
+  static const MemoryMappedFile *GetMappedFile(Image4DType *image_4d)
+  {
+    typedef typename Image4DType::PixelContainer PixelContainer;
+    typedef MappedImageContainer<typename PixelContainer::ElementIdentifier,
+                                 typename PixelContainer::Element> MappedContainer;
+    auto *mapped = dynamic_cast<MappedContainer *>(image_4d->GetPixelContainer());
+    return mapped ? mapped->GetMappedFile() : NULL;
+  }
+
   static PatchOffsetTable GetPatchOffsetTable(TImage *image, const itk::Size<3> &radius)
   {
     // Create an iterator over the output image
@@ -662,15 +691,27 @@ public:
 
     SmartPtr<GuidedNativeImageIO> io = GuidedNativeImageIO::New();
     io->CreateImageIO(fname, hints, false);
-    itk::ImageIOBase *base = io->GetIOBase();
 
     typedef itk::ImageFileWriter<UncompressedType> WriterType;
     typename WriterType::Pointer writer = WriterType::New();
-    writer->SetFileName(fname);
-    if (base)
-        writer->SetImageIO(base);
     writer->SetInput(imgUncompressed);
-    writer->Update();
+    io->UpdateWriter(writer.GetPointer(), fname);
+  }
+
+  template <class TSavedImage> static SmartPtr<TSavedImage> CopyImage(TSavedImage *image)
+  {
+    // Only the run-length encoded lines are copied, which is much cheaper
+    // than copying the voxels of an uncompressed image
+    SmartPtr<TSavedImage> copy = TSavedImage::New();
+    copy->CopyInformation(image);
+    copy->SetMetaDataDictionary(image->GetMetaDataDictionary());
+    copy->SetRegions(image->GetBufferedRegion());
+    copy->Allocate();
+
+    auto *src = image->GetBuffer()->GetBufferPointer();
+    std::copy(src, src + image->GetBuffer()->GetPixelContainer()->Size(),
+              copy->GetBuffer()->GetBufferPointer());
+    return copy;
   }
 
   template <class TInterpolateFunction>
@@ -1430,6 +1471,13 @@ ImageWrapper<TTraits>
   // Set the image as the input to the TDigest
   m_TDigestFilter->SetInput(m_Image4D);
 
+  // A memory mapped 4D image is digested one time point at a time, so that
+  // the time points do not all have to stay in memory
+  typedef ImageWrapperPartialSpecializationTraits<ImageType, Image4DType> Specialization;
+  bool lazy_4d = nt > 1 && Specialization::GetMappedFile(m_Image4D);
+  m_TDigestFilter->SetNumberOfStreamDivisions(lazy_4d ? nt : 1);
+  m_TDigestFilter->SetReleaseDigestedData(lazy_4d);
+
   // Set the sampling rate in the TDigest. For large images it is too computationally
   // expensive to digest the whole image, so instead we can digest a subset of the pixels.
   // The values here restrict sampling to a value between 500000 and 1000000.
@@ -1445,6 +1493,10 @@ ImageWrapper<TTraits>
   // spatial information. This has to be done before the call to SetITKTransform()
   m_TimePointSelectFilter->Update();
 
+  // Start reading the current time point and its neighbors
+  m_ResidentTimePoints.clear();
+  this->UpdateResidentTimePoints();
+
   // Update the reference space and transform
   this->SetITKTransform(referenceSpace, transform);
 
@@ -1942,6 +1994,49 @@ ImageWrapper<TTraits>
     // Update the image selector
     m_TimePointSelectFilter->SetSelectedInput(index);
     m_TimePointSelectFilter->Update();
+
+    this->UpdateResidentTimePoints();
+    }
+}
+
+template<class TTraits>
+void
+ImageWrapper<TTraits>
+::UpdateResidentTimePoints()
+{
+  // Only memory mapped images are loaded lazily. GuidedNativeImageIO maps
+  // large 4D images, from a scratch copy if necessary, and reads smaller ones
+  // into memory in full
+  typedef ImageWrapperPartialSpecializationTraits<ImageType, Image4DType> Specialization;
+  const MemoryMappedFile *mf = Specialization::GetMappedFile(m_Image4D);
+  unsigned int nt = m_ImageTimePoints.size();
+  if(!mf || nt < 2)
+    return;
+
+  size_t tp_bytes = mf->GetLength() / nt;
+  size_t max_resident = std::max((size_t) 3, m_TimePointMemoryBudget / tp_bytes);
+
+  // The current time point is read first, then its neighbors, which are the
+  // most likely to be selected next. The reads happen in the background
+  unsigned int tp = m_TimePointIndex;
+  std::vector<unsigned int> wanted = { tp };
+  if(tp + 1 < nt)
+    wanted.push_back(tp + 1);
+  if(tp > 0)
+    wanted.push_back(tp - 1);
+
+  for(auto it = wanted.rbegin(); it != wanted.rend(); ++it)
+    {
+    m_ResidentTimePoints.remove(*it);
+    m_ResidentTimePoints.push_front(*it);
+    mf->Prefetch(tp_bytes * (*it), tp_bytes);
+    }
+
+  // Release the least recently used time points over the budget
+  while(m_ResidentTimePoints.size() > max_resident)
+    {
+    mf->Release(tp_bytes * m_ResidentTimePoints.back(), tp_bytes);
+    m_ResidentTimePoints.pop_back();
     }
 }
 
@@ -2290,6 +2385,9 @@ void
 ImageWrapper<TTraits>
 ::WriteToFile(const char *filename, Registry &hints)
 {
+  // A background write to the same file must not finish after this one
+  this->FinishBackgroundWrite();
+
   // What kind of mapping are we using
   if(this->GetNativeMapping().IsIdentity())
     {
@@ -2306,13 +2404,100 @@ ImageWrapper<TTraits>
   m_FileName = itksys::SystemTools::GetFilenamePath(filename);
 
   // Store the timestamp when the filename was written
-  for(ImagePointer img : m_ImageTimePoints)
-    if(m_ImageSaveTime < img->GetTimeStamp())
-      m_ImageSaveTime = img->GetTimeStamp();
+  itk::TimeStamp ts = this->GetImageDataTimeStamp();
+  if(m_ImageSaveTime < ts)
+    m_ImageSaveTime = ts;
+}
 
-  // Also check global 4d image time stamp
-  if (m_ImageSaveTime < m_Image4D->GetTimeStamp())
-    m_ImageSaveTime = m_Image4D->GetTimeStamp();
+template<class TTraits>
+void
+ImageWrapper<TTraits>
+::WriteToFileInBackground(const char *filename, Registry &hints)
+{
+  typedef ImageWrapperPartialSpecializationTraits<ImageType, Image4DType> Specialization;
+
+  // Only one write at a time
+  this->FinishBackgroundWrite();
+
+  m_BackgroundWriteTime = this->GetImageDataTimeStamp();
+  m_BackgroundWriteFileName = filename;
+
+  // Images saved as float go through the display pipeline, which can not be
+  // used from another thread. These are written right away.
+  if(!this->GetNativeMapping().IsIdentity())
+    {
+    std::promise<void> result;
+    try
+      {
+      this->WriteToFileAsFloat(filename, hints);
+      result.set_value();
+      }
+    catch(...)
+      {
+      result.set_exception(std::current_exception());
+      }
+    m_BackgroundWrite = result.get_future();
+    return;
+    }
+
+  // Write either in 4D or in 3D, from a snapshot taken on this thread
+  std::string fn = filename;
+  Registry hints_copy = hints;
+  if(this->GetNumberOfTimePoints() > 1)
+    {
+    SmartPtr<Image4DType> snapshot = Specialization::CopyImage(m_Image4D.GetPointer());
+    m_BackgroundWrite = std::async(std::launch::async, [snapshot, fn, hints_copy]() mutable
+      {
+      Specialization::Write(snapshot.GetPointer(), fn.c_str(), hints_copy);
+      });
+    }
+  else
+    {
+    SmartPtr<ImageType> snapshot = Specialization::CopyImage(m_Image);
+    m_BackgroundWrite = std::async(std::launch::async, [snapshot, fn, hints_copy]() mutable
+      {
+      Specialization::Write(snapshot.GetPointer(), fn.c_str(), hints_copy);
+      });
+    }
+}
+
+template<class TTraits>
+bool
+ImageWrapper<TTraits>
+::IsBackgroundWriteFinished() const
+{
+  return !m_BackgroundWrite.valid()
+      || m_BackgroundWrite.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+template<class TTraits>
+void
+ImageWrapper<TTraits>
+::FinishBackgroundWrite()
+{
+  if(!m_BackgroundWrite.valid())
+    return;
+
+  // This rethrows any exception from the write
+  std::future<void> write = std::move(m_BackgroundWrite);
+  write.get();
+
+  // Same bookkeeping as in WriteToFile, but with the time of the snapshot
+  m_FileName = itksys::SystemTools::GetFilenamePath(m_BackgroundWriteFileName);
+  if(m_ImageSaveTime < m_BackgroundWriteTime)
+    m_ImageSaveTime = m_BackgroundWriteTime;
+}
+
+template<class TTraits>
+itk::TimeStamp
+ImageWrapper<TTraits>
+::GetImageDataTimeStamp() const
+{
+  itk::TimeStamp ts = m_Image4D->GetTimeStamp();
+  for(ImagePointer img : m_ImageTimePoints)
+    if(ts < img->GetTimeStamp())
+      ts = img->GetTimeStamp();
+  return ts;
 }
 
 template<class TTraits>
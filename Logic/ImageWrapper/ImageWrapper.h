@@ -44,6 +44,8 @@
 #include <DisplayMappingPolicy.h>
 #include <itkSimpleDataObjectDecorator.h>
 #include <array>
+#include <future>
+#include <list>
 #include <vector>
 
 // Forward declarations to IRIS classes
@@ -456,6 +458,17 @@ public:
   /** Set the current time index */
   virtual void SetTimePointIndex(unsigned int index) ITK_OVERRIDE;
 
+  /**
+   * Memory budget, in bytes, for the time points of a 4D image that is
+   * memory mapped from disk, either from its own file or from the scratch
+   * copy that GuidedNativeImageIO makes of large 4D images. Time points are
+   * read when they are first selected, and the most recently selected ones
+   * that fit in the budget are kept in memory. The pages of older time
+   * points are released.
+   */
+  irisSetMacro(TimePointMemoryBudget, size_t)
+  irisGetMacro(TimePointMemoryBudget, size_t)
+
   const ImageBaseType* GetDisplayViewportGeometry(unsigned int index) const;
 
   virtual void SetDisplayViewportGeometry(
@@ -698,6 +711,21 @@ public:
    */
   virtual void WriteToFile(const char *filename, Registry &hints) ITK_OVERRIDE;
 
+  /**
+   * Start writing a snapshot of the image to disk on a background thread
+   */
+  virtual void WriteToFileInBackground(const char *filename, Registry &hints) ITK_OVERRIDE;
+
+  /**
+   * Check if the background write has finished
+   */
+  virtual bool IsBackgroundWriteFinished() const ITK_OVERRIDE;
+
+  /**
+   * Wait for the background write and mark the image as saved
+   */
+  virtual void FinishBackgroundWrite() ITK_OVERRIDE;
+
   /**
    * Create a thumbnail from the image and write it to a .png file
    */
@@ -825,6 +853,16 @@ protected:
   typedef SmartPtr<TimePointSelectFilter> TimePointSelectPointer;
   TimePointSelectPointer m_TimePointSelectFilter;
 
+  /** Time points of a memory mapped 4D image kept in memory, most recent first */
+  std::list<unsigned int> m_ResidentTimePoints;
+  size_t m_TimePointMemoryBudget = ((size_t) 1) << 31;
+
+  /**
+   * Mark the current time point of a memory mapped 4D image as used, prefetch
+   * its neighbors and release time points that do not fit in the budget
+   */
+  void UpdateResidentTimePoints();
+
   /**
    * The currently selected 3D image from the 4D image. This is the output
    * of the time point select filter.
@@ -881,6 +919,14 @@ protected:
   /** Time when the internal image was allocated, and when it was last saved */
   itk::TimeStamp m_ImageAssignTime, m_ImageSaveTime;
 
+  /** The write started by WriteToFileInBackground, and its snapshot time */
+  std::future<void> m_BackgroundWrite;
+  itk::TimeStamp m_BackgroundWriteTime;
+  std::string m_BackgroundWriteFileName;
+
+  /** The newest time stamp of the 4D image and the time point images */
+  itk::TimeStamp GetImageDataTimeStamp() const;
+
   /** The pipeline that handles mapping intensities to the display slices */
   SmartPtr<DisplayMapping> m_DisplayMapping;
 
@@ -443,6 +443,26 @@ public:
    */
   virtual void WriteToFile(const char *filename, Registry &hints) = 0;
 
+  /**
+   * Start writing the image to disk on a background thread. The write works
+   * on a snapshot of the image, so the image can be edited in the meantime.
+   * Taking the snapshot is cheap for segmentations, whose lines are run-length
+   * encoded. FinishBackgroundWrite must be called to complete the save.
+   */
+  virtual void WriteToFileInBackground(const char *filename, Registry &hints) = 0;
+
+  /**
+   * Check if the background write has finished (or was never started)
+   */
+  virtual bool IsBackgroundWriteFinished() const = 0;
+
+  /**
+   * Wait for the background write to finish. If it succeeded, the image is
+   * marked as saved as of the time when the snapshot was taken. Otherwise, the
+   * exception thrown during the write is rethrown.
+   */
+  virtual void FinishBackgroundWrite() = 0;
+
   /**
    * Check if the image has unsaved changes
    */
@@ -68,7 +68,7 @@ void LabelImageWrapper::UpdateWrappedImages(
   // Set up new undo managers
   m_TimePointUndoManagers.resize(this->GetNumberOfTimePoints());
   for(auto &p : m_TimePointUndoManagers)
-    p = new UndoManagerType(4, 200000);
+    p = new UndoManagerType(4, 200000, this);
 
   // Modified event on the image is rebroadcast as the WrapperImageChangeEvent
   Rebroadcaster::Rebroadcast(image_4d, itk::ModifiedEvent(), this, WrapperImageChangeEvent());
@@ -76,6 +76,13 @@ void LabelImageWrapper::UpdateWrappedImages(
   // Modified event on each of the timepoints should also be rebroadcast
   for(auto &img : this->m_ImageTimePoints)
     Rebroadcaster::Rebroadcast(img, itk::ModifiedEvent(), this, WrapperImageChangeEvent());
+
+  // GetVoxel queries the time point images, which is done repeatedly by the
+  // cursor inspector and sampling code. Index the RLE lines to make these
+  // queries logarithmic in the number of segments. All edits to the label
+  // data are followed by PixelsModified(), which discards the stale index.
+  for(auto &img : this->m_ImageTimePoints)
+    img->SetUseLineIndex(true);
 }
 
 void LabelImageWrapper::StoreIntermediateUndoDelta(UndoManagerDelta *delta)
@@ -121,32 +128,11 @@ void LabelImageWrapper::Undo()
   // Get the commit for the undo
   const UndoManagerType::Commit &commit = um->GetCommitForUndo();
 
-  // The label image that will undergo undo
-  typedef itk::ImageRegionIterator<ImageType> IteratorType;
-
-  // Iterate over all the deltas in reverse order
+  // Iterate over all the deltas in reverse order, subtracting each delta
+  // from the label image one scanline at a time
   UndoManagerType::DList::const_reverse_iterator dit = commit.GetDeltas().rbegin();
   for(; dit != commit.GetDeltas().rend(); ++dit)
-    {
-    // Apply the changes in the current delta
-    UndoManagerType::Delta *delta = *dit;
-
-    // Iterator for the relevant region in the label image
-    IteratorType lit(m_Image, delta->GetRegion());
-
-    // Iterate over the rles in the delta
-    for(size_t i = 0; i < delta->GetNumberOfRLEs(); i++)
-      {
-      size_t n = delta->GetRLELength(i);
-      LabelType d = delta->GetRLEValue(i);
-      for(size_t j = 0; j < n; j++)
-        {
-        if(d != 0)
-          lit.Set(lit.Get() - d);
-        ++lit;
-        }
-      }
-    }
+    (*dit)->ApplyToImage(m_Image, true);
 
   // Set modified flags
   this->PixelsModified();
@@ -165,37 +151,23 @@ void LabelImageWrapper::Redo()
   // Get the commit for the redo
   const UndoManagerType::Commit &commit = um->GetCommitForRedo();
 
-  // The label image that will undergo redo
-  typedef itk::ImageRegionIterator<ImageType> IteratorType;
-
-  // Iterate over all the deltas in reverse order
+  // Iterate over all the deltas in order, adding each delta to the label
+  // image one scanline at a time
   UndoManagerType::DList::const_iterator dit = commit.GetDeltas().begin();
   for(; dit != commit.GetDeltas().end(); ++dit)
-    {
-    // Apply the changes in the current delta
-    UndoManagerType::Delta *delta = *dit;
-
-    // Iterator for the relevant region in the label image
-    IteratorType lit(m_Image, delta->GetRegion());
-
-    // Iterate over the rles in the delta
-    for(size_t i = 0; i < delta->GetNumberOfRLEs(); i++)
-      {
-      size_t n = delta->GetRLELength(i);
-      LabelType d = delta->GetRLEValue(i);
-      for(size_t j = 0; j < n; j++)
-        {
-        if(d != 0)
-          lit.Set(lit.Get() + d);
-        ++lit;
-        }
-      }
-    }
+    (*dit)->ApplyToImage(m_Image, false);
 
   // Set modified flags
   this->PixelsModified();
 }
 
+UndoMemoryBudget::Usage
+LabelImageWrapper
+::GetUndoMemoryUsage() const
+{
+  return UndoMemoryBudget::GetInstance().GetUsage(this);
+}
+
 const
 LabelImageWrapper::UndoManagerType *
 LabelImageWrapper
@@ -3,6 +3,7 @@
 
 #include "ImageWrapperTraits.h"
 #include "ScalarImageWrapper.h"
+#include "UndoMemoryBudget.h"
 
 template <typename TPixel> class UndoDataManager;
 template <typename TPixel> class UndoDelta;
@@ -77,6 +78,13 @@ public:
   /** Get the undo manager */
   const UndoManagerType *GetUndoManager() const;
 
+  /**
+   * Report the memory used by the undo data of this layer, summed over all
+   * time points. The undo managers of all layers share a single memory budget
+   * (see UndoMemoryBudget), with older undo points packed and spilled to disk.
+   */
+  UndoMemoryBudget::Usage GetUndoMemoryUsage() const;
+
   /** This is not used by the undo system itself, but uses the undo code to
    * store the contents of the image as an undo delta object, which can then
    * be stored in memory compactly. The caller is responsible for deleting the
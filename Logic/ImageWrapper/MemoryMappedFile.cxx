@@ -0,0 +1,401 @@
+#include "MemoryMappedFile.h"
+#include "IRISException.h"
+#include "itksys/SystemTools.hxx"
+#include "itksys/Directory.hxx"
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <vector>
+
+#ifdef WIN32
+#include <windows.h>
+#include <io.h>
+#include "itksys/Encoding.hxx"
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+
+// The files that are currently mapped, by full path
+std::mutex g_MappedFilesMutex;
+std::multimap<std::string, MemoryMappedFile *> g_MappedFiles;
+
+// The files that are written when saving an image under the given name: the
+// file itself, and the data file of formats with a separate header
+std::set<std::string> GetWrittenFiles(const std::string &fn)
+{
+  std::string full = itksys::SystemTools::CollapseFullPath(fn);
+  std::string ext = itksys::SystemTools::LowerCase(
+        itksys::SystemTools::GetFilenameLastExtension(full));
+  std::string stem = itksys::SystemTools::GetFilenamePath(full) + "/"
+      + itksys::SystemTools::GetFilenameWithoutLastExtension(full);
+
+  std::set<std::string> files;
+  files.insert(full);
+  if(ext == ".mhd")
+    {
+    files.insert(stem + ".raw");
+    files.insert(stem + ".zraw");
+    }
+  else if(ext == ".hdr")
+    {
+    files.insert(stem + ".img");
+    }
+  return files;
+}
+
+// Check if writing the given file would overwrite a mapped file
+bool IsWriteOverMappedFile(const std::string &fn)
+{
+  std::set<std::string> written = GetWrittenFiles(fn);
+
+  std::lock_guard<std::mutex> lock(g_MappedFilesMutex);
+  for(const auto &entry : g_MappedFiles)
+    if(written.count(entry.first))
+      return true;
+  return false;
+}
+
+#ifdef WIN32
+// Map a view of a file with copy-on-write access, optionally at an address
+void *MapFileView(const std::string &filename, size_t base_offset,
+                  size_t base_length, void *address)
+{
+  HANDLE hFile = CreateFileW(itksys::Encoding::ToWide(filename).c_str(),
+                             GENERIC_READ, FILE_SHARE_READ, NULL,
+                             OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if(hFile == INVALID_HANDLE_VALUE)
+    return NULL;
+
+  void *base = NULL;
+  LARGE_INTEGER file_size;
+  if(GetFileSizeEx(hFile, &file_size)
+     && (unsigned long long) file_size.QuadPart >= base_offset + base_length)
+    {
+    HANDLE hMap = CreateFileMappingW(hFile, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    if(hMap)
+      {
+      unsigned long long offset = base_offset;
+      base = MapViewOfFileEx(hMap, FILE_MAP_COPY,
+                             (DWORD) (offset >> 32), (DWORD) (offset & 0xffffffff),
+                             base_length, address);
+      CloseHandle(hMap);
+      }
+    }
+  CloseHandle(hFile);
+  return base;
+}
+#endif
+
+}
+
+MemoryMappedFile::MemoryMappedFile()
+{
+  m_Data = NULL;
+  m_Length = 0;
+  m_Base = NULL;
+  m_BaseLength = 0;
+  m_BaseOffset = 0;
+  m_Detached = false;
+  m_ScratchFile = NULL;
+}
+
+MemoryMappedFile::~MemoryMappedFile()
+{
+  if(m_Base)
+    {
+#ifdef WIN32
+    if(m_Detached)
+      VirtualFree(m_Base, 0, MEM_RELEASE);
+    else
+      UnmapViewOfFile(m_Base);
+#else
+    munmap(m_Base, m_BaseLength);
+#endif
+
+    std::lock_guard<std::mutex> lock(g_MappedFilesMutex);
+    auto range = g_MappedFiles.equal_range(m_FileName);
+    for(auto it = range.first; it != range.second; ++it)
+      {
+      if(it->second == this)
+        {
+        g_MappedFiles.erase(it);
+        break;
+        }
+      }
+    }
+
+  if(m_ScratchFile)
+    fclose(m_ScratchFile);
+}
+
+MemoryMappedFile *
+MemoryMappedFile::Map(const char *filename, size_t offset, size_t length)
+{
+  if(length == 0)
+    return NULL;
+
+  std::unique_ptr<MemoryMappedFile> mf(new MemoryMappedFile());
+  mf->m_FileName = itksys::SystemTools::CollapseFullPath(filename);
+
+#ifdef WIN32
+  // Views must start at a multiple of the allocation granularity
+  SYSTEM_INFO si;
+  GetSystemInfo(&si);
+  size_t align = offset % si.dwAllocationGranularity;
+
+  mf->m_BaseOffset = offset - align;
+  mf->m_BaseLength = length + align;
+  mf->m_Base = MapFileView(filename, mf->m_BaseOffset, mf->m_BaseLength, NULL);
+  if(!mf->m_Base)
+    return NULL;
+#else
+  // Mappings must start at a page boundary
+  size_t align = offset % (size_t) sysconf(_SC_PAGESIZE);
+
+  int fd = open(filename, O_RDONLY);
+  if(fd < 0)
+    return NULL;
+
+  struct stat st;
+  if(fstat(fd, &st) == 0 && (size_t) st.st_size >= offset + length)
+    {
+    mf->m_BaseOffset = offset - align;
+    mf->m_BaseLength = length + align;
+    void *base = mmap(NULL, mf->m_BaseLength, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                      fd, (off_t) mf->m_BaseOffset);
+    mf->m_Base = (base == MAP_FAILED) ? NULL : base;
+    }
+  close(fd);
+
+  if(!mf->m_Base)
+    return NULL;
+#endif
+
+  mf->m_Data = static_cast<char *>(mf->m_Base) + align;
+  mf->m_Length = length;
+
+  std::lock_guard<std::mutex> lock(g_MappedFilesMutex);
+  g_MappedFiles.insert(std::make_pair(mf->m_FileName, mf.get()));
+  return mf.release();
+}
+
+MemoryMappedFile *
+MemoryMappedFile::MapScratchCopy(size_t length, const ReadFunction &read)
+{
+  if(length == 0)
+    return NULL;
+
+  std::unique_ptr<MemoryMappedFile> mf(new MemoryMappedFile());
+  mf->m_ScratchFile = tmpfile();
+  if(!mf->m_ScratchFile)
+    return NULL;
+
+  // Copy the data one piece at a time
+  const size_t piece = ((size_t) 1) << 26;
+  std::vector<char> buffer(std::min(length, piece));
+  for(size_t pos = 0; pos < length; pos += piece)
+    {
+    size_t n = std::min(piece, length - pos);
+    read(pos, n, buffer.data());
+    if(fwrite(buffer.data(), 1, n, mf->m_ScratchFile) != n)
+      return NULL;
+    }
+  if(fflush(mf->m_ScratchFile) != 0)
+    return NULL;
+
+#ifdef WIN32
+  HANDLE hFile = (HANDLE) _get_osfhandle(_fileno(mf->m_ScratchFile));
+  HANDLE hMap = CreateFileMappingW(hFile, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+  if(hMap)
+    {
+    mf->m_Base = MapViewOfFile(hMap, FILE_MAP_COPY, 0, 0, length);
+    CloseHandle(hMap);
+    }
+#else
+  void *base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                    fileno(mf->m_ScratchFile), 0);
+  mf->m_Base = (base == MAP_FAILED) ? NULL : base;
+#endif
+
+  if(!mf->m_Base)
+    return NULL;
+
+  // The scratch file is not registered with the mapped files, since images
+  // are never saved over it
+  mf->m_BaseLength = length;
+  mf->m_Data = static_cast<char *>(mf->m_Base);
+  mf->m_Length = length;
+  return mf.release();
+}
+
+bool
+MemoryMappedFile::GetPageRange(size_t offset, size_t length, char *&start, size_t &size) const
+{
+  if(!m_Data || offset >= m_Length)
+    return false;
+
+#ifdef WIN32
+  SYSTEM_INFO si;
+  GetSystemInfo(&si);
+  size_t page = si.dwPageSize;
+#else
+  size_t page = (size_t) sysconf(_SC_PAGESIZE);
+#endif
+
+  // The mapped region starts at a page boundary
+  size_t first = m_Data - static_cast<char *>(m_Base) + offset;
+  size_t last = first + std::min(length, m_Length - offset);
+  first -= first % page;
+
+  start = static_cast<char *>(m_Base) + first;
+  size = last - first;
+  return size > 0;
+}
+
+void
+MemoryMappedFile::Prefetch(size_t offset, size_t length) const
+{
+  char *start;
+  size_t size;
+  if(!GetPageRange(offset, length, start, size))
+    return;
+
+#ifdef WIN32
+  WIN32_MEMORY_RANGE_ENTRY range;
+  range.VirtualAddress = start;
+  range.NumberOfBytes = size;
+  PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+  madvise(start, size, MADV_WILLNEED);
+#endif
+}
+
+void
+MemoryMappedFile::Release(size_t offset, size_t length) const
+{
+  char *start;
+  size_t size;
+  if(!GetPageRange(offset, length, start, size))
+    return;
+
+#ifdef WIN32
+  // Unlocking pages that are not locked removes them from the working set
+  VirtualUnlock(start, size);
+#elif defined(MADV_PAGEOUT)
+  madvise(start, size, MADV_PAGEOUT);
+#elif defined(MADV_COLD)
+  madvise(start, size, MADV_COLD);
+#endif
+}
+
+bool
+MemoryMappedFile::DetachFromFile()
+{
+#ifdef WIN32
+  if(m_Detached)
+    return true;
+
+  // Copy the data, including the pages that have been written to
+  char *base = static_cast<char *>(m_Base);
+  std::vector<char> copy(base, base + m_BaseLength);
+
+  // Allocate ordinary memory in place of the view, so that pointers into the
+  // data remain valid
+  UnmapViewOfFile(m_Base);
+  if(VirtualAlloc(m_Base, m_BaseLength, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE) == m_Base)
+    {
+    memcpy(m_Base, copy.data(), m_BaseLength);
+    m_Detached = true;
+    return true;
+    }
+
+  // The address range was taken in the meantime, put the view back
+  if(MapFileView(m_FileName, m_BaseOffset, m_BaseLength, m_Base) == m_Base)
+    memcpy(m_Base, copy.data(), m_BaseLength);
+  return false;
+#else
+  // Renaming a file over a mapped file leaves the mapped file intact
+  return true;
+#endif
+}
+
+std::string
+MemoryMappedFile::StageWrite(const char *filename)
+{
+  if(!IsWriteOverMappedFile(filename))
+    return filename;
+
+  // Create a new directory next to the file, so that the written files can
+  // be renamed over the original ones
+  std::string dir = itksys::SystemTools::GetFilenamePath(
+        itksys::SystemTools::CollapseFullPath(filename));
+  for(int i = 0; i < 1000; i++)
+    {
+    std::ostringstream oss;
+    oss << dir << "/.itksnap_save_" << i;
+    std::string stage_dir = oss.str();
+    if(!itksys::SystemTools::FileExists(stage_dir)
+       && itksys::SystemTools::MakeDirectory(stage_dir))
+      return stage_dir + "/" + itksys::SystemTools::GetFilenameName(filename);
+    }
+
+  throw IRISException("Unable to create a temporary directory in %s to save %s",
+                      dir.c_str(), filename);
+}
+
+void
+MemoryMappedFile::CommitStagedWrite(const std::string &staged, const char *filename)
+{
+  if(staged == filename)
+    return;
+
+  std::string stage_dir = itksys::SystemTools::GetFilenamePath(staged);
+  std::string dir = itksys::SystemTools::GetFilenamePath(
+        itksys::SystemTools::CollapseFullPath(filename));
+
+  itksys::Directory listing;
+  listing.Load(stage_dir);
+  for(unsigned long i = 0; i < listing.GetNumberOfFiles(); i++)
+    {
+    std::string name = listing.GetFile(i);
+    std::string src = stage_dir + "/" + name;
+    std::string dst = dir + "/" + name;
+    if(itksys::SystemTools::FileIsDirectory(src))
+      continue;
+
+#ifdef WIN32
+      {
+      // Windows does not replace files that are mapped
+      std::lock_guard<std::mutex> lock(g_MappedFilesMutex);
+      auto range = g_MappedFiles.equal_range(dst);
+      for(auto it = range.first; it != range.second; ++it)
+        if(!it->second->DetachFromFile())
+          throw IRISException("Unable to release the memory mapped file %s", dst.c_str());
+      }
+#endif
+
+    if(!itksys::SystemTools::RenameFile(src.c_str(), dst.c_str()))
+      throw IRISException("Unable to move the saved file %s to %s",
+                          src.c_str(), dst.c_str());
+    }
+
+  DiscardStagedWrite(staged, filename);
+}
+
+void
+MemoryMappedFile::DiscardStagedWrite(const std::string &staged, const char *filename)
+{
+  if(staged == filename)
+    return;
+
+  itksys::SystemTools::RemoveADirectory(itksys::SystemTools::GetFilenamePath(staged));
+}
@@ -0,0 +1,164 @@
+#ifndef MEMORYMAPPEDFILE_H
+#define MEMORYMAPPEDFILE_H
+
+#include "itkImportImageContainer.h"
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <string>
+
+/**
+ * \class MemoryMappedFile
+ * \brief A range of a file mapped into memory.
+ *
+ * The mapping is private (copy-on-write): the pages are read from the file
+ * when first accessed, and pages that are written to become private copies,
+ * so the file on disk is never modified.
+ *
+ * Overwriting or truncating a file while it is mapped would pull the data
+ * from under the mapping (on POSIX systems, accessing the missing pages
+ * raises SIGBUS), so the class keeps track of the mapped files, and writers
+ * that would replace one of them stage the write with StageWrite. The new
+ * file is written elsewhere and then renamed over the mapped file. On POSIX
+ * systems the mapping keeps the contents of the replaced file alive. Windows
+ * does not allow mapped files to be replaced, so there the mapped data is
+ * first copied into memory. Nothing protects against other programs
+ * modifying a mapped file in place.
+ *
+ * Data that can not be mapped from its own file, e.g., because the file is
+ * compressed, can be copied into a scratch file with MapScratchCopy. The
+ * scratch file is private to the process, so the concerns above do not
+ * apply to it.
+ */
+class MemoryMappedFile
+{
+public:
+  ~MemoryMappedFile();
+
+  /**
+   * Map length bytes of the file starting at the given offset. Returns NULL
+   * if the file is too short or can not be mapped.
+   */
+  static MemoryMappedFile *Map(const char *filename, size_t offset, size_t length);
+
+  /** Fills a buffer with n bytes of data starting at an offset */
+  typedef std::function<void(size_t offset, size_t n, char *buffer)> ReadFunction;
+
+  /**
+   * Copy length bytes of data into a scratch file and map it. The data is
+   * obtained from the read function piece by piece, so that only one piece
+   * is held in memory at a time. The scratch file is created with tmpfile()
+   * and is removed when the mapping is released. Returns NULL if the file
+   * can not be written or mapped. Exceptions thrown by the read function are
+   * passed on.
+   */
+  static MemoryMappedFile *MapScratchCopy(size_t length, const ReadFunction &read);
+
+  /** Pointer to the mapped data, i.e., to the byte at the offset */
+  char *GetData() const { return m_Data; }
+
+  /** Length of the mapped data */
+  size_t GetLength() const { return m_Length; }
+
+  /** The file that is mapped, empty for a scratch file */
+  const std::string &GetFileName() const { return m_FileName; }
+
+  /**
+   * Ask the system to start reading a range of the data from disk. This
+   * returns right away, the pages are read in the background.
+   */
+  void Prefetch(size_t offset, size_t length) const;
+
+  /**
+   * Tell the system that a range of the data is not needed for now, so that
+   * its pages can be reclaimed first. The contents are not affected, pages
+   * are read from the file again (or from swap, if they have been written
+   * to) when they are next accessed.
+   */
+  void Release(size_t offset, size_t length) const;
+
+  /**
+   * Prepare for writing an image file. If the write would overwrite a mapped
+   * file, i.e., the file itself or the data file that goes with it (the .raw
+   * file of an .mhd header), this returns a file name with the same name in
+   * a new temporary directory next to the file, and the image should be
+   * written there. Otherwise the file name is returned unchanged.
+   */
+  static std::string StageWrite(const char *filename);
+
+  /**
+   * Complete a write started with StageWrite by moving the written files
+   * over the original ones. On Windows, the mapped files that are replaced
+   * are first copied into memory, which must not happen while other threads
+   * read the mapped data. Throws an exception if the files can not be moved.
+   */
+  static void CommitStagedWrite(const std::string &staged, const char *filename);
+
+  /** Remove the files of a staged write that failed */
+  static void DiscardStagedWrite(const std::string &staged, const char *filename);
+
+private:
+  MemoryMappedFile();
+
+  // Replace the mapping by ordinary memory at the same address, holding a
+  // copy of the data, so that the file is no longer used. Returns false if
+  // this is not possible, in which case the mapping is unchanged
+  bool DetachFromFile();
+
+  // Get the whole pages that overlap a range of the data
+  bool GetPageRange(size_t offset, size_t length, char *&start, size_t &size) const;
+
+  std::string m_FileName;
+  char *m_Data;
+  size_t m_Length;
+
+  // The whole mapped region, which starts at a page boundary
+  void *m_Base;
+  size_t m_BaseLength;
+  size_t m_BaseOffset;
+
+  // Whether DetachFromFile replaced the mapping by ordinary memory
+  bool m_Detached;
+
+  // The scratch file created by MapScratchCopy
+  FILE *m_ScratchFile;
+};
+
+/**
+ * \class MappedImageContainer
+ * \brief A pixel container whose elements live in a memory mapped file.
+ *
+ * The container owns the mapping, which is released when the container is
+ * destroyed. The container does not manage its memory in the ITK sense, so
+ * code that reallocates the buffers of pixel containers must check for this
+ * class and copy the data instead.
+ */
+template <typename TElementIdentifier, typename TElement>
+class MappedImageContainer
+    : public itk::ImportImageContainer<TElementIdentifier, TElement>
+{
+public:
+  typedef MappedImageContainer                                    Self;
+  typedef itk::ImportImageContainer<TElementIdentifier, TElement> Superclass;
+  typedef itk::SmartPointer<Self>                                 Pointer;
+  typedef itk::SmartPointer<const Self>                           ConstPointer;
+  itkNewMacro(Self)
+  itkTypeMacro(MappedImageContainer, ImportImageContainer)
+
+  /** Use the mapped data as the elements of the container, taking ownership */
+  void SetMappedFile(MemoryMappedFile *file, TElementIdentifier n_elements)
+  {
+    m_File.reset(file);
+    this->SetImportPointer(reinterpret_cast<TElement *>(file->GetData()), n_elements, false);
+  }
+
+  const MemoryMappedFile *GetMappedFile() const { return m_File.get(); }
+
+protected:
+  MappedImageContainer() {}
+  ~MappedImageContainer() {}
+
+  std::unique_ptr<MemoryMappedFile> m_File;
+};
+
+#endif // MEMORYMAPPEDFILE_H
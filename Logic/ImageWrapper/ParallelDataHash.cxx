@@ -0,0 +1,170 @@
+#include "ParallelDataHash.h"
+#include "itkMultiThreaderBase.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+const uint64_t PRIME64_1 = 0x9E3779B185EBCA87ULL;
+const uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+const uint64_t PRIME64_3 = 0x165667B19E3779F9ULL;
+const uint64_t PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+const uint64_t PRIME64_5 = 0x27D4EB2F165667C5ULL;
+
+inline uint64_t RotL(uint64_t x, int r)
+{
+  return (x << r) | (x >> (64 - r));
+}
+
+// XXH64 reads its input in little endian order
+inline uint64_t ReadLE64(const unsigned char *p)
+{
+  return (uint64_t) p[0] | ((uint64_t) p[1] << 8) | ((uint64_t) p[2] << 16)
+      | ((uint64_t) p[3] << 24) | ((uint64_t) p[4] << 32) | ((uint64_t) p[5] << 40)
+      | ((uint64_t) p[6] << 48) | ((uint64_t) p[7] << 56);
+}
+
+inline uint64_t ReadLE32(const unsigned char *p)
+{
+  return (uint64_t) p[0] | ((uint64_t) p[1] << 8) | ((uint64_t) p[2] << 16)
+      | ((uint64_t) p[3] << 24);
+}
+
+inline void WriteLE64(uint64_t x, unsigned char *p)
+{
+  for(int i = 0; i < 8; i++)
+    p[i] = (unsigned char) (x >> (8 * i));
+}
+
+inline uint64_t Round(uint64_t acc, uint64_t input)
+{
+  acc += input * PRIME64_2;
+  acc = RotL(acc, 31);
+  return acc * PRIME64_1;
+}
+
+inline uint64_t MergeRound(uint64_t acc, uint64_t val)
+{
+  acc ^= Round(0, val);
+  return acc * PRIME64_1 + PRIME64_4;
+}
+
+}
+
+uint64_t
+ParallelDataHash::XXH64(const void *data, size_t n, uint64_t seed)
+{
+  const unsigned char *p = static_cast<const unsigned char *>(data);
+  const unsigned char *end = p + n;
+  uint64_t h;
+
+  if(n >= 32)
+    {
+    uint64_t v1 = seed + PRIME64_1 + PRIME64_2;
+    uint64_t v2 = seed + PRIME64_2;
+    uint64_t v3 = seed;
+    uint64_t v4 = seed - PRIME64_1;
+
+    for(const unsigned char *limit = end - 32; p <= limit; p += 32)
+      {
+      v1 = Round(v1, ReadLE64(p));
+      v2 = Round(v2, ReadLE64(p + 8));
+      v3 = Round(v3, ReadLE64(p + 16));
+      v4 = Round(v4, ReadLE64(p + 24));
+      }
+
+    h = RotL(v1, 1) + RotL(v2, 7) + RotL(v3, 12) + RotL(v4, 18);
+    h = MergeRound(h, v1);
+    h = MergeRound(h, v2);
+    h = MergeRound(h, v3);
+    h = MergeRound(h, v4);
+    }
+  else
+    {
+    h = seed + PRIME64_5;
+    }
+
+  h += (uint64_t) n;
+
+  for(; p + 8 <= end; p += 8)
+    {
+    h ^= Round(0, ReadLE64(p));
+    h = RotL(h, 27) * PRIME64_1 + PRIME64_4;
+    }
+
+  if(p + 4 <= end)
+    {
+    h ^= ReadLE32(p) * PRIME64_1;
+    h = RotL(h, 23) * PRIME64_2 + PRIME64_3;
+    p += 4;
+    }
+
+  for(; p < end; p++)
+    {
+    h ^= (*p) * PRIME64_5;
+    h = RotL(h, 11) * PRIME64_1;
+    }
+
+  h ^= h >> 33;
+  h *= PRIME64_2;
+  h ^= h >> 29;
+  h *= PRIME64_3;
+  h ^= h >> 32;
+  return h;
+}
+
+uint64_t
+ParallelDataHash::Compute(const void *data, size_t n, unsigned int n_threads)
+{
+  const char *bytes = static_cast<const char *>(data);
+  size_t n_leaves = (n + LeafSize - 1) / LeafSize;
+
+  // Digests of the leaves, followed by the length of the data
+  std::vector<unsigned char> digests(8 * (n_leaves + 1));
+  WriteLE64((uint64_t) n, &digests[8 * n_leaves]);
+
+  if(n_threads == 0)
+    n_threads = itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads();
+  n_threads = (unsigned int) std::min((size_t) std::max(n_threads, 1u), n_leaves);
+
+  // Leaves are handed out one at a time, so the threads stay busy even if
+  // some of the pages have to be read from disk first
+  std::atomic<size_t> next_leaf(0);
+  auto worker = [&]()
+  {
+    for(size_t i = next_leaf++; i < n_leaves; i = next_leaf++)
+      {
+      size_t start = i * LeafSize, len = std::min(LeafSize, n - start);
+      WriteLE64(XXH64(bytes + start, len), &digests[8 * i]);
+      }
+  };
+
+  if(n_threads > 1)
+    {
+    std::vector<std::thread> workers;
+    for(unsigned int t = 1; t < n_threads; t++)
+      workers.emplace_back(worker);
+    worker();
+    for(auto &w : workers)
+      w.join();
+    }
+  else
+    {
+    worker();
+    }
+
+  return XXH64(digests.data(), digests.size());
+}
+
+std::string
+ParallelDataHash::ComputeHex(const void *data, size_t n, unsigned int n_threads)
+{
+  char hex_code[17];
+  snprintf(hex_code, sizeof(hex_code), "%016llx",
+           (unsigned long long) Compute(data, n, n_threads));
+  return std::string(hex_code);
+}
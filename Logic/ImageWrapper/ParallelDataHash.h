@@ -0,0 +1,36 @@
+#ifndef PARALLELDATAHASH_H
+#define PARALLELDATAHASH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * \class ParallelDataHash
+ * \brief A fast hash of a block of memory, computed on several threads.
+ *
+ * The data is split into fixed size leaves that are hashed independently
+ * with XXH64, and the leaf digests, followed by the length of the data, are
+ * hashed again to give the final digest. The result only depends on the
+ * data, not on the number of threads, and is returned as 16 hex characters.
+ *
+ * This is much faster than MD5, but is not a cryptographic hash. Use it to
+ * identify image data, not to protect it.
+ */
+class ParallelDataHash
+{
+public:
+  /** Hash n bytes of data, using the default number of threads if zero */
+  static std::string ComputeHex(const void *data, size_t n, unsigned int n_threads = 0);
+
+  /** Hash n bytes of data, using the default number of threads if zero */
+  static uint64_t Compute(const void *data, size_t n, unsigned int n_threads = 0);
+
+  /** The XXH64 hash of a block of data */
+  static uint64_t XXH64(const void *data, size_t n, uint64_t seed = 0);
+
+  /** Size of the leaves that are hashed independently */
+  static constexpr size_t LeafSize = 1 << 20;
+};
+
+#endif // PARALLELDATAHASH_H
@@ -0,0 +1,652 @@
+#include "ParallelGzipIO.h"
+#include "IRISException.h"
+#include "itkMultiThreaderBase.h"
+#include <itk_zlib.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+// Compressed data is read in batches of this size
+const size_t GZIP_BATCH_SIZE = 1 << 24;
+
+// Maximum number of BGZF blocks waiting to be inflated
+const size_t GZIP_MAX_QUEUED_BLOCKS = 1024;
+
+// Size of the chunks read ahead for sequential inflation
+const size_t GZIP_CHUNK_SIZE = 1 << 22;
+const size_t GZIP_MAX_QUEUED_CHUNKS = 4;
+
+unsigned int ReadLE32(const unsigned char *p)
+{
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int) p[3] << 24);
+}
+
+// Parse the header of a BGZF block. Returns the size of the whole block and
+// sets the header length, returns zero if the data is not a BGZF header, or
+// -1 if more than avail bytes are needed to tell.
+long ParseBlockHeader(const unsigned char *p, size_t avail, size_t &hdr_len)
+{
+  if(avail < 12)
+    return -1;
+
+  // BGZF blocks only have the FEXTRA flag set
+  if(p[0] != 0x1f || p[1] != 0x8b || p[2] != 8 || p[3] != 4)
+    return 0;
+
+  size_t xlen = p[10] | (p[11] << 8);
+  if(avail < 12 + xlen)
+    return -1;
+
+  // Look for the 'BC' subfield that holds the block size minus one
+  for(size_t k = 0; k + 4 <= xlen; )
+    {
+    const unsigned char *sf = p + 12 + k;
+    size_t slen = sf[2] | (sf[3] << 8);
+    if(sf[0] == 'B' && sf[1] == 'C' && slen == 2 && k + 6 <= xlen)
+      {
+      hdr_len = 12 + xlen;
+      long size = (sf[4] | (sf[5] << 8)) + 1;
+      return size >= (long) hdr_len + 8 ? size : 0;
+      }
+    k += 4 + slen;
+    }
+
+  return 0;
+}
+
+// A BGZF block waiting to be inflated
+struct GzipBlock
+{
+  std::shared_ptr<std::vector<unsigned char> > Batch;
+  size_t Start, HeaderLength, Length;
+
+  // Position of the block's data in the uncompressed stream
+  size_t Position;
+};
+
+// Inflate a BGZF block into the part of the output range that it overlaps
+void InflateBlock(const GzipBlock &b, size_t offset, size_t n, char *buffer)
+{
+  const unsigned char *p = b.Batch->data() + b.Start;
+  unsigned long crc = ReadLE32(p + b.Length - 8);
+  size_t isize = ReadLE32(p + b.Length - 4);
+
+  // Blocks that lie entirely in the range are inflated in place
+  bool in_place = b.Position >= offset && b.Position + isize <= offset + n;
+  std::vector<char> temp;
+  char *out = buffer + (b.Position - offset);
+  if(!in_place)
+    {
+    temp.resize(isize);
+    out = temp.data();
+    }
+
+  z_stream zs;
+  memset(&zs, 0, sizeof(zs));
+  if(inflateInit2(&zs, -MAX_WBITS) != Z_OK)
+    throw IRISException("Error: failed to initialize zlib");
+
+  zs.next_in = (Bytef *) (p + b.HeaderLength);
+  zs.avail_in = (uInt) (b.Length - b.HeaderLength - 8);
+  zs.next_out = (Bytef *) out;
+  zs.avail_out = (uInt) isize;
+  int rc = inflate(&zs, Z_FINISH);
+  size_t n_out = zs.total_out;
+  inflateEnd(&zs);
+
+  if(rc != Z_STREAM_END || n_out != isize
+     || crc32(0L, (const Bytef *) out, (uInt) isize) != crc)
+    throw IRISException("Error: corrupt block in gzip file.");
+
+  if(!in_place)
+    {
+    size_t lo = std::max(offset, b.Position);
+    size_t hi = std::min(offset + n, b.Position + isize);
+    memcpy(buffer + (lo - offset), out + (lo - b.Position), hi - lo);
+    }
+}
+
+}
+
+ParallelGzipReader
+::ParallelGzipReader()
+{
+  m_File = NULL;
+  m_Blocked = false;
+  m_NumberOfThreads = 0;
+}
+
+ParallelGzipReader
+::~ParallelGzipReader()
+{
+  this->Close();
+}
+
+bool
+ParallelGzipReader
+::Open(const char *filename)
+{
+  this->Close();
+
+  m_File = fopen(filename, "rb");
+  if(!m_File)
+    return false;
+
+  // Check the gzip magic number, and whether the first member is a BGZF block
+  unsigned char hdr[18];
+  size_t n_read = fread(hdr, 1, sizeof(hdr), m_File);
+  if(n_read < 10 || hdr[0] != 0x1f || hdr[1] != 0x8b)
+    {
+    this->Close();
+    return false;
+    }
+
+  size_t hdr_len;
+  m_Blocked = ParseBlockHeader(hdr, n_read, hdr_len) > 0;
+  m_FileName = filename;
+  return true;
+}
+
+void
+ParallelGzipReader
+::Close()
+{
+  if(m_File)
+    fclose(m_File);
+  m_File = NULL;
+  m_Blocked = false;
+}
+
+void
+ParallelGzipReader
+::Read(size_t offset, size_t n, void *buffer)
+{
+  if(!m_File)
+    throw IRISException("Error: no gzip file is open.");
+
+  if(n == 0)
+    return;
+
+  if(m_Blocked)
+    this->ReadBlocked(offset, n, (char *) buffer);
+  else
+    this->ReadSequential(offset, n, (char *) buffer);
+}
+
+void
+ParallelGzipReader
+::ReadBlocked(size_t offset, size_t n, char *buffer)
+{
+  unsigned int n_threads = m_NumberOfThreads
+      ? m_NumberOfThreads : itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads();
+  n_threads = std::max(n_threads, 1u);
+
+  std::deque<GzipBlock> queue;
+  std::mutex mutex;
+  std::condition_variable cv_work, cv_space;
+  bool done = false;
+  std::exception_ptr worker_exc, reader_exc;
+
+  // Workers inflate the queued blocks into the buffer
+  std::vector<std::thread> workers;
+  for(unsigned int t = 0; t < n_threads; t++)
+    {
+    workers.emplace_back([&]()
+      {
+      for(;;)
+        {
+        GzipBlock block;
+          {
+          std::unique_lock<std::mutex> lock(mutex);
+          cv_work.wait(lock, [&]() { return !queue.empty() || done; });
+          if(queue.empty())
+            return;
+          block = std::move(queue.front());
+          queue.pop_front();
+          if(worker_exc)
+            continue;
+          }
+        cv_space.notify_one();
+
+        try
+          {
+          InflateBlock(block, offset, n, buffer);
+          }
+        catch(...)
+          {
+          std::lock_guard<std::mutex> lock(mutex);
+          if(!worker_exc)
+            worker_exc = std::current_exception();
+          cv_space.notify_all();
+          }
+        }
+      });
+    }
+
+  // Read the compressed data in batches and queue the blocks that overlap the
+  // requested range. A block cut off at the end of a batch is carried over.
+  try
+    {
+    fseek(m_File, 0, SEEK_SET);
+    std::vector<unsigned char> carry;
+    size_t pos_out = 0, end = offset + n;
+    while(pos_out < end)
+      {
+      auto batch = std::make_shared<std::vector<unsigned char> >(carry.size() + GZIP_BATCH_SIZE);
+      std::copy(carry.begin(), carry.end(), batch->begin());
+      size_t n_read = fread(batch->data() + carry.size(), 1, GZIP_BATCH_SIZE, m_File);
+      size_t len = carry.size() + n_read;
+      bool eof = n_read < GZIP_BATCH_SIZE;
+      carry.clear();
+
+      size_t pos = 0;
+      while(pos < len && pos_out < end)
+        {
+        size_t hdr_len = 0;
+        long size = ParseBlockHeader(batch->data() + pos, len - pos, hdr_len);
+        if(size == 0)
+          throw IRISException("Error: unexpected data in blocked gzip file %s.", m_FileName.c_str());
+
+        if(size < 0 || pos + size > len)
+          {
+          if(eof)
+            break;
+          carry.assign(batch->begin() + pos, batch->begin() + len);
+          break;
+          }
+
+        GzipBlock block;
+        block.Batch = batch;
+        block.Start = pos;
+        block.HeaderLength = hdr_len;
+        block.Length = size;
+        block.Position = pos_out;
+
+        size_t isize = ReadLE32(batch->data() + pos + size - 4);
+        if(pos_out < end && pos_out + isize > offset)
+          {
+            {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv_space.wait(lock, [&]() { return queue.size() < GZIP_MAX_QUEUED_BLOCKS || worker_exc; });
+            if(worker_exc)
+              break;
+            queue.push_back(std::move(block));
+            }
+          cv_work.notify_one();
+          }
+
+        pos_out += isize;
+        pos += size;
+        }
+
+        {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(worker_exc)
+          break;
+        }
+
+      if(eof)
+        break;
+      }
+
+    if(pos_out < end)
+      throw IRISException("Error: unexpected end of gzip file %s.", m_FileName.c_str());
+    }
+  catch(...)
+    {
+    reader_exc = std::current_exception();
+    }
+
+  // Let the workers finish the queue
+    {
+    std::lock_guard<std::mutex> lock(mutex);
+    done = true;
+    }
+  cv_work.notify_all();
+  for(auto &w : workers)
+    w.join();
+
+  if(reader_exc)
+    std::rethrow_exception(reader_exc);
+  if(worker_exc)
+    std::rethrow_exception(worker_exc);
+}
+
+void
+ParallelGzipReader
+::ReadSequential(size_t offset, size_t n, char *buffer)
+{
+  std::deque<std::vector<unsigned char> > chunks;
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool eof = false, stop = false;
+
+  // Read the compressed data ahead on a separate thread
+  fseek(m_File, 0, SEEK_SET);
+  std::thread reader([&]()
+    {
+    for(;;)
+      {
+      std::vector<unsigned char> chunk(GZIP_CHUNK_SIZE);
+      size_t n_read = fread(chunk.data(), 1, GZIP_CHUNK_SIZE, m_File);
+      chunk.resize(n_read);
+
+        {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&]() { return chunks.size() < GZIP_MAX_QUEUED_CHUNKS || stop; });
+        if(stop)
+          return;
+        if(n_read)
+          chunks.push_back(std::move(chunk));
+        eof = n_read < GZIP_CHUNK_SIZE;
+        }
+      cv.notify_all();
+
+      if(eof)
+        return;
+      }
+    });
+
+  // Inflate on this thread. Output that precedes the range is discarded.
+  z_stream zs;
+  memset(&zs, 0, sizeof(zs));
+  std::vector<unsigned char> chunk;
+  std::vector<char> skip(1 << 16);
+  std::exception_ptr exc;
+  try
+    {
+    if(inflateInit2(&zs, MAX_WBITS + 16) != Z_OK)
+      throw IRISException("Error: failed to initialize zlib");
+
+    size_t pos_out = 0, end = offset + n;
+    while(pos_out < end)
+      {
+      if(zs.avail_in == 0)
+        {
+          {
+          std::unique_lock<std::mutex> lock(mutex);
+          cv.wait(lock, [&]() { return !chunks.empty() || eof; });
+          if(chunks.empty())
+            throw IRISException("Error: unexpected end of gzip file %s.", m_FileName.c_str());
+          chunk = std::move(chunks.front());
+          chunks.pop_front();
+          }
+        cv.notify_all();
+        zs.next_in = chunk.data();
+        zs.avail_in = (uInt) chunk.size();
+        }
+
+      char *out;
+      size_t avail;
+      if(pos_out < offset)
+        {
+        out = skip.data();
+        avail = std::min(skip.size(), offset - pos_out);
+        }
+      else
+        {
+        out = buffer + (pos_out - offset);
+        avail = end - pos_out;
+        }
+
+      zs.next_out = (Bytef *) out;
+      zs.avail_out = (uInt) std::min(avail, (size_t) 1 << 30);
+      uInt avail_before = zs.avail_out;
+      int rc = inflate(&zs, Z_NO_FLUSH);
+      pos_out += avail_before - zs.avail_out;
+
+      // Another gzip member may follow the end of the stream
+      if(rc == Z_STREAM_END)
+        {
+        if(inflateReset(&zs) != Z_OK)
+          throw IRISException("Error: failed to reset zlib");
+        }
+      else if(rc != Z_OK && rc != Z_BUF_ERROR)
+        {
+        throw IRISException("Error: corrupt data in gzip file %s.", m_FileName.c_str());
+        }
+      }
+    }
+  catch(...)
+    {
+    exc = std::current_exception();
+    }
+
+  inflateEnd(&zs);
+
+    {
+    std::lock_guard<std::mutex> lock(mutex);
+    stop = true;
+    }
+  cv.notify_all();
+  reader.join();
+
+  if(exc)
+    std::rethrow_exception(exc);
+}
+
+namespace
+{
+
+// Amount of data in each BGZF block written, small enough for the compressed
+// block to fit in 64K even when the data does not compress
+const size_t BGZF_BLOCK_DATA_SIZE = 0xff00;
+const size_t BGZF_MAX_BLOCK_SIZE = 0x10000;
+
+// The empty block that marks the end of a BGZF file
+const unsigned char BGZF_EOF_BLOCK[28] = {
+  0x1f, 0x8b, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0x06, 0x00,
+  0x42, 0x43, 0x02, 0x00, 0x1b, 0x00, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00 };
+
+void WriteLE32(unsigned char *p, unsigned int v)
+{
+  for(int k = 0; k < 4; k++)
+    p[k] = (unsigned char) (v >> (8 * k));
+}
+
+// Compress a block of data into a BGZF member
+void DeflateBlock(const char *data, size_t n, int level, std::vector<unsigned char> &out)
+{
+  out.resize(BGZF_MAX_BLOCK_SIZE);
+  const size_t hdr_len = 18;
+  unsigned char hdr[hdr_len] = {
+    0x1f, 0x8b, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0x06, 0x00,
+    0x42, 0x43, 0x02, 0x00, 0x00, 0x00 };
+
+  // Fall back to storing the data if it does not compress into the block
+  size_t n_comp = 0;
+  for(int lev : { level, 0 })
+    {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if(deflateInit2(&zs, lev, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+      throw IRISException("Error: failed to initialize zlib");
+
+    zs.next_in = (Bytef *) data;
+    zs.avail_in = (uInt) n;
+    zs.next_out = out.data() + hdr_len;
+    zs.avail_out = (uInt) (BGZF_MAX_BLOCK_SIZE - hdr_len - 8);
+    int rc = deflate(&zs, Z_FINISH);
+    n_comp = zs.total_out;
+    deflateEnd(&zs);
+
+    if(rc == Z_STREAM_END)
+      break;
+    else if(lev == 0)
+      throw IRISException("Error: failed to compress block");
+    }
+
+  size_t size = hdr_len + n_comp + 8;
+  hdr[16] = (unsigned char) ((size - 1) & 0xff);
+  hdr[17] = (unsigned char) ((size - 1) >> 8);
+  memcpy(out.data(), hdr, hdr_len);
+  WriteLE32(out.data() + hdr_len + n_comp, crc32(0L, (const Bytef *) data, (uInt) n));
+  WriteLE32(out.data() + hdr_len + n_comp + 4, (unsigned int) n);
+  out.resize(size);
+}
+
+}
+
+ParallelGzipWriter
+::ParallelGzipWriter()
+{
+  m_File = NULL;
+  m_NumberOfThreads = 0;
+  m_CompressionLevel = Z_DEFAULT_COMPRESSION;
+}
+
+ParallelGzipWriter
+::~ParallelGzipWriter()
+{
+  // Errors can not be reported here, Close() should be called explicitly
+  if(m_File)
+    fclose(m_File);
+}
+
+void
+ParallelGzipWriter
+::Open(const char *filename)
+{
+  if(m_File)
+    fclose(m_File);
+
+  m_Batch.clear();
+  m_FileName = filename;
+  m_File = fopen(filename, "wb");
+  if(!m_File)
+    throw IRISException("Error: can not create file %s.", filename);
+}
+
+void
+ParallelGzipWriter
+::Write(const void *data, size_t n)
+{
+  const char *p = (const char *) data;
+  while(n > 0)
+    {
+    size_t k = std::min(n, GZIP_BATCH_SIZE - m_Batch.size());
+    m_Batch.insert(m_Batch.end(), p, p + k);
+    p += k;
+    n -= k;
+    if(m_Batch.size() == GZIP_BATCH_SIZE)
+      this->FlushBatch();
+    }
+}
+
+void
+ParallelGzipWriter
+::FlushBatch()
+{
+  if(!m_File)
+    throw IRISException("Error: no gzip file is open.");
+
+  size_t n_blocks = (m_Batch.size() + BGZF_BLOCK_DATA_SIZE - 1) / BGZF_BLOCK_DATA_SIZE;
+  if(n_blocks == 0)
+    return;
+
+  unsigned int n_threads = m_NumberOfThreads
+      ? m_NumberOfThreads : itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads();
+  n_threads = std::max(1u, std::min(n_threads, (unsigned int) n_blocks));
+
+  // Threads take blocks in turn and compress them into separate buffers
+  std::vector<std::vector<unsigned char> > blocks(n_blocks);
+  std::atomic<size_t> next_block(0);
+  std::mutex mutex;
+  std::exception_ptr worker_exc;
+  std::vector<std::thread> workers;
+  for(unsigned int t = 0; t < n_threads; t++)
+    {
+    workers.emplace_back([&]()
+      {
+      try
+        {
+        for(size_t b = next_block++; b < n_blocks; b = next_block++)
+          {
+          size_t start = b * BGZF_BLOCK_DATA_SIZE;
+          size_t n = std::min(BGZF_BLOCK_DATA_SIZE, m_Batch.size() - start);
+          DeflateBlock(m_Batch.data() + start, n, m_CompressionLevel, blocks[b]);
+          }
+        }
+      catch(...)
+        {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(!worker_exc)
+          worker_exc = std::current_exception();
+        next_block = n_blocks;
+        }
+      });
+    }
+
+  for(auto &w : workers)
+    w.join();
+
+  if(worker_exc)
+    std::rethrow_exception(worker_exc);
+
+  for(auto &block : blocks)
+    if(fwrite(block.data(), 1, block.size(), m_File) != block.size())
+      throw IRISException("Error: failed to write to file %s.", m_FileName.c_str());
+
+  m_Batch.clear();
+}
+
+void
+ParallelGzipWriter
+::Close()
+{
+  if(!m_File)
+    return;
+
+  this->FlushBatch();
+
+  bool ok = fwrite(BGZF_EOF_BLOCK, 1, sizeof(BGZF_EOF_BLOCK), m_File) == sizeof(BGZF_EOF_BLOCK);
+  ok = (fclose(m_File) == 0) && ok;
+  m_File = NULL;
+
+  if(!ok)
+    throw IRISException("Error: failed to write to file %s.", m_FileName.c_str());
+}
+
+void
+ParallelGzipWriter
+::CompressFile(const char *source, const char *target, unsigned int n_threads)
+{
+  FILE *f = fopen(source, "rb");
+  if(!f)
+    throw IRISException("Error: can not open file %s.", source);
+
+  try
+    {
+    ParallelGzipWriter writer;
+    writer.SetNumberOfThreads(n_threads);
+    writer.Open(target);
+
+    std::vector<char> buffer(GZIP_BATCH_SIZE);
+    size_t n_read;
+    while((n_read = fread(buffer.data(), 1, buffer.size(), f)) > 0)
+      writer.Write(buffer.data(), n_read);
+
+    if(ferror(f))
+      throw IRISException("Error: failed to read file %s.", source);
+
+    writer.Close();
+    }
+  catch(...)
+    {
+    fclose(f);
+    throw;
+    }
+
+  fclose(f);
+}
@@ -0,0 +1,111 @@
+#ifndef PARALLELGZIPIO_H
+#define PARALLELGZIPIO_H
+
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/**
+ * \class ParallelGzipReader
+ * \brief Reads a range of the uncompressed contents of a gzip file using
+ * several threads.
+ *
+ * Files made of BGZF blocks (blocked gzip, where every gzip member records
+ * its compressed size in a 'BC' extra field) are read in batches: the calling
+ * thread reads the compressed data and locates the blocks, while a pool of
+ * threads inflates the blocks of earlier batches directly into the output
+ * buffer. Blocks that precede the requested range are not inflated at all.
+ *
+ * Other gzip files, including files with several members, can only be
+ * inflated sequentially. In that case the compressed data is read ahead on
+ * a separate thread, so that disk access overlaps with the inflation.
+ *
+ * Errors, including corrupt or truncated data, are reported by throwing an
+ * IRISException.
+ */
+class ParallelGzipReader
+{
+public:
+  ParallelGzipReader();
+  ~ParallelGzipReader();
+
+  /** Open a file, returns false if it can not be opened or is not gzipped */
+  bool Open(const char *filename);
+
+  /** Close the file */
+  void Close();
+
+  /** Whether the file consists of BGZF blocks */
+  bool IsBlocked() const { return m_Blocked; }
+
+  /** Number of threads used to inflate blocked files, zero for the default */
+  void SetNumberOfThreads(unsigned int n) { m_NumberOfThreads = n; }
+  unsigned int GetNumberOfThreads() const { return m_NumberOfThreads; }
+
+  /** Read n bytes starting at the given offset in the uncompressed data */
+  void Read(size_t offset, size_t n, void *buffer);
+
+protected:
+
+  void ReadBlocked(size_t offset, size_t n, char *buffer);
+  void ReadSequential(size_t offset, size_t n, char *buffer);
+
+  std::string m_FileName;
+  FILE *m_File;
+  bool m_Blocked;
+  unsigned int m_NumberOfThreads;
+};
+
+/**
+ * \class ParallelGzipWriter
+ * \brief Writes a gzip file whose blocks are compressed on several threads.
+ *
+ * The data is split into blocks that are compressed independently and
+ * written as BGZF members. The output is a valid multi-member gzip file that
+ * standard gzip tools and zlib read as usual, and that ParallelGzipReader
+ * inflates in parallel. Compression is slightly worse than with a single
+ * gzip stream, because blocks do not share their dictionaries.
+ *
+ * Data passed to Write() is buffered and compressed in batches. Errors are
+ * reported by throwing an IRISException.
+ */
+class ParallelGzipWriter
+{
+public:
+  ParallelGzipWriter();
+  ~ParallelGzipWriter();
+
+  /** Create the file, throws an exception if it can not be created */
+  void Open(const char *filename);
+
+  /** Compress the buffered data and close the file */
+  void Close();
+
+  /** Number of threads used for compression, zero for the default */
+  void SetNumberOfThreads(unsigned int n) { m_NumberOfThreads = n; }
+  unsigned int GetNumberOfThreads() const { return m_NumberOfThreads; }
+
+  /** Compression level, between 1 and 9 */
+  void SetCompressionLevel(int level) { m_CompressionLevel = level; }
+  int GetCompressionLevel() const { return m_CompressionLevel; }
+
+  /** Append data to the file */
+  void Write(const void *data, size_t n);
+
+  /** Compress the contents of one file into another */
+  static void CompressFile(const char *source, const char *target,
+                           unsigned int n_threads = 0);
+
+protected:
+
+  void FlushBatch();
+
+  std::string m_FileName;
+  FILE *m_File;
+  std::vector<char> m_Batch;
+  unsigned int m_NumberOfThreads;
+  int m_CompressionLevel;
+};
+
+#endif // PARALLELGZIPIO_H
@@ -351,7 +351,6 @@ ScalarImageWrapper<TTraits>
 {
   SmartPtr<GuidedNativeImageIO> io = GuidedNativeImageIO::New();
   io->CreateImageIO(fname, hints, false);
-  itk::ImageIOBase *base = io->GetIOBase();
 
   // Create a pipeline that casts the image to floating type
   auto *float_img = this->CreateCastToFloatPipeline("WriteToFileAsFloat");
@@ -359,11 +358,8 @@ ScalarImageWrapper<TTraits>
   typedef typename ImageWrapperBase::FloatImageType FloatImageType;
   typedef itk::ImageFileWriter<FloatImageType> WriterType;
   SmartPtr<WriterType> writer = WriterType::New();
-  writer->SetFileName(fname);
-  if(base)
-    writer->SetImageIO(base);
   writer->SetInput(float_img);
-  writer->Update();
+  io->UpdateWriter(writer.GetPointer(), fname);
 
   // Release the pipeline (what a pain)
   this->ReleaseInternalPipeline("WriteToFileAsFloat");
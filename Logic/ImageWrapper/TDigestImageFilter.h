@@ -120,6 +120,15 @@ public:
    */
   void SetLog2SamplingRate(int log_2_sampling_rate);
 
+  /**
+   * When the input image is memory mapped, tell the system after each
+   * streamed region is digested that its pages are no longer needed. Combined
+   * with a number of stream divisions, this keeps a single pass over a large
+   * 4D image from filling memory with every time point. Off by default.
+   */
+  itkSetMacro(ReleaseDigestedData, bool)
+  itkGetConstMacro(ReleaseDigestedData, bool)
+
   /**
    * Get the t-digest output, wrapped as an itk::DataObject. Before using this object
    * call Update() on it.
@@ -160,6 +169,9 @@ private:
   // Sampling rate
   int m_Log2SamplingRate;
 
+  // Release mapped pages after each streamed region
+  bool m_ReleaseDigestedData;
+
   // Mutex for combining digests
   std::mutex m_Mutex;
 
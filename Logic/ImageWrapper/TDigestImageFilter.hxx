@@ -4,6 +4,7 @@
 #include <type_traits>
 #include <cmath>
 #include "TDigestImageFilter.h"
+#include "MemoryMappedFile.h"
 #include <itkImageRegionConstIterator.h>
 #include <itkVectorImage.h>
 #include <random>
@@ -54,6 +55,28 @@ constexpr void skip_value(const TValue &value, TValue &skip_min, TValue &skip_ma
     }
 };
 
+// Release the pages of a range of a memory mapped pixel container
+template <class TContainer>
+void release_mapped_range(const TContainer *container, size_t offset, size_t n)
+{
+  typedef typename TContainer::Element Element;
+  typedef MappedImageContainer<typename TContainer::ElementIdentifier, Element> MappedContainer;
+  auto *mapped = dynamic_cast<const MappedContainer *>(container);
+  if(mapped && mapped->GetMappedFile())
+    mapped->GetMappedFile()->Release(offset * sizeof(Element), n * sizeof(Element));
+}
+
+// Whether a region of an image occupies a contiguous range of the buffer
+template <class TImage>
+bool is_contiguous_region(const TImage *image, const typename TImage::RegionType &region)
+{
+  const auto &buffered = image->GetBufferedRegion();
+  for(unsigned int d = 0; d + 1 < TImage::ImageDimension; d++)
+    if(region.GetIndex(d) != buffered.GetIndex(d) || region.GetSize(d) != buffered.GetSize(d))
+      return false;
+  return true;
+}
+
 template <class TImage, class TDigest>
 class Helper
 {
@@ -69,6 +92,16 @@ public:
       buffer[n_read] = it.Get();
     }
 
+  static void release_region(const TImage *image, const RegionType &region)
+    {
+    // Only plain images can be memory mapped
+    if constexpr (std::is_base_of<itk::Image<PixelType, Dim>, TImage>::value)
+      if(is_contiguous_region(image, region))
+        release_mapped_range(image->GetPixelContainer(),
+                             image->ComputeOffset(region.GetIndex()),
+                             region.GetNumberOfPixels());
+    }
+
   /*
   static void fill_digest(
       const TImage *image, const typename TImage::RegionType &region,
@@ -121,6 +154,15 @@ public:
       }
     }
 
+  static void release_region(const TImage *image, const RegionType &region)
+    {
+    size_t ncomp = image->GetNumberOfComponentsPerPixel();
+    if(is_contiguous_region(image, region))
+      release_mapped_range(image->GetPixelContainer(),
+                           image->ComputeOffset(region.GetIndex()) * ncomp,
+                           region.GetNumberOfPixels() * ncomp);
+    }
+
   /*
   static void fill_digest(
       const TImage *image, const typename TImage::RegionType &region,
@@ -167,6 +209,7 @@ TDigestImageFilter<TInputImage>
   m_TransformScale = 1.0;
   m_TransformShift = 0.0;
   m_Log2SamplingRate = 0;
+  m_ReleaseDigestedData = false;
 }
 
 template <class TInputImage>
@@ -211,6 +254,11 @@ TDigestImageFilter<TInputImage>
   auto t_start = std::chrono::steady_clock::now();
   Superclass::StreamedGenerateData(inputRequestedRegionNumber);
   auto t_stop = std::chrono::steady_clock::now();
+
+  // The data of this region will not be needed again by the filter
+  if(m_ReleaseDigestedData)
+    Helper<TInputImage, typename TDigestDataObject::TDigest>::release_region(
+          this->GetInput(), this->GetInput()->GetRequestedRegion());
   auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(t_stop - t_start);
 
   auto n_pixels = this->GetInput()->GetBufferedRegion().GetNumberOfPixels();
@@ -548,18 +548,14 @@ VectorImageWrapper<TTraits>
 {
   SmartPtr<GuidedNativeImageIO> io = GuidedNativeImageIO::New();
   io->CreateImageIO(fname, hints, false);
-  itk::ImageIOBase *base = io->GetIOBase();
 
   // Create a pipeline that casts the image to floating type
   auto *float_img = this->CreateCastToFloatVectorPipeline("WriteToFileAsFloat");
 
   typedef itk::ImageFileWriter<typename ImageWrapperBase::FloatVectorImageType> WriterType;
   SmartPtr<WriterType> writer = WriterType::New();
-  writer->SetFileName(fname);
-  if(base)
-    writer->SetImageIO(base);
   writer->SetInput(float_img);
-  writer->Update();
+  io->UpdateWriter(writer.GetPointer(), fname);
 
   // Release the pipeline (what a pain)
   this->ReleaseInternalPipeline("WriteToFileAsFloat");
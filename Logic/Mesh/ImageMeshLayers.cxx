@@ -176,6 +176,44 @@ ImageMeshLayers
   return 0;
 }
 
+bool
+ImageMeshLayers
+::PrecomputeActiveMeshLayer(itk::Command *progressCmd)
+{
+  // Level set meshes are only computed for the current time point
+  if (m_IsSNAP)
+    return false;
+
+  auto app = m_ImageData->GetParent();
+  auto segImg = app->GetSelectedSegmentationLayer();
+  if (!segImg || segImg->GetNumberOfTimePoints() < 2
+      || !HasMeshForImage(segImg->GetUniqueId()))
+    return false;
+
+  auto segMesh = static_cast<SegmentationMeshWrapper*>
+      (m_ImageToMeshMap[segImg->GetUniqueId()]);
+
+  return segMesh->PrecomputeMeshes(progressCmd, app->GetCursorTimePoint());
+}
+
+void
+ImageMeshLayers
+::TrimActiveMeshLayerCache()
+{
+  if (m_IsSNAP)
+    return;
+
+  auto app = m_ImageData->GetParent();
+  auto segImg = app->GetSelectedSegmentationLayer();
+  if (!segImg || !HasMeshForImage(segImg->GetUniqueId()))
+    return;
+
+  auto segMesh = static_cast<SegmentationMeshWrapper*>
+      (m_ImageToMeshMap[segImg->GetUniqueId()]);
+
+  segMesh->TrimMeshCache(app->GetCursorTimePoint());
+}
+
 void
 ImageMeshLayers
 ::AddLayerFromFiles(std::vector<std::string> &fn_list, FileFormat format,
@@ -90,6 +90,19 @@ public:
    */
   int UpdateActiveMeshLayer(itk::Command *progressCmd);
 
+  /** Compute the meshes of the active segmentation layer for the time points
+   *  following the current one, see SegmentationMeshWrapper::PrecomputeMeshes.
+   *  Does nothing for 3D images and level set meshes. Returns true if any
+   *  meshes were computed.
+   */
+  bool PrecomputeActiveMeshLayer(itk::Command *progressCmd);
+
+  /** Drop cached meshes of the active segmentation layer that exceed its
+   *  memory limit, see SegmentationMeshWrapper::TrimMeshCache. Call from the
+   *  GUI thread.
+   */
+  void TrimActiveMeshLayerCache();
+
   /** Return the active layer Modified Time */
   unsigned long GetActiveMeshMTime();
 
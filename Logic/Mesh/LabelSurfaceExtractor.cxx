@@ -0,0 +1,385 @@
+#include "LabelSurfaceExtractor.h"
+
+#include "vtkPolyData.h"
+#include "vtkPoints.h"
+#include "vtkCellArray.h"
+#include "itk_zlib.h"
+#include <algorithm>
+
+namespace
+{
+
+typedef LabelSurfaceExtractor::ImageType ImageType;
+typedef ImageType::RLLine RLLine;
+typedef LabelSurfaceExtractor::CornerId CornerId;
+
+// State of the sweep through the image
+class SurfaceSweep
+{
+public:
+  SurfaceSweep(const LabelSurfaceExtractor *extractor, const ImageType *image,
+               const long *size, unsigned int brick_size, const unsigned int *brick_count,
+               const LabelSurfaceExtractor::BrickMask *mask)
+    : m_Extractor(extractor), m_Mask(mask), m_Targets(MAX_COLOR_LABELS + 1, NULL)
+  {
+    for(int d = 0; d < 3; d++)
+      m_Size[d] = size[d];
+    m_BrickSize = brick_size;
+    m_Lines = image->GetBuffer()->GetBufferPointer();
+
+    // Rows of bricks along x that contain a masked brick
+    if(mask)
+      {
+      for(int d = 0; d < 3; d++)
+        m_BrickCount[d] = brick_count[d];
+      m_RowActive.assign(brick_count[1] * brick_count[2], false);
+      for(unsigned int b = 0; b < mask->size(); b++)
+        if((*mask)[b])
+          m_RowActive[b / brick_count[0]] = true;
+      }
+  }
+
+  void AddLabel(LabelType label, LabelSurfaceExtractor::BrickFaceMap *target)
+  {
+    m_Targets[label] = target;
+  }
+
+  void Run()
+  {
+    long nx = m_Size[0], ny = m_Size[1], nz = m_Size[2];
+    for(long z = 0; z < nz; z++)
+      {
+      for(long y = 0; y < ny; y++)
+        {
+        // Skip lines that cannot contribute faces to the masked bricks
+        if(m_Mask && !IsLineActive(y, z))
+          continue;
+
+        const RLLine *line = m_Lines + (y + ny * z);
+
+        // Faces between the runs of the line, and at its ends
+        long t = 0;
+        LabelType prev = 0;
+        for(size_t s = 0; s < line->size(); s++)
+          {
+          AddFace(0, t - 1, y, z, prev, (*line)[s].second);
+          prev = (*line)[s].second;
+          t += (*line)[s].first;
+          }
+        AddFace(0, nx - 1, y, z, prev, 0);
+
+        // Faces shared with the next line in y and in z. The faces on the
+        // lower boundary of the image are added with the first line
+        if(y == 0)
+          CompareLines(1, NULL, line, -1, z);
+        CompareLines(1, line, y + 1 < ny ? line + 1 : NULL, y, z);
+
+        if(z == 0)
+          CompareLines(2, NULL, line, y, -1);
+        CompareLines(2, line, z + 1 < nz ? line + ny : NULL, y, z);
+        }
+      }
+  }
+
+protected:
+
+  // Whether any face added for line (y,z) may fall in a masked brick. The
+  // first corners of these faces have coordinates y or y+1 and z or z+1.
+  bool IsLineActive(long y, long z) const
+  {
+    for(long cz = z; cz <= z + 1; cz++)
+      for(long cy = y; cy <= y + 1; cy++)
+        {
+        unsigned int by = std::min((unsigned int) (cy / m_BrickSize), m_BrickCount[1] - 1);
+        unsigned int bz = std::min((unsigned int) (cz / m_BrickSize), m_BrickCount[2] - 1);
+        if(m_RowActive[by + m_BrickCount[1] * bz])
+          return true;
+        }
+    return false;
+  }
+
+  CornerId MakeCorner(long x, long y, long z) const
+  {
+    return ((CornerId) z * (m_Size[1] + 1) + y) * (m_Size[0] + 1) + x;
+  }
+
+  // Add the face between voxel (x,y,z) and its neighbor in direction d. The
+  // face is oriented towards the neighbor for label a and away from it for b
+  void AddFace(int d, long x, long y, long z, LabelType a, LabelType b)
+  {
+    if(a == b)
+      return;
+
+    LabelSurfaceExtractor::BrickFaceMap *ta = m_Targets[a], *tb = m_Targets[b];
+    if(!ta && !tb)
+      return;
+
+    // Corners of the face, so that (c1 - c0) x (c2 - c0) points along +d
+    int u = (d + 1) % 3, v = (d + 2) % 3;
+    long c[4][3];
+    for(int k = 0; k < 4; k++)
+      {
+      c[k][0] = x; c[k][1] = y; c[k][2] = z;
+      c[k][d]++;
+      }
+    c[1][u]++;
+    c[2][u]++; c[2][v]++;
+    c[3][v]++;
+
+    CornerId id[4];
+    for(int k = 0; k < 4; k++)
+      id[k] = MakeCorner(c[k][0], c[k][1], c[k][2]);
+
+    // The face belongs to the brick of its first corner
+    unsigned int brick = m_Extractor->GetCornerBrick(id[0]);
+    if(m_Mask && !(*m_Mask)[brick])
+      return;
+
+    if(ta)
+      {
+      LabelSurfaceExtractor::Face f = {{ id[0], id[1], id[2], id[3] }};
+      (*ta)[brick].push_back(f);
+      }
+    if(tb)
+      {
+      LabelSurfaceExtractor::Face f = {{ id[0], id[3], id[2], id[1] }};
+      (*tb)[brick].push_back(f);
+      }
+  }
+
+  // Add the faces between two lines that are adjacent in direction d. The
+  // (y,z) position is that of line a. A NULL line is outside of the image.
+  void CompareLines(int d, const RLLine *a, const RLLine *b, long y, long z)
+  {
+    long nx = m_Size[0];
+    size_t ia = 0, ib = 0;
+    long ea = a ? (*a)[0].first : nx, eb = b ? (*b)[0].first : nx;
+    LabelType la = a ? (*a)[0].second : 0, lb = b ? (*b)[0].second : 0;
+    for(long x = 0; x < nx; )
+      {
+      // The interval [x, e) has constant labels in both lines
+      long e = std::min(ea, eb);
+      if(la != lb && (m_Targets[la] || m_Targets[lb]))
+        for(long i = x; i < e; i++)
+          AddFace(d, i, y, z, la, lb);
+      x = e;
+
+      if(a && x == ea && ++ia < a->size())
+        {
+        ea += (*a)[ia].first;
+        la = (*a)[ia].second;
+        }
+      if(b && x == eb && ++ib < b->size())
+        {
+        eb += (*b)[ib].first;
+        lb = (*b)[ib].second;
+        }
+      }
+  }
+
+  const LabelSurfaceExtractor *m_Extractor;
+  const LabelSurfaceExtractor::BrickMask *m_Mask;
+  std::vector<LabelSurfaceExtractor::BrickFaceMap *> m_Targets;
+  std::vector<bool> m_RowActive;
+  long m_Size[3];
+  unsigned int m_BrickSize, m_BrickCount[3];
+  const RLLine *m_Lines;
+};
+
+// Builds a polydata from faces, with one point per corner
+class SurfaceBuilder
+{
+public:
+  SurfaceBuilder(const LabelSurfaceExtractor *extractor,
+                 const LabelSurfaceExtractor::CornerPositionMap *positions,
+                 std::vector<CornerId> &point_corners)
+    : m_Extractor(extractor), m_Positions(positions), m_PointCorners(point_corners)
+  {
+    m_Points = vtkSmartPointer<vtkPoints>::New();
+    m_Triangles = vtkSmartPointer<vtkCellArray>::New();
+    m_PointCorners.clear();
+  }
+
+  void AddFaces(const LabelSurfaceExtractor::FaceList &faces)
+  {
+    for(const LabelSurfaceExtractor::Face &f : faces)
+      {
+      vtkIdType p[4];
+      for(int k = 0; k < 4; k++)
+        {
+        auto res = m_PointIds.emplace(f.Corners[k], 0);
+        if(res.second)
+          {
+          Vector3f x = m_Extractor->GetCornerPosition(f.Corners[k]);
+          if(m_Positions)
+            {
+            auto pos = m_Positions->find(f.Corners[k]);
+            if(pos != m_Positions->end())
+              x = pos->second;
+            }
+          res.first->second = m_Points->InsertNextPoint(x[0], x[1], x[2]);
+          m_PointCorners.push_back(f.Corners[k]);
+          }
+        p[k] = res.first->second;
+        }
+
+      vtkIdType t1[3] = { p[0], p[1], p[2] }, t2[3] = { p[0], p[2], p[3] };
+      m_Triangles->InsertNextCell(3, t1);
+      m_Triangles->InsertNextCell(3, t2);
+      }
+  }
+
+  vtkSmartPointer<vtkPolyData> GetSurface()
+  {
+    vtkSmartPointer<vtkPolyData> pd = vtkSmartPointer<vtkPolyData>::New();
+    pd->SetPoints(m_Points);
+    pd->SetPolys(m_Triangles);
+    return pd;
+  }
+
+protected:
+  const LabelSurfaceExtractor *m_Extractor;
+  const LabelSurfaceExtractor::CornerPositionMap *m_Positions;
+  std::vector<CornerId> &m_PointCorners;
+  std::unordered_map<CornerId, vtkIdType> m_PointIds;
+  vtkSmartPointer<vtkPoints> m_Points;
+  vtkSmartPointer<vtkCellArray> m_Triangles;
+};
+
+}
+
+LabelSurfaceExtractor
+::LabelSurfaceExtractor(const ImageType *image, unsigned int brick_size)
+{
+  m_Image = image;
+  m_BrickSize = brick_size;
+
+  ImageType::RegionType region = image->GetBufferedRegion();
+  m_Start = region.GetIndex();
+  for(int d = 0; d < 3; d++)
+    {
+    m_Size[d] = region.GetSize(d);
+    m_BrickCount[d] = std::max(1u, (unsigned int) ((m_Size[d] + brick_size - 1) / brick_size));
+    }
+}
+
+unsigned int
+LabelSurfaceExtractor
+::GetCornerBrick(CornerId c) const
+{
+  // Corner coordinates range from 0 to the size of the image, the corners
+  // on the upper boundary belong to the last brick
+  unsigned int b[3];
+  for(int d = 0; d < 3; d++)
+    {
+    CornerId n = m_Size[d] + 1;
+    b[d] = std::min((unsigned int) ((c % n) / m_BrickSize), m_BrickCount[d] - 1);
+    c /= n;
+    }
+  return b[0] + m_BrickCount[0] * (b[1] + m_BrickCount[1] * b[2]);
+}
+
+Vector3f
+LabelSurfaceExtractor
+::GetCornerPosition(CornerId c) const
+{
+  // Voxel corners are half a voxel away from the voxel centers
+  Vector3f x;
+  for(int d = 0; d < 3; d++)
+    {
+    CornerId n = m_Size[d] + 1;
+    x[d] = m_Start[d] + (float) (c % n) - 0.5f;
+    c /= n;
+    }
+  return x;
+}
+
+void
+LabelSurfaceExtractor
+::ComputeBrickCheckSums(std::vector<unsigned long> &sums) const
+{
+  sums.assign(this->GetNumberOfBricks(), adler32(0L, NULL, 0));
+
+  const RLLine *lines = m_Image->GetBuffer()->GetBufferPointer();
+  long ny = m_Size[1], nz = m_Size[2];
+  for(long z = 0; z < nz; z++)
+    {
+    for(long y = 0; y < ny; y++)
+      {
+      const RLLine &line = lines[y + ny * z];
+      unsigned int brow = m_BrickCount[0] *
+          (y / m_BrickSize + m_BrickCount[1] * (z / m_BrickSize));
+
+      // Add each run to the bricks that it crosses
+      long t = 0;
+      for(size_t s = 0; s < line.size(); s++)
+        {
+        long t_end = t + line[s].first;
+        while(t < t_end)
+          {
+          long bx = t / m_BrickSize;
+          long piece_end = std::min(t_end, (bx + 1) * (long) m_BrickSize);
+          long data[5] = { t, piece_end, y, z, (long) line[s].second };
+          unsigned long &sum = sums[brow + bx];
+          sum = adler32(sum, (unsigned char *) data, sizeof(data));
+          t = piece_end;
+          }
+        }
+      }
+    }
+}
+
+void
+LabelSurfaceExtractor
+::DilateBrickMask(BrickMask &mask) const
+{
+  BrickMask src = mask;
+  int n[3] = { (int) m_BrickCount[0], (int) m_BrickCount[1], (int) m_BrickCount[2] };
+  for(int z = 0; z < n[2]; z++)
+    for(int y = 0; y < n[1]; y++)
+      for(int x = 0; x < n[0]; x++)
+        {
+        if(!src[x + n[0] * (y + n[1] * z)])
+          continue;
+        for(int k = std::max(z - 1, 0); k <= std::min(z + 1, n[2] - 1); k++)
+          for(int j = std::max(y - 1, 0); j <= std::min(y + 1, n[1] - 1); j++)
+            for(int i = std::max(x - 1, 0); i <= std::min(x + 1, n[0] - 1); i++)
+              mask[i + n[0] * (j + n[1] * k)] = true;
+        }
+}
+
+void
+LabelSurfaceExtractor
+::Extract(const std::vector<LabelType> &labels, const BrickMask *mask,
+          SurfaceMap &surfaces) const
+{
+  SurfaceSweep sweep(this, m_Image, m_Size, m_BrickSize, m_BrickCount, mask);
+  for(LabelType label : labels)
+    if(label != 0)
+      sweep.AddLabel(label, &surfaces[label]);
+
+  sweep.Run();
+}
+
+vtkSmartPointer<vtkPolyData>
+LabelSurfaceExtractor
+::MakeSurface(const BrickFaceMap &faces, const BrickMask *mask,
+              const CornerPositionMap *positions,
+              std::vector<CornerId> &point_corners) const
+{
+  SurfaceBuilder builder(this, positions, point_corners);
+  for(auto &it : faces)
+    if(!mask || (*mask)[it.first])
+      builder.AddFaces(it.second);
+  return builder.GetSurface();
+}
+
+vtkSmartPointer<vtkPolyData>
+LabelSurfaceExtractor
+::MakeSurface(const FaceList &faces, const CornerPositionMap *positions,
+              std::vector<CornerId> &point_corners) const
+{
+  SurfaceBuilder builder(this, positions, point_corners);
+  builder.AddFaces(faces);
+  return builder.GetSurface();
+}
@@ -0,0 +1,111 @@
+#ifndef LABELSURFACEEXTRACTOR_H
+#define LABELSURFACEEXTRACTOR_H
+
+#include "SNAPCommon.h"
+#include "ImageWrapperTraits.h"
+#include "vtkSmartPointer.h"
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+class vtkPolyData;
+
+/**
+ * \class LabelSurfaceExtractor
+ * \brief Extracts the boundary surfaces of several labels of a segmentation
+ * in a single pass over its run-length encoded lines.
+ *
+ * The surface of a label consists of the voxel faces that separate the label
+ * from other labels or from the outside of the image. Faces across lines are
+ * found by walking the runs of neighboring lines together, so the image is
+ * never converted to a dense representation and each label costs time
+ * proportional to its surface area.
+ *
+ * The image is divided into cubic bricks, and the faces of each label are
+ * grouped by the brick that contains their first corner. The faces in a
+ * brick only depend on the voxels in that brick and in its lower neighbors,
+ * so after a local edit the faces can be extracted again just for the bricks
+ * whose checksums have changed (dilated by one brick). Faces are stored as
+ * voxel corner ids, which makes it possible to stitch the faces of different
+ * bricks into a single surface with MakeSurface.
+ *
+ * The surfaces are blocky and in voxel index coordinates. They are meant to
+ * be smoothed afterwards, see VTKMeshPipeline::SmoothSurface.
+ */
+class LabelSurfaceExtractor
+{
+public:
+  typedef LabelImageWrapperTraits::ImageType ImageType;
+
+  /** Identifies a voxel corner in the image */
+  typedef unsigned long long CornerId;
+
+  /** A voxel face, with corners ordered counterclockwise seen from outside */
+  struct Face
+  {
+    CornerId Corners[4];
+  };
+
+  /** Faces of a label, grouped by brick */
+  typedef std::vector<Face> FaceList;
+  typedef std::unordered_map<unsigned int, FaceList> BrickFaceMap;
+  typedef std::map<LabelType, BrickFaceMap> SurfaceMap;
+
+  /** Positions assigned to corners, i.e., after smoothing */
+  typedef std::unordered_map<CornerId, Vector3f> CornerPositionMap;
+
+  /** A mask over the bricks */
+  typedef std::vector<bool> BrickMask;
+
+  LabelSurfaceExtractor(const ImageType *image, unsigned int brick_size = 32);
+
+  /** Number of bricks in the image */
+  unsigned int GetNumberOfBricks() const
+    { return m_BrickCount[0] * m_BrickCount[1] * m_BrickCount[2]; }
+
+  /** The brick that contains a corner */
+  unsigned int GetCornerBrick(CornerId c) const;
+
+  /** The position of a corner in voxel coordinates */
+  Vector3f GetCornerPosition(CornerId c) const;
+
+  /** Compute a checksum of the runs in each brick */
+  void ComputeBrickCheckSums(std::vector<unsigned long> &sums) const;
+
+  /** Grow a mask by one brick in every direction */
+  void DilateBrickMask(BrickMask &mask) const;
+
+  /**
+   * Extract the faces of the given labels in the bricks set in the mask, or
+   * in all bricks if the mask is NULL. Label zero is ignored. The faces are
+   * added to the map, which gets an entry for every label.
+   */
+  void Extract(const std::vector<LabelType> &labels, const BrickMask *mask,
+               SurfaceMap &surfaces) const;
+
+  /**
+   * Make a polydata from the faces in the bricks set in the mask, or from
+   * all faces if the mask is NULL. Corners found in the position map are
+   * placed at these positions, the others at their voxel coordinates. The
+   * corner of each point of the polydata is returned in point_corners.
+   */
+  vtkSmartPointer<vtkPolyData> MakeSurface(
+      const BrickFaceMap &faces, const BrickMask *mask,
+      const CornerPositionMap *positions,
+      std::vector<CornerId> &point_corners) const;
+
+  /** Make a polydata from a list of faces, e.g., the faces of one brick */
+  vtkSmartPointer<vtkPolyData> MakeSurface(
+      const FaceList &faces, const CornerPositionMap *positions,
+      std::vector<CornerId> &point_corners) const;
+
+protected:
+
+  const ImageType *m_Image;
+  ImageType::IndexType m_Start;
+  long m_Size[3];
+  unsigned int m_BrickSize;
+  unsigned int m_BrickCount[3];
+};
+
+#endif // LABELSURFACEEXTRACTOR_H
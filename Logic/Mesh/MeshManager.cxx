@@ -189,6 +189,11 @@ MeshManager
 
     // Update the meshes
     pipeline->UpdateMeshes(command);
+
+    // Drop the meshes of other timepoints if they use too much memory
+    MultiLabelMeshPipelineTable *pipelineTable =
+        static_cast<MultiLabelMeshPipelineTable *>(wrapper->GetUserData("MeshPipelineTable"));
+    pipelineTable->TrimToMemoryLimit(timepoint, wrapper->GetNumberOfTimePoints());
     }
 
   // Fire a modified event as well
@@ -74,6 +74,14 @@ MeshOptions
     NewSimpleProperty("MeshSmoothingFeatureEdgeSmoothing", false);
   m_MeshSmoothingBoundarySmoothingModel = 
     NewSimpleProperty("MeshSmoothingBoundarySmoothing", false);
+
+  // Begin discrete surface params
+  m_UseDiscreteSurfaceExtractionModel =
+    NewSimpleProperty("UseDiscreteSurfaceExtraction", false);
+  m_DiscreteSmoothingIterationsModel =
+    NewRangedProperty("DiscreteSmoothingIterations", 15u,0u,200u,1u);
+  m_DiscreteSmoothingPassBandModel =
+    NewRangedProperty("DiscreteSmoothingPassBand", 0.1f,0.001f,2.0f,0.001f);
 }
 
 /*
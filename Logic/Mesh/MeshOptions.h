@@ -69,6 +69,14 @@ public:
   irisSimplePropertyAccessMacro(MeshSmoothingFeatureEdgeSmoothing,bool)
   irisSimplePropertyAccessMacro(MeshSmoothingBoundarySmoothing,bool)
 
+  // Discrete surface extraction properties. When enabled, segmentation meshes
+  // are extracted from the label boundaries in one pass over the image
+  // instead of by thresholding and marching cubes for each label, and the
+  // Gaussian smoothing options are replaced by smoothing of the mesh
+  irisSimplePropertyAccessMacro(UseDiscreteSurfaceExtraction,bool)
+  irisRangedPropertyAccessMacro(DiscreteSmoothingIterations,unsigned int)
+  irisRangedPropertyAccessMacro(DiscreteSmoothingPassBand,float)
+
 protected:
   MeshOptions();
 
@@ -95,6 +103,11 @@ private:
   SmartPtr<ConcreteRangedFloatProperty> m_MeshSmoothingFeatureAngleModel;
   SmartPtr<ConcreteSimpleBooleanProperty> m_MeshSmoothingFeatureEdgeSmoothingModel;
   SmartPtr<ConcreteSimpleBooleanProperty> m_MeshSmoothingBoundarySmoothingModel;
+
+  // Begin discrete surface params
+  SmartPtr<ConcreteSimpleBooleanProperty> m_UseDiscreteSurfaceExtractionModel;
+  SmartPtr<ConcreteRangedUIntProperty> m_DiscreteSmoothingIterationsModel;
+  SmartPtr<ConcreteRangedFloatProperty> m_DiscreteSmoothingPassBandModel;
 };
 
 #endif // __MeshOptions_h_
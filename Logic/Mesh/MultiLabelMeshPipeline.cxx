@@ -48,6 +48,12 @@
 
 // ITK includes
 #include "itkBinaryThresholdImageFilter.h"
+#include "itkMultiThreaderBase.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <thread>
 
 using namespace std;
 
@@ -79,6 +85,37 @@ MultiLabelMeshPipeline
 ::~MultiLabelMeshPipeline()
 {
   delete m_VTKPipeline;
+  for(MeshWorker *w : m_Workers)
+    delete w;
+}
+
+MultiLabelMeshPipeline::MeshWorker
+::MeshWorker(MeshOptions *options)
+{
+  Image = InputImageType::New();
+
+  // The filters run on a single thread, the parallelism is across labels
+  ROI = ROIFilter::New();
+  ROI->SetInput(Image);
+  ROI->ReleaseDataFlagOn();
+  ROI->SetNumberOfWorkUnits(1);
+
+  Threshold = ThresholdFilter::New();
+  Threshold->SetInput(ROI->GetOutput());
+  Threshold->ReleaseDataFlagOn();
+  Threshold->SetInsideValue(1.0f);
+  Threshold->SetOutsideValue(-1.0f);
+  Threshold->SetNumberOfWorkUnits(1);
+
+  VTKPipeline = new VTKMeshPipeline();
+  VTKPipeline->SetImage(Threshold->GetOutput());
+  VTKPipeline->SetMeshOptions(options);
+}
+
+MultiLabelMeshPipeline::MeshWorker
+::~MeshWorker()
+{
+  delete VTKPipeline;
 }
 
 void
@@ -91,11 +128,14 @@ MultiLabelMeshPipeline
     // Save the options
     m_MeshOptions->DeepCopy(options);
 
-    // Apply the options to the internal pipeline
+    // Apply the options to the internal pipelines
     m_VTKPipeline->SetMeshOptions(m_MeshOptions);
+    for(MeshWorker *w : m_Workers)
+      w->VTKPipeline->SetMeshOptions(m_MeshOptions);
 
     // Clear the cached stuff
     m_MeshInfo.clear();
+    ClearSurfaceCache();
     }
 }
 
@@ -201,6 +241,315 @@ void MultiLabelMeshPipeline::UpdateMeshInfoHelper(
   current_meshinfo->Count += run_length;
 }
 
+MultiLabelMeshPipeline::InputImageType::RegionType
+MultiLabelMeshPipeline::GetMeshRegion(const MeshInfo &mi) const
+{
+  // TODO: make this more elegant
+  InputImageType::RegionType bbWiderRegion;
+  for(int d = 0; d < 3; d++)
+    {
+    unsigned long len =
+        (unsigned long) (1 + mi.BoundingBox[1][d] - mi.BoundingBox[0][d]);
+    bbWiderRegion.SetIndex(d, mi.BoundingBox[0][d]);
+    bbWiderRegion.SetSize(d, len);
+    }
+  bbWiderRegion.PadByRadius(5);
+  bbWiderRegion.Crop(m_InputImage->GetLargestPossibleRegion());
+  return bbWiderRegion;
+}
+
+void MultiLabelMeshPipeline::ComputeMeshInRegion(
+    ROIFilter *roi, ThresholdFilter *threshold, VTKMeshPipeline *vtk,
+    const InputImageType *image, LabelType label,
+    const InputImageType::RegionType &region, vtkPolyData *mesh,
+    std::mutex *mutex)
+{
+  // Pass the region to the ROI filter and propagate the filter
+  roi->SetInput(image);
+  roi->SetRegionOfInterest(region);
+  roi->Update();
+
+  // Set the parameters for the thresholding filter
+  threshold->SetLowerThreshold(label);
+  threshold->SetUpperThreshold(label);
+  threshold->UpdateLargestPossibleRegion();
+
+  // Graft the polydata to the last filter in the pipeline
+  vtk->SetImage(threshold->GetOutput());
+  vtk->ComputeMesh(mesh, mutex);
+}
+
+void MultiLabelMeshPipeline::ClearSurfaceCache()
+{
+  m_SurfaceCache.clear();
+  m_BrickCheckSums.clear();
+  m_DirtyBricks.clear();
+  m_PatchBricks.clear();
+}
+
+void MultiLabelMeshPipeline::ExtractSurfaces(
+    const LabelSurfaceExtractor &extractor,
+    const std::vector<std::pair<LabelType, MeshInfo *> > &labels)
+{
+  // Find the bricks that changed since the last update. The faces in a brick
+  // depend on the voxels in the brick below it, so the changed bricks are
+  // grown by one brick to get the bricks whose faces must be extracted again
+  unsigned int n_bricks = extractor.GetNumberOfBricks();
+  std::vector<unsigned long> sums;
+  extractor.ComputeBrickCheckSums(sums);
+
+  bool have_sums = (m_BrickCheckSums.size() == n_bricks);
+  m_DirtyBricks.assign(n_bricks, !have_sums);
+  if(have_sums)
+    for(unsigned int b = 0; b < n_bricks; b++)
+      m_DirtyBricks[b] = (sums[b] != m_BrickCheckSums[b]);
+  m_BrickCheckSums.swap(sums);
+
+  extractor.DilateBrickMask(m_DirtyBricks);
+  m_PatchBricks = m_DirtyBricks;
+  extractor.DilateBrickMask(m_PatchBricks);
+
+  // Labels can be updated incrementally if their surface is cached and the
+  // edit is local. Otherwise it is faster to start from scratch.
+  unsigned int n_dirty = std::count(m_DirtyBricks.begin(), m_DirtyBricks.end(), true);
+  bool local = have_sums && n_dirty * 4 < n_bricks;
+
+  std::vector<LabelType> full, partial;
+  for(auto &it : labels)
+    {
+    auto cit = m_SurfaceCache.find(it.first);
+    if(local && cit != m_SurfaceCache.end())
+      {
+      // Drop the faces that are about to be extracted again
+      for(auto fit = cit->second.Faces.begin(); fit != cit->second.Faces.end(); )
+        {
+        if(m_DirtyBricks[fit->first])
+          fit = cit->second.Faces.erase(fit);
+        else
+          ++fit;
+        }
+      cit->second.Incremental = true;
+      partial.push_back(it.first);
+      }
+    else
+      {
+      m_SurfaceCache[it.first] = SurfaceCache();
+      full.push_back(it.first);
+      }
+    }
+
+  LabelSurfaceExtractor::SurfaceMap surfaces;
+  if(full.size())
+    {
+    extractor.Extract(full, nullptr, surfaces);
+    for(LabelType label : full)
+      m_SurfaceCache[label].Faces.swap(surfaces[label]);
+    }
+
+  if(partial.size())
+    {
+    surfaces.clear();
+    extractor.Extract(partial, &m_DirtyBricks, surfaces);
+    for(LabelType label : partial)
+      for(auto &fit : surfaces[label])
+        m_SurfaceCache[label].Faces[fit.first].swap(fit.second);
+    }
+}
+
+void MultiLabelMeshPipeline::ComputeDiscreteMesh(
+    VTKMeshPipeline *vtk, const LabelSurfaceExtractor *extractor,
+    SurfaceCache &cache, vtkPolyData *mesh)
+{
+  std::vector<LabelSurfaceExtractor::CornerId> corners;
+  vtkSmartPointer<vtkPolyData> smooth = vtkSmartPointer<vtkPolyData>::New();
+  vtkSmartPointer<vtkPolyData> surface;
+
+  if(!cache.Incremental)
+    {
+    // Smooth the whole surface and remember where each corner ended up
+    surface = extractor->MakeSurface(cache.Faces, nullptr, nullptr, corners);
+    vtk->SmoothSurface(surface, smooth);
+
+    cache.Positions.clear();
+    for(vtkIdType i = 0; i < (vtkIdType) corners.size(); i++)
+      {
+      double *x = smooth->GetPoint(i);
+      cache.Positions[corners[i]] = Vector3f(x[0], x[1], x[2]);
+      }
+    cache.Patches.clear();
+    }
+  else
+    {
+    // Smooth a patch that extends one brick past the re-extracted faces, so
+    // that the corners in the dirty bricks see the same neighborhood as they
+    // would when smoothing the whole surface. The boundary of the patch is
+    // held in place. Only the corners in the dirty bricks take their new
+    // positions, the others keep the positions from the previous update.
+    surface = extractor->MakeSurface(cache.Faces, &m_PatchBricks, nullptr, corners);
+    vtk->SmoothSurface(surface, smooth);
+
+    for(vtkIdType i = 0; i < (vtkIdType) corners.size(); i++)
+      {
+      auto pit = cache.Positions.find(corners[i]);
+      if(pit == cache.Positions.end() || m_DirtyBricks[extractor->GetCornerBrick(corners[i])])
+        {
+        double *x = smooth->GetPoint(i);
+        cache.Positions[corners[i]] = Vector3f(x[0], x[1], x[2]);
+        }
+      }
+
+    // Forget the corners that are no longer on the surface
+    LabelSurfaceExtractor::CornerPositionMap used;
+    used.reserve(cache.Positions.size());
+    for(auto &it : cache.Faces)
+      for(const LabelSurfaceExtractor::Face &f : it.second)
+        for(int k = 0; k < 4; k++)
+          used[f.Corners[k]] = cache.Positions[f.Corners[k]];
+    cache.Positions.swap(used);
+    cache.Incremental = false;
+    }
+
+  // Map each brick's faces to RAS, then decimate and smooth them. After a
+  // local edit, only the bricks whose faces have a corner that moved are
+  // processed again. These are the dirty bricks and their lower neighbors,
+  // all of which are among the patch bricks.
+  for(auto pit = cache.Patches.begin(); pit != cache.Patches.end(); )
+    {
+    auto fit = cache.Faces.find(pit->first);
+    if(fit == cache.Faces.end() || fit->second.empty() || m_PatchBricks[pit->first])
+      pit = cache.Patches.erase(pit);
+    else
+      ++pit;
+    }
+
+  std::vector<vtkPolyData *> patches;
+  for(auto &it : cache.Faces)
+    {
+    if(it.second.empty())
+      continue;
+
+    vtkSmartPointer<vtkPolyData> &patch = cache.Patches[it.first];
+    if(!patch)
+      {
+      surface = extractor->MakeSurface(it.second, &cache.Positions, corners);
+      patch = vtkSmartPointer<vtkPolyData>::New();
+      vtk->ComputeMeshPatch(surface, m_InputImage, patch);
+      }
+    patches.push_back(patch);
+    }
+
+  // Join the patches and compute the normals of the whole surface
+  vtk->ComputeMeshFromPatches(patches, m_InputImage, mesh);
+}
+
+void MultiLabelMeshPipeline::ComputeMeshesInParallel(
+    const std::vector<std::pair<LabelType, MeshInfo *> > &labels,
+    unsigned int n_threads, AllPurposeProgressAccumulator *progress,
+    const LabelSurfaceExtractor *extractor)
+{
+  // Create the workers that are missing
+  while(m_Workers.size() < n_threads)
+    m_Workers.push_back(new MeshWorker(m_MeshOptions));
+
+  // Point each worker to the current input. The views share the pixel
+  // container of the input, but have their own regions, so that requests
+  // made by the ROI filters do not race with each other
+  InputImageType *input = const_cast<InputImageType *>(m_InputImage.GetPointer());
+  for(unsigned int i = 0; i < n_threads; i++)
+    {
+    InputImageType *view = m_Workers[i]->Image;
+    view->CopyInformation(input);
+    view->SetBufferedRegion(input->GetBufferedRegion());
+    view->SetRequestedRegion(input->GetBufferedRegion());
+    view->SetPixelContainer(input->GetPixelContainer());
+    view->Modified();
+    }
+
+  // Progress is reported from this thread as labels are completed, since
+  // progress observers are generally not thread-safe
+  SmartPtr<TrivalProgressSource> tracker = TrivalProgressSource::New();
+  progress->RegisterSource(tracker, 1.0);
+  double total_count = 0.0;
+  for(auto &it : labels)
+    total_count += it.second->Count;
+  tracker->StartProgress(total_count);
+
+  // State shared between the workers
+  std::mutex mutex;
+  std::condition_variable cv;
+  size_t next = 0, n_done = 0;
+  double done_count = 0.0;
+  std::exception_ptr error;
+
+  auto work = [&](MeshWorker *w)
+    {
+    while(true)
+      {
+      size_t k;
+        {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(next == labels.size() || error)
+          return;
+        k = next++;
+        }
+
+      LabelType label = labels[k].first;
+      MeshInfo *mi = labels[k].second;
+      try
+        {
+        if(extractor)
+          ComputeDiscreteMesh(w->VTKPipeline, extractor, m_SurfaceCache.at(label), mi->Mesh);
+        else
+          ComputeMeshInRegion(w->ROI, w->Threshold, w->VTKPipeline,
+                              w->Image, label, GetMeshRegion(*mi), mi->Mesh, &m_VTKMutex);
+        }
+      catch(...)
+        {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(!error)
+          error = std::current_exception();
+        }
+
+        {
+        std::lock_guard<std::mutex> lock(mutex);
+        done_count += mi->Count;
+        n_done++;
+        }
+      cv.notify_one();
+      }
+    };
+
+  std::vector<std::thread> threads;
+  for(unsigned int i = 0; i < n_threads; i++)
+    threads.push_back(std::thread(work, m_Workers[i]));
+
+  // Wait for the labels to complete, passing on progress
+  double reported = 0.0;
+  std::unique_lock<std::mutex> lock(mutex);
+  while(n_done < labels.size() && !error)
+    {
+    cv.wait(lock);
+    double delta = done_count - reported;
+    reported = done_count;
+    lock.unlock();
+    tracker->AddProgress(delta);
+    lock.lock();
+    }
+  lock.unlock();
+
+  for(auto &t : threads)
+    t.join();
+
+  tracker->EndProgress();
+
+  // Release the views of the input image
+  for(unsigned int i = 0; i < n_threads; i++)
+    m_Workers[i]->Image->Initialize();
+
+  if(error)
+    std::rethrow_exception(error);
+}
+
 void MultiLabelMeshPipeline::UpdateMeshes(itk::Command *progressCommand)
 {
   // Create a temporary table of mesh info
@@ -253,14 +602,18 @@ void MultiLabelMeshPipeline::UpdateMeshes(itk::Command *progressCommand)
   for(MeshInfoMap::iterator it = m_MeshInfo.begin(); it != m_MeshInfo.end();)
     {
     if(meshmap.find(it->first) == meshmap.end())
+      {
+      m_SurfaceCache.erase(it->first);
       m_MeshInfo.erase(it++);
+      }
     else
       it++;
     }
 
   // Deal with progress accumulation
   SmartPtr<AllPurposeProgressAccumulator> progress = AllPurposeProgressAccumulator::New();
-  progress->AddObserver(itk::ProgressEvent(), progressCommand);
+  if(progressCommand)
+    progress->AddObserver(itk::ProgressEvent(), progressCommand);
 
   // Next we check which meshes are new or updated and mark them as needing to
   // be recomputed
@@ -278,48 +631,63 @@ void MultiLabelMeshPipeline::UpdateMeshes(itk::Command *progressCommand)
       info.BoundingBox[0] = it->second.BoundingBox[0];
       info.BoundingBox[1] = it->second.BoundingBox[1];
       info.Mesh = NULL;
-
-      //auto src = m_VTKPipeline->GetProgressAccumulator();
-
-      // Capture progress from this mesh
-      progress->RegisterSource(m_VTKPipeline->GetProgressAccumulator(), info.Count);
       }
     }
 
-  // Now compute the meshes
+  // Collect the labels whose meshes must be computed, largest first
+  std::vector<std::pair<LabelType, MeshInfo *> > dirty;
   for(MeshInfoMap::iterator it = m_MeshInfo.begin(); it != m_MeshInfo.end(); it++)
     {
     if(it->second.Mesh == NULL)
       {
-      // Create the mesh
-      MeshInfo &mi = it->second;
-      mi.Mesh = vtkSmartPointer<vtkPolyData>::New();
+      it->second.Mesh = vtkSmartPointer<vtkPolyData>::New();
+      dirty.push_back(std::make_pair(it->first, &it->second));
+      }
+    }
 
-      // TODO: make this more elegant
-      InputImageType::RegionType bbWiderRegion;
-      for(int d = 0; d < 3; d++)
-        {
-        unsigned long len =
-            (unsigned long) (1 + mi.BoundingBox[1][d] - mi.BoundingBox[0][d]);
-        bbWiderRegion.SetIndex(d, mi.BoundingBox[0][d]);
-        bbWiderRegion.SetSize(d, len);
-        }
-      bbWiderRegion.PadByRadius(5);
-      bbWiderRegion.Crop(m_InputImage->GetLargestPossibleRegion());
+  std::stable_sort(dirty.begin(), dirty.end(),
+                   [this](const std::pair<LabelType, MeshInfo *> &a,
+                          const std::pair<LabelType, MeshInfo *> &b)
+    {
+    return GetMeshRegion(*a.second).GetNumberOfPixels()
+        > GetMeshRegion(*b.second).GetNumberOfPixels();
+    });
 
-      // Pass the region to the ROI filter and propagate the filter
-      m_ROIFilter->SetInput(m_InputImage);
-      m_ROIFilter->SetRegionOfInterest(bbWiderRegion);
-      m_ROIFilter->Update();
+  // Now compute the meshes
+  unsigned int n_threads = std::min(
+        (unsigned int) dirty.size(),
+        m_NumberOfThreads ? m_NumberOfThreads
+                          : (unsigned int) itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads());
 
-      // Set the parameters for the thresholding filter
-      m_ThrehsoldFilter->SetLowerThreshold(it->first);
-      m_ThrehsoldFilter->SetUpperThreshold(it->first);
-      m_ThrehsoldFilter->UpdateLargestPossibleRegion();
+  if(m_MeshOptions->GetUseDiscreteSurfaceExtraction())
+    {
+    // Extract the boundaries of all the labels in one pass, then smooth and
+    // post-process them. Progress is tracked per label in this mode.
+    if(dirty.size())
+      {
+      LabelSurfaceExtractor extractor(m_InputImage, m_BrickSize);
+      ExtractSurfaces(extractor, dirty);
+      ComputeMeshesInParallel(dirty, std::max(n_threads, 1u), progress, &extractor);
+      }
+    }
+  else if(n_threads > 1)
+    {
+    ClearSurfaceCache();
+    ComputeMeshesInParallel(dirty, n_threads, progress);
+    }
+  else
+    {
+    ClearSurfaceCache();
 
-      // Graft the polydata to the last filter in the pipeline
-      m_VTKPipeline->SetImage(m_ThrehsoldFilter->GetOutput());
-      m_VTKPipeline->ComputeMesh(it->second.Mesh);
+    // Capture progress from each mesh
+    for(auto &it : dirty)
+      progress->RegisterSource(m_VTKPipeline->GetProgressAccumulator(), it.second->Count);
+
+    for(auto &it : dirty)
+      {
+      ComputeMeshInRegion(m_ROIFilter, m_ThrehsoldFilter, m_VTKPipeline,
+                          m_InputImage, it.first, GetMeshRegion(*it.second),
+                          it.second->Mesh, nullptr);
 
       // Update progress
       progress->StartNextRun(m_VTKPipeline->GetProgressAccumulator());
@@ -341,6 +709,7 @@ MultiLabelMeshPipeline
     {
     m_InputImage = image;
     m_MeshInfo.clear();
+    ClearSurfaceCache();
     }
 }
 
@@ -375,18 +744,57 @@ void
 MultiLabelMeshPipelineTable::SetPipeline(unsigned int timepoint, SmartPtr<MultiLabelMeshPipeline> pipeline)
 {
   m_table[timepoint] = pipeline;
-  uint32_t size = GetPipelineMemorySize(pipeline);
-  m_MemoryUsage += size;
+}
+
+void
+MultiLabelMeshPipelineTable::RemovePipeline(unsigned int timepoint)
+{
+  m_table.erase(timepoint);
+}
+
+uint32_t
+MultiLabelMeshPipelineTable::GetMemoryUsage()
+{
+  // The meshes change with every update, so the usage is not cached
+  uint32_t sum = 0;
+  for (auto &pair : m_table)
+    if (pair.second)
+      sum += GetPipelineMemorySize(pair.second);
+  return sum;
+}
 
-  // Remove item from the front of the table if memory usage exceeds threshold
-  // -- but will keep item if it's the only item in the table
-  // -- because we still want to render single huge mesh
-  if (m_MemoryUsage > m_MemoryLimit && m_table.size() > 1)
+std::vector<unsigned int>
+MultiLabelMeshPipelineTable::TrimToMemoryLimit(unsigned int keep_timepoint, unsigned int n_timepoints)
+{
+  std::vector<unsigned int> removed;
+  n_timepoints = std::max(n_timepoints, 1u);
+  uint32_t usage = GetMemoryUsage();
+  while (usage > m_MemoryLimit && m_table.size() > 1)
     {
-      //printf("[table trimming] usage = %u MB\n", m_MemoryUsage);
-      m_MemoryUsage -= GetPipelineMemorySize(m_table.begin()->second);
-      m_table.erase(m_table.begin());
+    // Find the timepoint that is reached last when playing forward
+    auto victim = m_table.end();
+    unsigned int max_dist = 0;
+    for (auto it = m_table.begin(); it != m_table.end(); ++it)
+      {
+      unsigned int dist = (it->first + n_timepoints - keep_timepoint % n_timepoints) % n_timepoints;
+      if (dist > max_dist)
+        {
+        max_dist = dist;
+        victim = it;
+        }
+      }
+
+    if (victim == m_table.end())
+      break;
+
+    //printf("[table trimming] usage = %u MB\n", usage);
+    if (victim->second)
+      usage -= std::min(usage, GetPipelineMemorySize(victim->second));
+    removed.push_back(victim->first);
+    m_table.erase(victim);
     }
+
+  return removed;
 }
 
 uint32_t
@@ -396,7 +804,8 @@ MultiLabelMeshPipelineTable::GetPipelineMemorySize(SmartPtr<MultiLabelMeshPipeli
   uint32_t sum = 0;
   for (auto pair : collection)
     {
-      sum += (pair.second->GetActualMemorySize())/1024;
+      if (pair.second)
+        sum += (pair.second->GetActualMemorySize())/1024;
     }
   return sum;
 }
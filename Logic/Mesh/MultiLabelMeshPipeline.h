@@ -44,6 +44,8 @@
 #include "ImageWrapperTraits.h"
 #include "RLERegionOfInterestImageFilter.h"
 #include "RLEImageScanlineIterator.h"
+#include "LabelSurfaceExtractor.h"
+#include <mutex>
 
 
 // Forward reference to itk classes
@@ -70,6 +72,20 @@ class AllPurposeProgressAccumulator;
  * whether it has been updated relative to the corresponding mesh. This makes
  * it possible for selective mesh recomputation, leading to fast mesh computation
  * even for big segmentations.
+ *
+ * When several labels need to be recomputed, they are meshed in parallel by
+ * a pool of workers, each with its own ROI, threshold and VTK pipeline. The
+ * labels are scheduled largest bounding box first, so that the longest jobs
+ * do not end up running last.
+ *
+ * If discrete surface extraction is enabled in the mesh options, the label
+ * boundaries of all the labels to update are first extracted in one pass
+ * over the image by LabelSurfaceExtractor, and the workers only smooth and
+ * post-process these surfaces. In this mode the pipeline also keeps the
+ * faces and smoothed vertex positions of each label, along with a checksum
+ * of each brick of the image. After a local edit, only the faces in the
+ * bricks around the edit are extracted and smoothed again, and the result
+ * is stitched into the cached surface.
  */
 class MultiLabelMeshPipeline : public itk::Object
 {
@@ -129,9 +145,14 @@ public:
    * the color label is not present in the image */
   bool ComputeMesh(LabelType label, vtkPolyData *outData);
 
-  /** Update the meshes */
+  /** Update the meshes. The progress command may be NULL */
   void UpdateMeshes(itk::Command *progressCommand);
 
+  /** Number of threads used to compute meshes. The default of zero uses the
+   * global default number of threads of ITK. */
+  irisSetMacro(NumberOfThreads, unsigned int)
+  irisGetMacro(NumberOfThreads, unsigned int)
+
   /** Get the collection of computed meshes */
   std::map<LabelType, vtkSmartPointer<vtkPolyData> > GetMeshCollection();
 
@@ -184,6 +205,86 @@ private:
   // The VTK pipeline
   VTKMeshPipeline *           m_VTKPipeline;
 
+  // A set of filters that computes the mesh for one label at a time. Each
+  // thread that meshes labels in parallel uses its own worker, which reads
+  // from a private view of the input image so that the pipeline requests of
+  // different threads do not interfere.
+  struct MeshWorker
+  {
+    InputImagePointer Image;
+    ROIFilterPointer ROI;
+    ThresholdFilterPointer Threshold;
+    VTKMeshPipeline *VTKPipeline;
+
+    MeshWorker(MeshOptions *options);
+    ~MeshWorker();
+  };
+
+  // Workers used by UpdateMeshes, created on demand
+  std::vector<MeshWorker *> m_Workers;
+
+  // Maximum number of workers, zero for the ITK default
+  unsigned int m_NumberOfThreads = 0;
+
+  // Mutex passed to the VTK pipelines, see VTKMeshPipeline::ComputeMesh
+  std::mutex m_VTKMutex;
+
+  // The region used to compute the mesh for a label
+  InputImageType::RegionType GetMeshRegion(const MeshInfo &mi) const;
+
+  // Run the ROI, threshold and VTK filters to compute the mesh for a label
+  static void ComputeMeshInRegion(
+      ROIFilter *roi, ThresholdFilter *threshold, VTKMeshPipeline *vtk,
+      const InputImageType *image, LabelType label,
+      const InputImageType::RegionType &region, vtkPolyData *mesh,
+      std::mutex *mutex);
+
+  // Surface of a label kept between updates in discrete mode. The vertex
+  // positions are in voxel coordinates, after smoothing. The patches are the
+  // decimated and smoothed meshes of the faces in each brick
+  struct SurfaceCache
+  {
+    LabelSurfaceExtractor::BrickFaceMap Faces;
+    LabelSurfaceExtractor::CornerPositionMap Positions;
+    std::unordered_map<unsigned int, vtkSmartPointer<vtkPolyData> > Patches;
+
+    // Whether only the faces in the dirty bricks have been extracted again
+    bool Incremental = false;
+  };
+
+  std::map<LabelType, SurfaceCache> m_SurfaceCache;
+
+  // Checksums of the bricks of the image at the last update in discrete mode
+  std::vector<unsigned long> m_BrickCheckSums;
+
+  // Bricks whose faces were extracted again by the current update, and the
+  // larger set of bricks that are smoothed and decimated again
+  LabelSurfaceExtractor::BrickMask m_DirtyBricks, m_PatchBricks;
+
+  // Size of the bricks used for incremental updates
+  static constexpr unsigned int m_BrickSize = 32;
+
+  // Clear the surfaces kept for incremental updates
+  void ClearSurfaceCache();
+
+  // Extract the faces of the labels to update into the surface cache
+  void ExtractSurfaces(
+      const LabelSurfaceExtractor &extractor,
+      const std::vector<std::pair<LabelType, MeshInfo *> > &labels);
+
+  // Compute the mesh of a label from its surface cache
+  void ComputeDiscreteMesh(
+      VTKMeshPipeline *vtk, const LabelSurfaceExtractor *extractor,
+      SurfaceCache &cache, vtkPolyData *mesh);
+
+  // Compute the meshes for the given labels using up to n_threads workers.
+  // If an extractor is given, the meshes are computed from the surfaces in
+  // the surface cache rather than by marching cubes.
+  void ComputeMeshesInParallel(
+      const std::vector<std::pair<LabelType, MeshInfo *> > &labels,
+      unsigned int n_threads, AllPurposeProgressAccumulator *progress,
+      const LabelSurfaceExtractor *extractor = nullptr);
+
   // Helper routine for the update command
   void UpdateMeshInfoHelper(
       MeshInfo *current_meshinfo,
@@ -212,9 +313,26 @@ public:
   // Set pipeline for a timepoint. If timepoint exists, overwrite existing pipeline
   void SetPipeline(unsigned int timepoint, SmartPtr<MultiLabelMeshPipeline> pipeline);
 
+  // Remove the pipeline for a timepoint
+  void RemovePipeline(unsigned int timepoint);
+
   // Get memory size of a pipeline in MB
   static uint32_t  GetPipelineMemorySize(SmartPtr<MultiLabelMeshPipeline> pipeline);
 
+  // Memory used by the meshes of all pipelines in MB
+  uint32_t GetMemoryUsage();
+
+  // Memory limit for the meshes of all pipelines in MB
+  irisSetMacro(MemoryLimit, uint32_t)
+  irisGetMacro(MemoryLimit, uint32_t)
+
+  // Remove pipelines until the memory usage is under the limit. The pipelines
+  // that come last when playing forward from the given timepoint are removed
+  // first, and the pipeline for that timepoint is always kept, because we
+  // still want to render a single huge mesh. Returns the removed timepoints.
+  std::vector<unsigned int> TrimToMemoryLimit(
+      unsigned int keep_timepoint, unsigned int n_timepoints);
+
 protected:
   MultiLabelMeshPipelineTable() {};
   ~MultiLabelMeshPipelineTable() {};
@@ -223,10 +341,7 @@ protected:
 
 private:
   // Memory usage limit in MB
-  static constexpr uint32_t m_MemoryLimit = 1000;
-
-  // Total current memory used by the table
-  uint32_t m_MemoryUsage = 0;
+  uint32_t m_MemoryLimit = 1000;
 
   MeshPipelineTableType m_table;
 
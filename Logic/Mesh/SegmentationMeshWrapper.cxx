@@ -1,6 +1,12 @@
 #include "SegmentationMeshWrapper.h"
 #include "MeshWrapperBase.h"
 #include "Rebroadcaster.h"
+#include "AllPurposeProgressAccumulator.h"
+#include "itkMultiThreaderBase.h"
+
+#include <algorithm>
+#include <exception>
+#include <thread>
 
 //--------------------------------------------
 //  SegmentationMeshAssembly Implementation
@@ -8,7 +14,13 @@
 SegmentationMeshAssembly::
 SegmentationMeshAssembly()
 {
-  m_Pipeline = MultiLabelMeshPipeline::New();
+}
+
+void
+SegmentationMeshAssembly::
+SetPipeline(MultiLabelMeshPipeline *pipeline)
+{
+  m_Pipeline = pipeline;
 }
 
 SegmentationMeshAssembly::
@@ -35,6 +47,13 @@ UpdateMeshAssembly(itk::Command *progress, ImagePointer img, MeshOptions *option
   m_Pipeline->UpdateMeshes(progress);
 
   // Post Update. Update mesh assmebly
+  this->UpdateFromPipeline();
+}
+
+void
+SegmentationMeshAssembly::
+UpdateFromPipeline()
+{
   auto collection = m_Pipeline->GetMeshCollection();
   // Process creation and update
   for (auto cit = collection.cbegin(); cit != collection.cend(); ++cit)
@@ -67,6 +86,7 @@ UpdateMeshAssembly(itk::Command *progress, ImagePointer img, MeshOptions *option
 
 SegmentationMeshWrapper::SegmentationMeshWrapper()
 {
+  m_PipelineTable = MultiLabelMeshPipelineTable::New();
 }
 
 void
@@ -104,7 +124,9 @@ SegmentationMeshWrapper
 bool
 SegmentationMeshWrapper::IsMeshDirty(unsigned int timepoint)
 {
-  auto imgMTime = m_ImagePointer->GetImage()->GetMTime();
+  // Each time point is compared to its own image, so that editing one frame
+  // of a 4D segmentation does not invalidate the meshes of the others
+  auto imgMTime = m_ImagePointer->GetImageByTimePoint(timepoint)->GetMTime();
 
   auto assembly = dynamic_cast<SegmentationMeshAssembly*>(GetMeshAssembly(timepoint));
   if (assembly)
@@ -125,7 +147,13 @@ void
 SegmentationMeshWrapper::
 CreateNewAssembly(unsigned int timepoint)
 {
-  m_MeshAssemblyMap[timepoint] = SegmentationMeshAssembly::New().GetPointer();
+  auto segAssembly = SegmentationMeshAssembly::New();
+  m_MeshAssemblyMap[timepoint] = segAssembly.GetPointer();
+
+  // The pipeline of the assembly is kept in the pipeline table
+  SmartPtr<MultiLabelMeshPipeline> pipeline = MultiLabelMeshPipeline::New();
+  m_PipelineTable->SetPipeline(timepoint, pipeline);
+  segAssembly->SetPipeline(pipeline);
 
   MeshAssembly *assembly = m_MeshAssemblyMap[timepoint];
 
@@ -150,6 +178,121 @@ SegmentationMeshWrapper::UpdateMeshes(itk::Command *progressCmd, unsigned int ti
   assembly->UpdateMeshAssembly(progressCmd, img, m_MeshOptions);
 }
 
+bool
+SegmentationMeshWrapper::PrecomputeMeshes(itk::Command *progressCmd, unsigned int current_tp)
+{
+  // Memory used by the meshes that are already computed. Stop once the cache
+  // is full, since the meshes computed next would only be trimmed again
+  if (m_PipelineTable->GetMemoryUsage() > m_PipelineTable->GetMemoryLimit())
+    return false;
+
+  // Take the next dirty time points in playback order, starting after the
+  // current one, one for each thread
+  unsigned int nt = m_ImagePointer->GetNumberOfTimePoints();
+  unsigned int n_total = itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads();
+  std::vector<unsigned int> frames;
+  for (unsigned int i = 1; i < nt && frames.size() < n_total; i++)
+    {
+    unsigned int tp = (current_tp + i) % nt;
+    if (IsMeshDirty(tp))
+      frames.push_back(tp);
+    }
+
+  if (frames.empty())
+    return false;
+
+  // Split the threads between the time points. The pipelines are set up on
+  // this thread, since creating an assembly fires events
+  unsigned int n_per_frame = std::max(1u, n_total / (unsigned int) frames.size());
+
+  std::vector<MultiLabelMeshPipeline *> pipelines;
+  for (unsigned int tp : frames)
+    {
+    if (!m_MeshAssemblyMap.count(tp))
+      CreateNewAssembly(tp);
+
+    auto assembly = static_cast<SegmentationMeshAssembly*>(m_MeshAssemblyMap[tp].GetPointer());
+    MultiLabelMeshPipeline *pipeline = assembly->GetPipeline();
+    pipeline->SetImage(m_ImagePointer->GetImageByTimePoint(tp));
+    pipeline->SetMeshOptions(m_MeshOptions);
+    pipeline->SetNumberOfThreads(n_per_frame);
+    pipelines.push_back(pipeline);
+    }
+
+  // Progress is reported from this thread, one unit per time point
+  SmartPtr<AllPurposeProgressAccumulator> progress = AllPurposeProgressAccumulator::New();
+  if (progressCmd)
+    progress->AddObserver(itk::ProgressEvent(), progressCmd);
+  SmartPtr<TrivalProgressSource> tracker = TrivalProgressSource::New();
+  progress->RegisterSource(tracker, 1.0);
+  tracker->StartProgress(frames.size());
+
+  // Compute the time points concurrently
+  std::vector<std::exception_ptr> errors(frames.size());
+  std::vector<std::thread> threads;
+  for (size_t k = 0; k < frames.size(); k++)
+    {
+    threads.push_back(std::thread([&pipelines, &errors, k]()
+      {
+      try
+        {
+        pipelines[k]->UpdateMeshes(nullptr);
+        }
+      catch (...)
+        {
+        errors[k] = std::current_exception();
+        }
+      }));
+    }
+
+  for (auto &t : threads)
+    {
+    t.join();
+    tracker->AddProgress(1.0);
+    }
+
+  tracker->EndProgress();
+  progress->UnregisterAllSources();
+
+  // Pass the meshes to the assemblies
+  for (size_t k = 0; k < frames.size(); k++)
+    pipelines[k]->SetNumberOfThreads(0);
+
+  for (size_t k = 0; k < frames.size(); k++)
+    if (errors[k])
+      std::rethrow_exception(errors[k]);
+
+  for (size_t k = 0; k < frames.size(); k++)
+    {
+    auto assembly = static_cast<SegmentationMeshAssembly*>(
+          m_MeshAssemblyMap[frames[k]].GetPointer());
+    assembly->UpdateFromPipeline();
+    }
+
+  return true;
+}
+
+void
+SegmentationMeshWrapper::TrimMeshCache(unsigned int current_tp)
+{
+  auto removed = m_PipelineTable->TrimToMemoryLimit(
+        current_tp, m_ImagePointer->GetNumberOfTimePoints());
+  for (unsigned int tp : removed)
+    m_MeshAssemblyMap.erase(tp);
+}
+
+void
+SegmentationMeshWrapper::SetCacheMemoryLimit(uint32_t limit)
+{
+  m_PipelineTable->SetMemoryLimit(limit);
+}
+
+uint32_t
+SegmentationMeshWrapper::GetCacheMemoryLimit() const
+{
+  return m_PipelineTable->GetMemoryLimit();
+}
+
 void
 SegmentationMeshWrapper
 ::SaveToRegistry(Registry &)
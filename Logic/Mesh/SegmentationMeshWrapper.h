@@ -17,7 +17,14 @@ public:
 
   MultiLabelMeshPipeline *GetPipeline();
 
+  /** Set the pipeline used to compute the meshes, which is owned by the
+   * pipeline table of the wrapper */
+  void SetPipeline(MultiLabelMeshPipeline *pipeline);
+
   void UpdateMeshAssembly(itk::Command *progress, ImagePointer img, MeshOptions *options);
+
+  /** Copy the meshes computed by the pipeline into the assembly */
+  void UpdateFromPipeline();
 protected:
   SegmentationMeshAssembly();
   virtual ~SegmentationMeshAssembly();
@@ -62,6 +69,30 @@ public:
 
   void UpdateMeshes(itk::Command *progressCmd, unsigned int timepoint);
 
+  /**
+   * Compute the meshes for the next few time points whose meshes are dirty,
+   * in playback order starting after the current one, so that playing through
+   * a 4D segmentation does not stall at every frame. Up to one time point per
+   * thread is computed concurrently. Does nothing once the cache memory limit
+   * is reached. Callers repeat this until it returns false, which lets them
+   * release their locks and check for edits between calls. Should be called
+   * after the mesh of the current time point has been updated. Returns true
+   * if any meshes were computed.
+   */
+  bool PrecomputeMeshes(itk::Command *progressCmd, unsigned int current_tp);
+
+  /**
+   * Drop the meshes of the time points reached last when playing forward from
+   * the current time point, if the meshes use more than the cache memory
+   * limit. This removes mesh assemblies that the renderer may be displaying,
+   * so it should be called from the GUI thread.
+   */
+  void TrimMeshCache(unsigned int current_tp);
+
+  /** Memory limit for the meshes of all time points, in MB */
+  void SetCacheMemoryLimit(uint32_t limit);
+  uint32_t GetCacheMemoryLimit() const;
+
   void Initialize(LabelImageWrapper *segImg, MeshOptions* meshOptions);
 
   /** Add a new blank segmentation mesh assembly to the assembly map*/
@@ -82,6 +113,9 @@ protected:
 
   SmartPtr<MeshOptions> m_MeshOptions;
 
+  // The pipelines of all the time points
+  SmartPtr<MultiLabelMeshPipelineTable> m_PipelineTable;
+
 	const char* m_NicknamePrefix = "Mesh-";
 };
 
@@ -38,6 +38,9 @@
 #include "MeshOptions.h"
 #include "SNAPExportITKToVTK.h"
 #include <map>
+#include <vtkAppendPolyData.h>
+#include <vtkCleanPolyData.h>
+#include <vnl/vnl_det.h>
 
 using namespace std;
 
@@ -114,6 +117,46 @@ VTKMeshPipeline
   m_DecimateFilter->Delete();
 }
 
+void
+VTKMeshPipeline
+::ApplyDecimationOptions(vtkDecimatePro *filter)
+{
+  filter->SetTargetReduction(
+    m_MeshOptions->GetDecimateTargetReduction());
+
+  filter->SetMaximumError(
+    m_MeshOptions->GetDecimateMaximumError());
+
+  filter->SetFeatureAngle(
+    m_MeshOptions->GetDecimateFeatureAngle());
+
+  filter->SetPreserveTopology(
+    m_MeshOptions->GetDecimatePreserveTopology());
+}
+
+void
+VTKMeshPipeline
+::ApplyMeshSmoothingOptions(vtkSmoothPolyDataFilter *filter)
+{
+  filter->SetNumberOfIterations(
+    m_MeshOptions->GetMeshSmoothingIterations());
+
+  filter->SetRelaxationFactor(
+    m_MeshOptions->GetMeshSmoothingRelaxationFactor());
+
+  filter->SetFeatureAngle(
+    m_MeshOptions->GetMeshSmoothingFeatureAngle());
+
+  filter->SetFeatureEdgeSmoothing(
+    m_MeshOptions->GetMeshSmoothingFeatureEdgeSmoothing());
+
+  filter->SetBoundarySmoothing(
+    m_MeshOptions->GetMeshSmoothingBoundarySmoothing());
+
+  filter->SetConvergence(
+    m_MeshOptions->GetMeshSmoothingConvergence());
+}
+
 void
 VTKMeshPipeline
 ::SetMeshOptions(MeshOptions *options)
@@ -170,17 +213,7 @@ VTKMeshPipeline
     pipePolyTail = m_DecimateFilter->GetOutputPort();
 
     // Apply parameters to the decimation filter
-    m_DecimateFilter->SetTargetReduction(
-      options->GetDecimateTargetReduction());
-
-    m_DecimateFilter->SetMaximumError(
-      options->GetDecimateMaximumError());
-
-    m_DecimateFilter->SetFeatureAngle(
-      options->GetDecimateFeatureAngle());
-
-    m_DecimateFilter->SetPreserveTopology(
-      options->GetDecimatePreserveTopology());
+    ApplyDecimationOptions(m_DecimateFilter);
 
     } // If decimate enabled
 
@@ -195,23 +228,7 @@ VTKMeshPipeline
     pipePolyTail = m_PolygonSmoothingFilter->GetOutputPort();
 
     // Apply parameters to the mesh smoothing filter
-    m_PolygonSmoothingFilter->SetNumberOfIterations(
-      options->GetMeshSmoothingIterations());
-
-    m_PolygonSmoothingFilter->SetRelaxationFactor(
-      options->GetMeshSmoothingRelaxationFactor());
-
-    m_PolygonSmoothingFilter->SetFeatureAngle(
-      options->GetMeshSmoothingFeatureAngle());
-
-    m_PolygonSmoothingFilter->SetFeatureEdgeSmoothing(
-      options->GetMeshSmoothingFeatureEdgeSmoothing());
-
-    m_PolygonSmoothingFilter->SetBoundarySmoothing(
-      options->GetMeshSmoothingBoundarySmoothing());
-
-    m_PolygonSmoothingFilter->SetConvergence(
-      options->GetMeshSmoothingConvergence());
+    ApplyMeshSmoothingOptions(m_PolygonSmoothingFilter);
     }
 
   // 6. Pipe in the final output into the stripper
@@ -224,7 +241,7 @@ VTKMeshPipeline
 
 void
 VTKMeshPipeline
-::ComputeMesh(vtkPolyData *outMesh, std::mutex *mutex)
+::ComputeMesh(vtkPolyData *outMesh, std::mutex *mutex, bool lockWholePipeline)
 {
   // Reset the progress meter
   m_Progress->ResetProgress();
@@ -240,14 +257,28 @@ VTKMeshPipeline
   m_VTKExporter->SetInput(m_InputImage);
   m_VTKImporter->Modified();
 
-  // Update the importer
+  // The importer is not safe to update from several threads at once, so it
+  // runs under the mutex. It passes the buffer of the input image to VTK
+  // without copying it, so when the input can change while the mesh is being
+  // computed, lockWholePipeline keeps the mutex until the whole pipeline has run
   if(mutex) mutex->lock();
-  m_VTKImporter->Update();
+  try
+    {
+    m_VTKImporter->Update();
+    if(mutex && !lockWholePipeline)
+      {
+      mutex->unlock();
+      mutex = nullptr;
+      }
+    m_StripperFilter->Update();
+    }
+  catch(...)
+    {
+    if(mutex) mutex->unlock();
+    throw;
+    }
   if(mutex) mutex->unlock();
 
-  // Update the pipeline
-  m_StripperFilter->Update();
-
   // In the case that the jacobian of the transform is negative,
   // flip the normals around
   if(m_Transform->GetMatrix()->Determinant() < 0)
@@ -264,6 +295,131 @@ VTKMeshPipeline
   m_StripperFilter->SetOutput(NULL);
 }
 
+void
+VTKMeshPipeline
+::SmoothSurface(vtkPolyData *surface, vtkPolyData *outSurface)
+{
+  // Smooth the blocky surface with a windowed sinc filter, which does not
+  // shrink the surface like Laplacian smoothing does. Boundary vertices are
+  // held in place, which allows smoothing a patch of a larger surface.
+  unsigned int n_iter = m_MeshOptions->GetDiscreteSmoothingIterations();
+  if(n_iter == 0)
+    {
+    outSurface->ShallowCopy(surface);
+    return;
+    }
+
+  vtkSmartPointer<vtkWindowedSincPolyDataFilter> sinc =
+      vtkSmartPointer<vtkWindowedSincPolyDataFilter>::New();
+  sinc->SetInputData(surface);
+  sinc->SetNumberOfIterations(n_iter);
+  sinc->SetPassBand(m_MeshOptions->GetDiscreteSmoothingPassBand());
+  sinc->BoundarySmoothingOff();
+  sinc->FeatureEdgeSmoothingOff();
+  sinc->NonManifoldSmoothingOn();
+  sinc->NormalizeCoordinatesOn();
+  sinc->Update();
+
+  outSurface->ShallowCopy(sinc->GetOutput());
+}
+
+void
+VTKMeshPipeline
+::ComputeMeshPatch(vtkPolyData *surface, const itk::ImageBase<3> *image,
+                   vtkPolyData *outPatch)
+{
+  // The filters are created for each call: this path is used once per patch
+  // and the filters are cheap compared to the work they do
+  vtkSmartPointer<vtkPolyData> tail = surface;
+
+  // 1. Map from voxel to NIFTI/RAS coordinates
+  vtkSmartPointer<vtkTransform> transform = vtkSmartPointer<vtkTransform>::New();
+  transform->SetMatrix(ConstructVoxelToNiftiMatrix(image).data_block());
+
+  vtkSmartPointer<vtkTransformPolyDataFilter> tf =
+      vtkSmartPointer<vtkTransformPolyDataFilter>::New();
+  tf->SetInputData(tail);
+  tf->SetTransform(transform);
+  tf->Update();
+  tail = tf->GetOutput();
+
+  // 2. Decimation and mesh smoothing, as for the marching cubes pipeline, but
+  // keeping the boundary of the patch where it is
+  if(m_MeshOptions->GetUseDecimation())
+    {
+    vtkSmartPointer<vtkDecimatePro> decimate = vtkSmartPointer<vtkDecimatePro>::New();
+    decimate->SetInputData(tail);
+    ApplyDecimationOptions(decimate);
+    decimate->BoundaryVertexDeletionOff();
+    decimate->Update();
+    tail = decimate->GetOutput();
+    }
+
+  if(m_MeshOptions->GetUseMeshSmoothing())
+    {
+    vtkSmartPointer<vtkSmoothPolyDataFilter> smooth =
+        vtkSmartPointer<vtkSmoothPolyDataFilter>::New();
+    smooth->SetInputData(tail);
+    ApplyMeshSmoothingOptions(smooth);
+    smooth->BoundarySmoothingOff();
+    smooth->Update();
+    tail = smooth->GetOutput();
+    }
+
+  outPatch->ShallowCopy(tail);
+}
+
+void
+VTKMeshPipeline
+::ComputeMeshFromPatches(const std::vector<vtkPolyData *> &patches,
+                         const itk::ImageBase<3> *image, vtkPolyData *outMesh)
+{
+  if(patches.empty())
+    {
+    outMesh->Initialize();
+    return;
+    }
+
+  // 1. Join the patches. Points on the boundary between two patches are at
+  // exactly the same place in both, and are merged
+  vtkSmartPointer<vtkAppendPolyData> append = vtkSmartPointer<vtkAppendPolyData>::New();
+  for(vtkPolyData *patch : patches)
+    append->AddInputData(patch);
+
+  vtkSmartPointer<vtkCleanPolyData> clean = vtkSmartPointer<vtkCleanPolyData>::New();
+  clean->SetInputConnection(append->GetOutputPort());
+  clean->PointMergingOn();
+  clean->SetTolerance(0.0);
+  clean->ConvertPolysToLinesOff();
+  clean->ConvertLinesToPointsOff();
+  clean->ConvertStripsToPolysOff();
+
+  // 2. Compute the normals. The surface is oriented outwards in voxel space,
+  // so the normals have to be flipped if the transform is a reflection
+  vtkSmartPointer<vtkPolyDataNormals> normals = vtkSmartPointer<vtkPolyDataNormals>::New();
+  normals->SetInputConnection(clean->GetOutputPort());
+  normals->SplittingOff();
+  normals->ComputeCellNormalsOff();
+  normals->SetFlipNormals(vnl_det(ConstructVoxelToNiftiMatrix(image)) < 0);
+
+  // 3. Triangle strips, as produced by the marching cubes pipeline
+  vtkSmartPointer<vtkStripper> stripper = vtkSmartPointer<vtkStripper>::New();
+  stripper->SetInputConnection(normals->GetOutputPort());
+  stripper->Update();
+
+  outMesh->ShallowCopy(stripper->GetOutput());
+}
+
+vnl_matrix_fixed<double, 4, 4>
+VTKMeshPipeline
+::ConstructVoxelToNiftiMatrix(const itk::ImageBase<3> *image)
+{
+  return ImageWrapperBase::ConstructNiftiSform(
+        image->GetDirection().GetVnlMatrix().as_ref(),
+        image->GetOrigin().GetVnlVector(),
+        image->GetSpacing().GetVnlVector());
+}
+
 void
 VTKMeshPipeline
 ::SetImage(const ImageType *image)
@@ -59,8 +59,11 @@
 #include <vtkDecimatePro.h>
 #include <vtkTransformPolyDataFilter.h>
 #include <vtkTransform.h>
+#include <vtkWindowedSincPolyDataFilter.h>
+#include <vtkPolyDataNormals.h>
 
 #include <mutex>
+#include <vector>
 
 #ifndef vtkFloatingPointType
 # define vtkFloatingPointType vtkFloatingPointType
@@ -89,8 +92,39 @@ public:
   /** Set the mesh options for this filter */
   void SetMeshOptions(MeshOptions *options);
 
-  /** Compute a mesh for a particular color label */
-  void ComputeMesh(vtkPolyData *outData, std::mutex *mutex = nullptr);
+  /**
+   * Compute a mesh for a particular color label. The mutex, if given, is held
+   * while the importer updates. With lockWholePipeline, it is held until the
+   * whole pipeline has run, for inputs that another thread may modify.
+   */
+  void ComputeMesh(vtkPolyData *outData, std::mutex *mutex = nullptr,
+                   bool lockWholePipeline = false);
+
+  /**
+   * Smooth a surface extracted from a label image by LabelSurfaceExtractor,
+   * using the discrete smoothing parameters in the mesh options. Points on
+   * the boundary of the surface do not move. The output has the same points
+   * in the same order as the input.
+   */
+  void SmoothSurface(vtkPolyData *surface, vtkPolyData *outSurface);
+
+  /**
+   * Compute a patch of a mesh from a patch of a smoothed surface in voxel
+   * coordinates of the image. The patch is mapped to RAS coordinates, then
+   * decimated and smoothed according to the mesh options. The points on the
+   * boundary of the patch are neither removed nor moved, so that patches
+   * computed separately fit together. This method does not use the input
+   * image or the marching cubes pipeline.
+   */
+  void ComputeMeshPatch(vtkPolyData *surface, const itk::ImageBase<3> *image,
+                        vtkPolyData *outPatch);
+
+  /**
+   * Join patches computed by ComputeMeshPatch into a mesh, merging the points
+   * they share, and compute the normals of the mesh.
+   */
+  void ComputeMeshFromPatches(const std::vector<vtkPolyData *> &patches,
+                              const itk::ImageBase<3> *image, vtkPolyData *outData);
 
   /** Get the progress accumulator */
   AllPurposeProgressAccumulator *GetProgressAccumulator()
@@ -103,6 +137,16 @@ public:
   ~VTKMeshPipeline();
 
 private:
+
+  // Apply the mesh options to a decimation filter
+  void ApplyDecimationOptions(vtkDecimatePro *filter);
+
+  // Apply the mesh options to a mesh smoothing filter
+  void ApplyMeshSmoothingOptions(vtkSmoothPolyDataFilter *filter);
+
+  // Matrix mapping voxel coordinates of an image to NIFTI/RAS coordinates
+  static vnl_matrix_fixed<double, 4, 4> ConstructVoxelToNiftiMatrix(
+      const itk::ImageBase<3> *image);
   
   // VTK-ITK Connection typedefs
   typedef itk::VTKImageExport<ImageType> VTKExportType;
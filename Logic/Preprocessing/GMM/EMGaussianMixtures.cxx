@@ -1,9 +1,16 @@
 #include "EMGaussianMixtures.h"
+#include "itkMultiThreaderBase.h"
+#include <algorithm>
 #include <iostream>
 #include <ctime>
 
+// Number of samples processed together in each step of the EM. Partial sums
+// are kept for each block and added up in order, so the results do not depend
+// on the number of threads.
+static const int EM_BLOCK_SIZE = 1024;
+
 EMGaussianMixtures::EMGaussianMixtures(double **x, int dataSize, int dataDim, int numOfClass)
-  :m_x(x), m_numOfData(dataSize), m_dimOfGaussian(dataDim), m_numOfGaussian(numOfClass), m_setPriorFlag(0), m_numOfIteration(0), m_fail(0)
+  :m_numOfData(dataSize), m_dimOfGaussian(dataDim), m_numOfGaussian(numOfClass), m_setPriorFlag(0), m_numOfIteration(0), m_fail(0)
 {
   m_latent = new double*[dataSize];
   m_probs = new double[dataSize*numOfClass];
@@ -23,6 +30,17 @@ EMGaussianMixtures::EMGaussianMixtures(double **x, int dataSize, int dataDim, in
   m_sum = new double[numOfClass];
   m_weight = new double[numOfClass];
 
+  // Copy the samples into a contiguous buffer, one component after another,
+  // so that the loops over samples read consecutive values
+  m_x.resize((size_t) dataSize * dataDim);
+  for (int i = 0; i < dataSize; i++)
+    {
+    for (int k = 0; k < dataDim; k++)
+      {
+      m_x[(size_t) k * dataSize + i] = x[i][k];
+      }
+    }
+
   m_gmm = GaussianMixtureModel::New();
   m_gmm->Initialize(dataDim, numOfClass);
 
@@ -194,15 +212,37 @@ double ** EMGaussianMixtures::UpdateOnce(void)
   return m_latent;
 }
 
+int EMGaussianMixtures::GetNumberOfBlocks() const
+{
+  return (m_numOfData + EM_BLOCK_SIZE - 1) / EM_BLOCK_SIZE;
+}
+
+template <class TFunction>
+void EMGaussianMixtures::ParallelForEachBlock(TFunction f)
+{
+  itk::MultiThreaderBase::Pointer mt = itk::MultiThreaderBase::New();
+  mt->ParallelizeArray(0, this->GetNumberOfBlocks(), [&](itk::SizeValueType b)
+    {
+    int start = (int) b * EM_BLOCK_SIZE;
+    f((int) b, start, std::min(EM_BLOCK_SIZE, m_numOfData - start));
+    }, nullptr);
+}
+
 void EMGaussianMixtures::EvaluatePDF(void)
 {
-  for (int i = 0; i < m_numOfData; i++)
+  ParallelForEachBlock([this](int, int start, int count)
     {
+    std::vector<double> scratch((m_dimOfGaussian + 1) * count), log_pdf(count);
     for (int j = 0; j < m_numOfGaussian; j++)
       {
-      m_log_pdf[i][j] = m_gmm->EvaluateLogPDF(j, m_x[i]);
+      m_gmm->GetGaussian(j)->EvaluateLogPDF(
+            &m_x[start], m_numOfData, count, log_pdf.data(), scratch.data());
+      for (int i = 0; i < count; i++)
+        {
+        m_log_pdf[start + i][j] = log_pdf[i];
+        }
       }
-    }
+    });
   if (m_setPriorFlag == 0)
     {
     for (int j = 0; j < m_numOfGaussian; j++)
@@ -279,39 +319,27 @@ void EMGaussianMixtures::UpdateLatent(void)
   
   if (m_setPriorFlag == 0)
     {
-    for (int i = 0; i < m_numOfData; i++)
+    // Sums of the latent variables over each block of samples
+    std::vector<double> block_sum(GetNumberOfBlocks() * m_numOfGaussian, 0.0);
+    ParallelForEachBlock([&](int b, int start, int count)
       {
-      for (int j = 0; j < m_numOfGaussian; j++)
-        {
-        m_latent[i][j] = ComputePosterior(m_numOfGaussian, m_log_pdf[i], m_weight, logw.data_block(), j);
-        m_sum[j] += m_latent[i][j];
-        }
-
-
-      /*
-      sum = 0;
-      for (int j = 0; j < m_numOfGaussian; j++)
-        {
-        m_tmp1[j] = m_weight[j] * m_pdf[i][j];
-        sum += m_tmp1[j];
-        }
-      if(sum == 0)
+      double *bsum = &block_sum[b * m_numOfGaussian];
+      for (int i = start; i < start + count; i++)
         {
         for (int j = 0; j < m_numOfGaussian; j++)
           {
-          m_latent[i][j] = 1.0 / m_numOfGaussian;
-          m_sum[j] += m_latent[i][j];
+          m_latent[i][j] = ComputePosterior(m_numOfGaussian, m_log_pdf[i], m_weight, logw.data_block(), j);
+          bsum[j] += m_latent[i][j];
           }
         }
-      else
+      });
+
+    for (int b = 0; b < GetNumberOfBlocks(); b++)
+      {
+      for (int j = 0; j < m_numOfGaussian; j++)
         {
-        for (int j = 0; j < m_numOfGaussian; j++)
-          {
-          m_latent[i][j] = m_tmp1[j] / sum;
-          m_sum[j] += m_latent[i][j];
-          }
+        m_sum[j] += block_sum[b * m_numOfGaussian + j];
         }
-        */
       }
     }
   else
@@ -337,18 +365,41 @@ void EMGaussianMixtures::UpdateLatent(void)
 
 void EMGaussianMixtures::UpdateMean(void)
 {
+  int nb = GetNumberOfBlocks(), nk = m_numOfGaussian * m_dimOfGaussian;
+
+  // Sums of the samples weighted by the latent variables, for each block
+  std::vector<double> block_sum(nb * nk, 0.0);
+  ParallelForEachBlock([&](int b, int start, int count)
+    {
+    std::vector<double> w(count);
+    double *bsum = &block_sum[b * nk];
+    for (int i = 0; i < m_numOfGaussian; i++)
+      {
+      for (int s = 0; s < count; s++)
+        {
+        w[s] = m_latent[start + s][i];
+        }
+      for (int k = 0; k < m_dimOfGaussian; k++)
+        {
+        const double *xk = &m_x[(size_t) k * m_numOfData + start];
+        double acc = 0;
+        for (int s = 0; s < count; s++)
+          {
+          acc += w[s] * xk[s];
+          }
+        bsum[i * m_dimOfGaussian + k] = acc;
+        }
+      }
+    });
+
   for (int i = 0; i < m_numOfGaussian; i++)
     {
     for (int j = 0; j < m_dimOfGaussian; j++)
       {
       m_tmp2[j] = 0;
-      }
-    
-    for (int j = 0; j < m_numOfData; j++)
-      {
-      for (int k = 0; k < m_dimOfGaussian; k++)
+      for (int b = 0; b < nb; b++)
         {
-        m_tmp2[k] += m_latent[j][i] * m_x[j][k];
+        m_tmp2[j] += block_sum[b * nk + i * m_dimOfGaussian + j];
         }
       }
 
@@ -377,30 +428,65 @@ void EMGaussianMixtures::UpdateMean(void)
 
 void EMGaussianMixtures::UpdateCovariance(void)
 {
+  int d = m_dimOfGaussian, nb = GetNumberOfBlocks(), nc = m_numOfGaussian * d * d;
+
+  std::vector<VectorType> means;
   for (int i = 0; i < m_numOfGaussian; i++)
     {
-    const VectorType &current_mean = m_gmm->GetMean(i);
-    
-    for (int j = 0; j < m_dimOfGaussian; j++)
+    means.push_back(m_gmm->GetMean(i));
+    }
+
+  // Weighted sums of the outer products of the mean-subtracted samples for
+  // each block. Only the lower triangle is computed.
+  std::vector<double> block_sum(nb * nc, 0.0);
+  ParallelForEachBlock([&](int b, int start, int count)
+    {
+    std::vector<double> z(d * count), wz(count);
+    double *bsum = &block_sum[b * nc];
+    for (int i = 0; i < m_numOfGaussian; i++)
       {
-      for (int k = 0; k < m_dimOfGaussian; k++)
+      for (int k = 0; k < d; k++)
         {
-        m_tmp3[j*m_dimOfGaussian+k] = 0;
+        const double *xk = &m_x[(size_t) k * m_numOfData + start];
+        double *zk = &z[k * count], mk = means[i][k];
+        for (int s = 0; s < count; s++)
+          {
+          zk[s] = xk[s] - mk;
+          }
         }
-      }
-    
-    for (int j = 0; j < m_numOfData; j++)
-      {
-      for (int k = 0; k < m_dimOfGaussian; k++)
+      for (int k = 0; k < d; k++)
         {
-        m_tmp2[k] = m_x[j][k] - current_mean[k];
+        const double *zk = &z[k * count];
+        for (int s = 0; s < count; s++)
+          {
+          wz[s] = m_latent[start + s][i] * zk[s];
+          }
+        for (int l = 0; l <= k; l++)
+          {
+          const double *zl = &z[l * count];
+          double acc = 0;
+          for (int s = 0; s < count; s++)
+            {
+            acc += wz[s] * zl[s];
+            }
+          bsum[i * d * d + k * d + l] = acc;
+          }
         }
-      for (int k = 0; k < m_dimOfGaussian; k++)
+      }
+    });
+
+  for (int i = 0; i < m_numOfGaussian; i++)
+    {
+    for (int k = 0; k < d; k++)
+      {
+      for (int l = 0; l <= k; l++)
         {
-        for (int l = 0; l < m_dimOfGaussian; l++)
+        double sum = 0;
+        for (int b = 0; b < nb; b++)
           {
-          m_tmp3[k*m_dimOfGaussian+l] += m_tmp2[k] * m_tmp2[l] * m_latent[j][i];
+          sum += block_sum[b * nc + i * d * d + k * d + l];
           }
+        m_tmp3[k*d+l] = m_tmp3[l*d+k] = sum;
         }
       }
 
@@ -3,6 +3,7 @@
 
 #include "GaussianMixtureModel.h"
 #include "SNAPCommon.h"
+#include <vector>
 
 class EMGaussianMixtures
 {
@@ -42,11 +43,16 @@ private:
   void UpdateMean(void);
   void UpdateCovariance(void);
   void UpdateWeight(void);
+
+  // Run f(block, start, count) for each block of samples on several threads
+  template <class TFunction> void ParallelForEachBlock(TFunction f);
+  int GetNumberOfBlocks() const;
   
   double **m_latent;
   double **m_log_pdf;
   double **m_prior;
-  double **m_x;
+  // The samples, stored one component after another
+  std::vector<double> m_x;
   double *m_probs;
   double *m_probs2;
   double *m_tmp1;
@@ -6,7 +6,7 @@
 #include <limits>
 
 Gaussian::Gaussian(int dimension)
-  :m_dimension(dimension)
+  :m_dimension(dimension), m_LogNormFac(0.0), m_HasCholesky(false)
 {
   // Initialize the scratch buffers
   m_x_vector = VectorType(dimension);
@@ -51,6 +51,55 @@ void Gaussian::SetCovariance(const MatrixType &cov)
   m_DiagNormFac = VectorType(m_dimension);
   for(int i = 0; i < m_dimension; i++)
     m_DiagNormFac[i] = log(2 * vnl_math::pi * m_Lambda[i]);
+
+  // Compute the Cholesky factor L of the covariance matrix, so that the
+  // Mahalanobis distance of x is the squared norm of inv(L) * (x - mean). This
+  // fails for singular matrices, which are handled using the eigensystem.
+  int d = m_dimension;
+  std::vector<double> L(d * d, 0.0);
+  m_HasCholesky = true;
+  m_LogNormFac = d * log(2 * vnl_math::pi);
+  for(int i = 0; i < d && m_HasCholesky; i++)
+    {
+    for(int j = 0; j <= i; j++)
+      {
+      double sum = m_covariance_matrix(i,j);
+      for(int k = 0; k < j; k++)
+        sum -= L[i*d+k] * L[j*d+k];
+
+      if(i == j)
+        {
+        if(!(sum > 0) || !vnl_math::isfinite(sum))
+          {
+          m_HasCholesky = false;
+          break;
+          }
+        L[i*d+i] = sqrt(sum);
+        m_LogNormFac += log(sum);
+        }
+      else
+        {
+        L[i*d+j] = sum / L[j*d+j];
+        }
+      }
+    }
+
+  // Invert the lower triangular factor by forward substitution
+  m_InvCholesky.assign(d * d, 0.0);
+  if(m_HasCholesky)
+    {
+    for(int j = 0; j < d; j++)
+      {
+      m_InvCholesky[j*d+j] = 1.0 / L[j*d+j];
+      for(int i = j + 1; i < d; i++)
+        {
+        double sum = 0;
+        for(int k = j; k < i; k++)
+          sum -= L[i*d+k] * m_InvCholesky[k*d+j];
+        m_InvCholesky[i*d+j] = sum / L[i*d+i];
+        }
+      }
+    }
 }
 
 double Gaussian::EvaluateLogPDF(VectorType &x, VectorType &xscratch)
@@ -95,6 +144,81 @@ double Gaussian::EvaluateLogPDF(VectorType &x, VectorType &xscratch)
   return 0.5 * logz;
 }
 
+void Gaussian::EvaluateLogPDF(const double *x, int stride, int n,
+                              double *log_pdf, double *scratch) const
+{
+  // The loops below run over the samples, so that they can be vectorized
+  int d = m_dimension;
+  double *y = scratch + d * n;
+
+  // Subtract the mean from x
+  for(int j = 0; j < d; j++)
+    {
+    const double *xj = x + j * stride;
+    double *zj = scratch + j * n, mj = m_mean_vector[j];
+    for(int s = 0; s < n; s++)
+      zj[s] = xj[s] - mj;
+    }
+
+  for(int s = 0; s < n; s++)
+    log_pdf[s] = 0.0;
+
+  if(m_HasCholesky)
+    {
+    // Accumulate the squared norm of inv(L) * (x - mean)
+    for(int i = 0; i < d; i++)
+      {
+      const double *row = &m_InvCholesky[i*d];
+      for(int s = 0; s < n; s++)
+        y[s] = row[0] * scratch[s];
+      for(int j = 1; j <= i; j++)
+        {
+        const double *zj = scratch + j * n;
+        for(int s = 0; s < n; s++)
+          y[s] += row[j] * zj[s];
+        }
+      for(int s = 0; s < n; s++)
+        log_pdf[s] += y[s] * y[s];
+      }
+
+    for(int s = 0; s < n; s++)
+      log_pdf[s] = -0.5 * (m_LogNormFac + log_pdf[s]);
+    }
+  else
+    {
+    // Same as the single sample version, one eigenvector at a time
+    for(int i = 0; i < d; i++)
+      {
+      const double *row = m_Vt[i];
+      for(int s = 0; s < n; s++)
+        y[s] = row[0] * scratch[s];
+      for(int j = 1; j < d; j++)
+        {
+        const double *zj = scratch + j * n;
+        for(int s = 0; s < n; s++)
+          y[s] += row[j] * zj[s];
+        }
+
+      if(m_Lambda[i] == 0)
+        {
+        // Zero variance: p(x) = 0 unless z[i] == 0
+        for(int s = 0; s < n; s++)
+          if(y[s] != 0)
+            log_pdf[s] = -std::numeric_limits<double>::infinity();
+        }
+      else
+        {
+        double nf = m_DiagNormFac[i], lambda = m_Lambda[i];
+        for(int s = 0; s < n; s++)
+          log_pdf[s] -= nf + y[s] * y[s] / lambda;
+        }
+      }
+
+    for(int s = 0; s < n; s++)
+      log_pdf[s] *= 0.5;
+    }
+}
+
 double Gaussian::EvaluatePDF(double *x)
 {
   // We got to exponentiate somewhere, so might as well do it here
@@ -4,6 +4,7 @@
 #include <vnl/vnl_matrix.h>
 #include <vnl/algo/vnl_matrix_inverse.h>
 #include <vnl/algo/vnl_determinant.h>
+#include <vector>
 
 class Gaussian
 {
@@ -26,6 +27,12 @@ public:
   // Evaluate log PDF with user-provided scratch buffer
   double EvaluateLogPDF(VectorType &x, VectorType &xscratch);
 
+  // Evaluate log PDF of n samples stored component by component, i.e., component
+  // k of sample s is x[k * stride + s]. The scratch buffer must hold
+  // (dimension + 1) * n values. Safe to call from several threads at once.
+  void EvaluateLogPDF(const double *x, int stride, int n,
+                      double *log_pdf, double *scratch) const;
+
   void PrintParameters();
 
   // Tests whether the Gaussian is a delta function (i.e., has zero total variance)
@@ -43,6 +50,13 @@ private:
   vnl_diag_matrix<double> m_Lambda;
   VectorType m_DiagNormFac;
 
+  // Inverse of the Cholesky factor of the covariance matrix (lower triangular,
+  // stored row by row) and log of the normalization factor. Only available
+  // when the covariance matrix is positive definite.
+  std::vector<double> m_InvCholesky;
+  double m_LogNormFac;
+  bool m_HasCholesky;
+
   // Mean-subtracted and rotated x vector; PCA-normalized z-vector
   // these vectors are used to avoid memory allocation
   VectorType m_x_vector;
@@ -2,9 +2,10 @@
 #define GMMCLASSIFYIMAGEFILTER_TXX
 
 #include "GMMClassifyImageFilter.h"
-#include "itkImageRegionConstIterator.h"
+#include "itkImageScanlineIterator.h"
 #include "EMGaussianMixtures.h"
-#include "ImageCollectionConstIteratorWithIndex.h"
+#include <utility>
+#include <vector>
 
 template <class TInputImage, class TInputVectorImage, class TOutputImage>
 GMMClassifyImageFilter<TInputImage, TInputVectorImage, TOutputImage>
@@ -90,65 +91,106 @@ GMMClassifyImageFilter<TInputImage, TInputVectorImage, TOutputImage>
   assert(m_MixtureModel);
   OutputImagePointer outputPtr = this->GetOutput(0);
 
-  // Create a collection iterator
-  typedef ImageCollectionConstIteratorWithIndex<TInputImage, TInputVectorImage> CollectionIter;
+  int nComp = m_MixtureModel->GetNumberOfComponents();
+  int nGauss = m_MixtureModel->GetNumberOfGaussians();
 
-  typedef itk::ImageRegionIterator<TOutputImage> OutputIter;
-  OutputIter it_out(outputPtr, outputRegionForThread);
+  // Collect the inputs in the order in which they were added. Each is either
+  // a scalar image or a vector image.
+  typedef std::pair<const InputImageType *, const InputVectorImageType *> InputPair;
+  std::vector<InputPair> inputs;
+  int nInputComp = 0;
+  for( itk::InputDataObjectIterator it( this ); !it.IsAtEnd(); it++ )
+    {
+    InputPair in(dynamic_cast<const InputImageType *>(it.GetInput()),
+                 dynamic_cast<const InputVectorImageType *>(it.GetInput()));
+    if(in.first)
+      nInputComp++;
+    else if(in.second)
+      nInputComp += in.second->GetNumberOfComponentsPerPixel();
+    else
+      continue;
+    inputs.push_back(in);
+    }
+
+  if(nInputComp != nComp)
+    itkExceptionMacro(<< "The inputs have " << nInputComp << " components but the "
+                      << "mixture model has " << nComp);
 
-  vnl_vector<double> x(m_MixtureModel->GetNumberOfComponents());
-  vnl_vector<double> x_scratch(m_MixtureModel->GetNumberOfComponents());
-  vnl_vector<double> z_scratch(m_MixtureModel->GetNumberOfComponents());
-  vnl_vector<double> log_pdf(m_MixtureModel->GetNumberOfGaussians());
-  vnl_vector<double> log_w(m_MixtureModel->GetNumberOfGaussians());
-  vnl_vector<double> w(m_MixtureModel->GetNumberOfGaussians());
-  vnl_vector<double> p(m_MixtureModel->GetNumberOfGaussians());
+  vnl_vector<double> log_pdf_voxel(nGauss);
+  vnl_vector<double> log_w(nGauss);
+  vnl_vector<double> w(nGauss);
 
   // Create a multiplier vector (1 for foreground, -1 for background)
-  vnl_vector<double> pfactor(m_MixtureModel->GetNumberOfGaussians());
-  for(int i = 0; i < m_MixtureModel->GetNumberOfGaussians(); i++)
+  vnl_vector<double> pfactor(nGauss);
+  for(int i = 0; i < nGauss; i++)
     {
     pfactor[i] = m_MixtureModel->IsForeground(i) ? 1.0 : -1.0;
     log_w[i] = log(m_MixtureModel->GetWeight(i));
     w[i] = m_MixtureModel->GetWeight(i);
     }
 
-  // Configure the input collection iterator
-  itk::Size<ImageDimension> radius; radius.Fill(0);
-  CollectionIter cit(radius, outputRegionForThread);
-  for( itk::InputDataObjectIterator it( this ); !it.IsAtEnd(); it++ )
-    cit.AddImage(it.GetInput());
+  // The voxels are processed one line at a time. The values of a line are
+  // copied from the input buffers into a block that stores the components one
+  // after another, so that the log PDF of each Gaussian can be computed for
+  // the whole line with loops that run over the voxels.
+  int nx = outputRegionForThread.GetSize(0);
+  std::vector<double> x(nComp * nx), scratch((nComp + 1) * nx), log_pdf(nGauss * nx);
 
-  // Get the number of components
-  int nComp = cit.GetTotalComponents();
-
-  // Iterate through all the voxels
+  typedef itk::ImageScanlineIterator<TOutputImage> OutputIter;
+  OutputIter it_out(outputPtr, outputRegionForThread);
   while ( !it_out.IsAtEnd() )
     {
-    cit.GetNeighborhoodValues(x);
+    const typename OutputImageType::IndexType &idx = it_out.GetIndex();
 
-    // Evaluate the posterior probability robustly
-    for(int k = 0; k < m_MixtureModel->GetNumberOfGaussians(); k++)
+    // Pack the line of each input component into the block
+    double *xc = x.data();
+    for(const InputPair &in : inputs)
       {
-      log_pdf[k] = m_MixtureModel->EvaluateLogPDF(k, x, x_scratch);
+      if(in.first)
+        {
+        const InputComponentType *p =
+            in.first->GetBufferPointer() + in.first->ComputeOffset(idx);
+        for(int s = 0; s < nx; s++)
+          xc[s] = p[s];
+        xc += nx;
+        }
+      else
+        {
+        int nc = in.second->GetNumberOfComponentsPerPixel();
+        const typename InputVectorImageType::InternalPixelType *p =
+            in.second->GetBufferPointer() + nc * in.second->ComputeOffset(idx);
+        for(int k = 0; k < nc; k++, xc += nx)
+          for(int s = 0; s < nx; s++)
+            xc[s] = p[s * nc + k];
+        }
       }
 
-    // Evaluate the GMM for each of the clusters
-    double pdiff = 0;
-    for(int k = 0; k < m_MixtureModel->GetNumberOfGaussians(); k++)
-      {
-      p[k] = EMGaussianMixtures::ComputePosterior(
-            m_MixtureModel->GetNumberOfGaussians(),
-            log_pdf.data_block(), w.data_block(), log_w.data_block(), k);
+    // Evaluate each Gaussian for the whole line
+    for(int k = 0; k < nGauss; k++)
+      m_MixtureModel->GetGaussian(k)->EvaluateLogPDF(
+            x.data(), nx, nx, &log_pdf[k * nx], scratch.data());
 
-      pdiff += p[k] * pfactor[k];
+    for(int s = 0; s < nx; s++)
+      {
+      for(int k = 0; k < nGauss; k++)
+        log_pdf_voxel[k] = log_pdf[k * nx + s];
+
+      // Evaluate the GMM for each of the clusters
+      double pdiff = 0;
+      for(int k = 0; k < nGauss; k++)
+        {
+        double p = EMGaussianMixtures::ComputePosterior(
+              nGauss, log_pdf_voxel.data_block(), w.data_block(), log_w.data_block(), k);
+
+        pdiff += p * pfactor[k];
+        }
+
+      // Store the value
+      it_out.Set((OutputPixelType)(pdiff * 0x7fff));
+      ++it_out;
       }
 
-    // Store the value
-    it_out.Set((OutputPixelType)(pdiff * 0x7fff));
-
-    ++it_out;
-    ++cit;
+    it_out.NextLine();
     }
 }
 
@@ -9,6 +9,124 @@
 // Includes from the random forest library
 #include "Library/classification.h"
 #include "Library/data.h"
+#include "itkMultiThreaderBase.h"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <queue>
+#include <thread>
+
+namespace
+{
+
+// Number of labeled voxels sampled for training, and the number of these
+// that each tree of the forest is trained on
+const size_t RF_SAMPLE_POOL_SIZE = 50000;
+const size_t RF_MAX_SAMPLES_PER_TREE = 10000;
+
+// A fixed pseudo-random priority for each voxel (splitmix64 finalizer). The
+// voxels with the lowest priorities are sampled, so that the sample does not
+// change between trainings unless the labels do, and only changes a little
+// when a few voxels are labeled
+inline unsigned long long VoxelPriority(long offset)
+{
+  unsigned long long z = (unsigned long long) offset + 0x9E3779B97F4A7C15ULL;
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+// Reservoir of the voxels of one class with the lowest priorities
+struct ClassReservoir
+{
+  typedef std::pair<unsigned long long, long> Entry;
+  std::priority_queue<Entry> heap;
+  size_t count = 0;
+
+  void Insert(long offset, size_t capacity)
+  {
+    unsigned long long priority = VoxelPriority(offset);
+    count++;
+    if(heap.size() < capacity)
+      heap.push(Entry(priority, offset));
+    else if(priority < heap.top().first)
+      {
+      heap.pop();
+      heap.push(Entry(priority, offset));
+      }
+  }
+};
+
+// Sample the labeled voxels in a region of the segmentation by walking over
+// its runs. The number of voxels taken from each class is proportional to the
+// size of the class. The result holds (offset, label) pairs in the order of
+// the offsets, which are relative to the buffered region
+void SampleTrainingVoxels(const LabelImageWrapper::ImageType *seg,
+                          const itk::ImageRegion<3> &region,
+                          std::vector<std::pair<long, LabelType> > &voxels)
+{
+  typedef LabelImageWrapper::ImageType::RLLine RLLine;
+  const RLLine *lines = seg->GetBuffer()->GetBufferPointer();
+
+  // The region relative to the buffered region
+  const itk::ImageRegion<3> &buffered = seg->GetBufferedRegion();
+  long nx = buffered.GetSize(0), ny = buffered.GetSize(1);
+  long r0[3], r1[3];
+  for(unsigned int d = 0; d < 3; d++)
+    {
+    r0[d] = region.GetIndex(d) - buffered.GetIndex(d);
+    r1[d] = r0[d] + region.GetSize(d);
+    }
+
+  std::map<LabelType, ClassReservoir> reservoirs;
+  for(long z = r0[2]; z < r1[2]; z++)
+    {
+    for(long y = r0[1]; y < r1[1]; y++)
+      {
+      const RLLine &line = lines[y + ny * z];
+      long line_offset = nx * (y + ny * z);
+      long t = 0;
+      for(size_t s = 0; s < line.size() && t < r1[0]; s++)
+        {
+        long t_end = t + line[s].first;
+        LabelType label = line[s].second;
+        if(label)
+          {
+          ClassReservoir &res = reservoirs[label];
+          for(long x = std::max(t, r0[0]); x < std::min(t_end, r1[0]); x++)
+            res.Insert(line_offset + x, RF_SAMPLE_POOL_SIZE);
+          }
+        t = t_end;
+        }
+      }
+    }
+
+  size_t total = 0;
+  for(auto &it : reservoirs)
+    total += it.second.count;
+
+  // Each reservoir holds at least its share of the pool, so the share can be
+  // taken from its lowest priority voxels
+  voxels.clear();
+  for(auto &it : reservoirs)
+    {
+    ClassReservoir &res = it.second;
+    size_t keep = res.count;
+    if(total > RF_SAMPLE_POOL_SIZE)
+      keep = std::max((size_t) 1, (size_t) (RF_SAMPLE_POOL_SIZE * (double) res.count / total + 0.5));
+
+    while(res.heap.size() > keep)
+      res.heap.pop();
+    for(; !res.heap.empty(); res.heap.pop())
+      voxels.push_back(std::make_pair(res.heap.top().second, it.first));
+    }
+
+  std::sort(voxels.begin(), voxels.end());
+}
+
+}
 
 template <class TPixel, class TLabel, int VDim>
 RFClassificationEngine<TPixel,TLabel,VDim>::RFClassificationEngine()
@@ -39,6 +157,10 @@ void RFClassificationEngine<TPixel,TLabel,VDim>::SetDataSource(SNAPImageData *im
 
     // Reset the classifier
     m_Classifier->Reset();
+
+    // Features from the old data source can not be used
+    m_FeatureCache.clear();
+    m_FeatureCacheKey.clear();
     }
 }
 
@@ -46,6 +168,38 @@ template <class TPixel, class TLabel, int VDim>
 void RFClassificationEngine<TPixel,TLabel,VDim>::ResetClassifier()
 {
   m_Classifier->Reset();
+  m_FeatureCache.clear();
+  m_FeatureCacheKey.clear();
+}
+
+template <class TPixel, class TLabel, int VDim>
+std::vector<unsigned long>
+RFClassificationEngine<TPixel,TLabel,VDim>::ComputeFeatureCacheKey() const
+{
+  std::vector<unsigned long> key;
+  for(unsigned int d = 0; d < 3; d++)
+    key.push_back(m_PatchRadius[d]);
+  key.push_back(m_UseCoordinateFeatures);
+
+  // Voxel offsets refer to the buffered region of the segmentation
+  const itk::ImageRegion<3> &seg_region =
+      m_DataSource->GetFirstSegmentationLayer()->GetImage()->GetBufferedRegion();
+  for(unsigned int d = 0; d < 3; d++)
+    {
+    key.push_back(seg_region.GetIndex(d));
+    key.push_back(seg_region.GetSize(d));
+    }
+
+  // Features are no longer valid when the image data changes
+  for(LayerIterator it = m_DataSource->GetLayers(MAIN_ROLE | OVERLAY_ROLE);
+      !it.IsAtEnd(); ++it)
+    {
+    key.push_back(it.GetLayer()->GetUniqueId());
+    key.push_back(it.GetLayer()->GetTimePointIndex());
+    key.push_back(it.GetLayer()->GetImageBase()->GetMTime());
+    }
+
+  return key;
 }
 
 template <class TPixel, class TLabel, int VDim>
@@ -59,10 +213,6 @@ void RFClassificationEngine<TPixel,TLabel,VDim>:: TrainClassifier()
   typedef itk::Image<float, 3> FloatImage;
   typedef itk::VectorImage<float, 3> FloatVectorImage;
 
-  // TODO: in the future, we should only recompute the sample when we know
-  // that the data has changed. However, currently, we are just going to
-  // compute a new sample every time
-
   // Delete the sample
   if(m_Sample)
     delete m_Sample;
@@ -71,21 +221,14 @@ void RFClassificationEngine<TPixel,TLabel,VDim>:: TrainClassifier()
   // TODO: this is defaulting to the first image - is this correct?
   LabelImageWrapper *wrpSeg = m_DataSource->GetFirstSegmentationLayer();
   const LabelImageWrapper::ImageType *imgSeg = wrpSeg->GetImage();
-  typedef itk::ImageRegionConstIteratorWithIndex<LabelImageWrapper::ImageType> LabelIter;
 
   // Shrink the buffered region by radius because we can't handle BCs
   itk::ImageRegion<3> reg = imgSeg->GetBufferedRegion();
   reg.ShrinkByRadius(m_PatchRadius);
 
-  // We need to iterate throught the label image once to determine the
-  // number of samples to allocate.
-  unsigned long nSamples = 0;
-  for(LabelIter lit(imgSeg, reg); !lit.IsAtEnd(); ++lit)
-    if(lit.Value())
-      nSamples++;
-
-  // TODO: if the number of samples is greater than max number of training samples,
-  // we should choose a random subset of samples.
+  // Pick the voxels to train on. Features are only extracted for these
+  std::vector<std::pair<long, LabelType> > voxels;
+  SampleTrainingVoxels(imgSeg, reg, voxels);
 
   // Compute the patch size
   int patch_size = 1;
@@ -97,12 +240,11 @@ void RFClassificationEngine<TPixel,TLabel,VDim>:: TrainClassifier()
   {
     ImageWrapperBase *layer;
     ImageWrapperBase::PatchOffsetTable offset_table;
-    int n_comp, i_comp;
-    vnl_matrix<double> sample_matrix;
+    int n_comp, i_comp, n_layer_comp;
   };
 
   // Compute the offset tables and dimensions of the patches
-  int total_comp = 0;
+  int total_comp = 0, max_comp = 0;
   std::vector<SampleData> sample_data;
   for(auto it = m_DataSource->GetLayers(MAIN_ROLE | OVERLAY_ROLE); !it.IsAtEnd(); ++it)
     {
@@ -110,67 +252,119 @@ void RFClassificationEngine<TPixel,TLabel,VDim>:: TrainClassifier()
     ImageWrapperBase::PatchOffsetTable offset_table = it.GetLayer()->GetPatchOffsetTable(m_PatchRadius);
 
     // Number of components sampled per pixel from this image
-    int n_comp = it.GetLayer()->GetNumberOfComponents() * patch_size;
+    int n_layer_comp = it.GetLayer()->GetNumberOfComponents();
+    int n_comp = n_layer_comp * patch_size;
 
     // Save the sample data structure
-    SampleData sd = { it.GetLayer(), offset_table, n_comp, total_comp };
+    SampleData sd = { it.GetLayer(), offset_table, n_comp, total_comp, n_layer_comp };
     sample_data.push_back(sd);
 
-    // Allocate the storage for the data
-    sample_data.back().sample_matrix.set_size(patch_size, it.GetLayer()->GetNumberOfComponents());
-
     // Update total components
     total_comp += n_comp;
+    max_comp = std::max(max_comp, n_comp);
     }
 
   // Allocate the patches
   int nColumns = m_UseCoordinateFeatures ? total_comp + 3 : total_comp;
 
-  // Create a new sample
-  m_Sample = new SampleType(nSamples, nColumns);
-
-  // Allocate the sample storage and matrices that point to its storage
-  vnl_vector<double> current_sample(total_comp);
-
-  // Now fill out the samples
-  int iSample = 0;
-  for(LabelIter lit(imgSeg, reg); !lit.IsAtEnd(); ++lit)
+  // Features cached by the previous training can be reused if the images
+  // and the feature settings have not changed since
+  std::vector<unsigned long> cache_key = this->ComputeFeatureCacheKey();
+  if(cache_key != m_FeatureCacheKey)
     {
-    LabelType label = lit.Value();
-    if(label)
-      {
-      // Fill in the data
-      auto &column = m_Sample->data[iSample];
+    m_FeatureCache.clear();
+    m_FeatureCacheKey = cache_key;
+    }
 
-      // Sample from each image
-      int k = 0;
-      for(auto &sd : sample_data)
+  // Create a new sample
+  m_Sample = new SampleType(voxels.size(), nColumns);
+
+  // Fill out the samples on several threads. The cache is only read here
+  const itk::ImageRegion<3> &buffered = imgSeg->GetBufferedRegion();
+  std::atomic<size_t> next_voxel(0);
+  std::exception_ptr error;
+  std::mutex error_mutex;
+  auto worker = [&]()
+  {
+    std::vector<double> patch(max_comp);
+    try
+      {
+      for(size_t iSample = next_voxel++; iSample < voxels.size(); iSample = next_voxel++)
         {
-        // Sample this patch
-        double *p = sd.sample_matrix.data_block();
-        sd.layer->SamplePatchAsDouble(lit.GetIndex(), sd.offset_table, p);
-
-        // This in-place transpose operation is required because the RF classes expect the
-        // sample to be ordered first by component and then by patch location, but the
-        // SamplePatchAsDouble samples first by patch location, then by component
-        if(sd.sample_matrix.rows() > 1)
-          sd.sample_matrix.inplace_transpose();
-
-        // Copy data to actual sample
-        for(unsigned int i = 0; i < sd.n_comp; i++)
-          column[k++] = (float) p[i];
+        auto &column = m_Sample->data[iSample];
+        m_Sample->label[iSample] = voxels[iSample].second;
+
+        auto cached = m_FeatureCache.find(voxels[iSample].first);
+        if(cached != m_FeatureCache.end())
+          {
+          for(int k = 0; k < nColumns; k++)
+            column[k] = cached->second[k];
+          continue;
+          }
+
+        // Get the index of the voxel from its offset
+        itk::Index<3> idx;
+        long offset = voxels[iSample].first;
+        for(unsigned int d = 0; d < 3; d++)
+          {
+          idx[d] = buffered.GetIndex(d) + offset % buffered.GetSize(d);
+          offset /= buffered.GetSize(d);
+          }
+
+        // Sample from each image
+        int k = 0;
+        for(auto &sd : sample_data)
+          {
+          sd.layer->SamplePatchAsDouble(idx, sd.offset_table, patch.data());
+
+          // The RF classes expect the sample to be ordered first by component
+          // and then by patch location, but SamplePatchAsDouble samples first
+          // by patch location, then by component
+          for(int c = 0; c < sd.n_layer_comp; c++)
+            for(int j = 0; j < patch_size; j++)
+              column[k++] = (float) patch[j * sd.n_layer_comp + c];
+          }
+
+        // Add the coordinate features if used
+        if(m_UseCoordinateFeatures)
+          for(int d = 0; d < 3; d++)
+            column[k++] = idx[d];
         }
-
-      // Add the coordinate features if used
-      if(m_UseCoordinateFeatures)
-        for(int d = 0; d < 3; d++)
-          column[k++] = lit.GetIndex()[d];
-
-      // Fill in the label
-      m_Sample->label[iSample] = label;
-      ++iSample;
       }
+    catch(...)
+      {
+      std::lock_guard<std::mutex> lock(error_mutex);
+      if(!error)
+        error = std::current_exception();
+      next_voxel = voxels.size();
+      }
+  };
+
+  unsigned int n_threads = std::min(
+        (size_t) itk::MultiThreaderBase::GetGlobalDefaultNumberOfThreads(),
+        voxels.size() / 256 + 1);
+  std::vector<std::thread> workers;
+  for(unsigned int t = 1; t < n_threads; t++)
+    workers.emplace_back(worker);
+  worker();
+  for(auto &w : workers)
+    w.join();
+
+  if(error)
+    std::rethrow_exception(error);
+
+  // Keep the features of the current sample for the next training
+  std::unordered_map<long, std::vector<float> > cache;
+  cache.reserve(voxels.size());
+  for(size_t iSample = 0; iSample < voxels.size(); iSample++)
+    {
+    auto &column = m_Sample->data[iSample];
+    std::vector<float> &features = cache[voxels[iSample].first];
+    features.resize(nColumns);
+    for(int k = 0; k < nColumns; k++)
+      features[k] = column[k];
     }
+  m_FeatureCache.swap(cache);
 
   // Check that the sample has at least two distinct labels
   bool isValidSample = false;
@@ -197,8 +391,8 @@ void RFClassificationEngine<TPixel,TLabel,VDim>:: TrainClassifier()
   params.verbose = true;
 
   // Cap the number of training voxels at some reasonable number
-  if(m_Sample->Size() > 10000)
-    params.subSamplePercent = 100 * 10000.0 / m_Sample->Size();
+  if(m_Sample->Size() > RF_MAX_SAMPLES_PER_TREE)
+    params.subSamplePercent = 100.0 * RF_MAX_SAMPLES_PER_TREE / m_Sample->Size();
   else
     params.subSamplePercent = 0;
 
@@ -5,6 +5,8 @@
 #include <itkObjectFactory.h>
 #include "SNAPCommon.h"
 #include <itkSize.h>
+#include <unordered_map>
+#include <vector>
 
 template <class TPixel, class TLabel, int VDim> class RandomForestClassifier;
 template <class TData, class TLabel> class MLData;
@@ -93,6 +95,15 @@ protected:
   typedef MLData<float, LabelType> SampleType;
   SampleType *m_Sample;
 
+  // Features extracted for the voxels sampled in the last training, by voxel
+  // offset in the segmentation, and the settings and layers they came from.
+  // Voxels that are sampled again are not extracted again if these match
+  std::unordered_map<long, std::vector<float> > m_FeatureCache;
+  std::vector<unsigned long> m_FeatureCacheKey;
+
+  // Compute the key that tells whether the cached features are still valid
+  std::vector<unsigned long> ComputeFeatureCacheKey() const;
+
 };
 
 #endif // RFCLASSIFICATIONENGINE_H
@@ -3,6 +3,8 @@
 
 #include <utility> //std::pair
 #include <vector>
+#include <mutex>
+#include <atomic>
 #include <itkImageBase.h>
 #include <itkImage.h>
 
@@ -107,6 +109,7 @@ public:
         Superclass::Initialize();
         m_OnTheFlyCleanup = true;
         myBuffer = BufferType::New();
+        DiscardLineIndex();
     }
 
     /** Fill the image buffer with a value.  Be sure to call Allocate()
@@ -144,9 +147,39 @@ public:
     * This method is used by iterators directly. */
     int SetPixel(RLLine & line, IndexValueType & segmentRemainder, IndexValueType & realIndex, const TPixel & value);
 
-    /** \brief Get a pixel. SLOW! Better use iterators for pixel access. */
+    /** Copy pixels [start, start+length) of a line into a buffer.
+    * The start is relative to the beginning of the line. */
+    static void GetLineSpan(const RLLine & line, IndexValueType start, SizeValueType length, TPixel *out);
+
+    /** Replace pixels [start, start+length) of a line with the given values.
+    * The line is rebuilt in a single linear merge, which is much faster than
+    * calling SetPixel for every pixel of a painted span. */
+    void SetLineSpan(RLLine & line, IndexValueType start, SizeValueType length, const TPixel *values);
+
+    /** Same as above, with the span starting at the given image index. */
+    void SetLineSpan(const IndexType & index, SizeValueType length, const TPixel *values);
+
+    /** \brief Get a pixel. SLOW! Better use iterators for pixel access.
+    * With the line index turned on, the lookup is a binary search. */
     const TPixel & GetPixel(const IndexType & index) const;
 
+    /** Should GetPixel use a per-line index of segment ends?
+    * The index is built lazily for each line queried by GetPixel, and
+    * costs one IndexValueType per segment of every indexed line. Lines
+    * modified through this class are re-indexed on their next query.
+    * Code that modifies RLLine-s directly through GetBuffer() must call
+    * Modified() afterwards, which discards the whole index. Lookups and
+    * invalidation of single lines do not lock; only discarding the whole
+    * index does. Off by default. */
+    bool GetUseLineIndex() const { return m_UseLineIndex; }
+
+    /** Should GetPixel use a per-line index of segment ends? */
+    void SetUseLineIndex(bool value)
+    {
+        m_UseLineIndex = value;
+        DiscardLineIndex();
+    }
+
     ///** Get a reference to a pixel. Chaning it changes the whole RLE segment! */
     //TPixel & GetPixel(const IndexType & index);
 
@@ -231,6 +264,8 @@ protected:
     RLEImage() : itk::ImageBase < VImageDimension >()
     {
         m_OnTheFlyCleanup = true;
+        m_UseLineIndex = false;
+        m_LineIndexTime = 0;
         myBuffer = BufferType::New();
     }
     void PrintSelf(std::ostream & os, itk::Indent indent) const ITK_OVERRIDE;
@@ -250,9 +285,57 @@ protected:
     /** Merges adjacent segments with duplicate values in a single line. */
     void CleanUpLine(RLLine & line) const;
 
+    /** Rebuild a line, replacing pixels [start, start+length) with the values
+    * returned by the functor, called as f(i, oldValue) for i in [0, length). */
+    template <class TFunctor>
+    void MergeLineSpan(RLLine & line, IndexValueType start, SizeValueType length, TFunctor f);
+
+    /** Mark the index of a line as out of date after the line was modified.
+    * Only the entry of this line is touched, without locking, so different
+    * lines may be modified from several threads at once (e.g. in CleanUp).
+    * Like any write to the image, this must not run concurrently with
+    * GetPixel, and the UseLineIndex flag should not be toggled meanwhile. */
+    void InvalidateLineIndex(const RLLine & line) const
+    {
+        if (!m_UseLineIndex || m_LineIndex.empty())
+            return;
+        itk::OffsetValueType offset = &line - myBuffer->GetBufferPointer();
+        if (offset >= 0 && offset < itk::OffsetValueType(m_LineIndex.size()))
+            m_LineIndex[offset].State.store(LineIndexStale, std::memory_order_release);
+    }
+
+    /** Discard the index of all lines, e.g. when the buffer is replaced.
+    * The next lookup allocates a new index for the current buffer. */
+    void DiscardLineIndex()
+    {
+        std::lock_guard<std::mutex> guard(m_LineIndexMutex);
+        m_LineIndex.clear();
+        m_LineIndexTime = 0;
+    }
+
+    /** Look up a pixel in a line using the line index. */
+    const TPixel & GetPixelIndexed(const RLLine & line, IndexValueType x) const;
+
 private:
     bool m_OnTheFlyCleanup; //should same-valued segments be merged on the fly
 
+    /** Cumulative segment ends of a line, i.e. Ends[i] is the position
+    * just past the i-th segment. Used for binary search in GetPixel.
+    * The state tells whether Ends is up to date, and lets a single thread
+    * claim the entry to rebuild it while others scan the line. */
+    enum LineIndexState { LineIndexStale, LineIndexBuilding, LineIndexValid };
+    struct LineIndexEntry
+    {
+        std::atomic<int> State;
+        std::vector<IndexValueType> Ends;
+        LineIndexEntry() : State(LineIndexStale) {}
+    };
+
+    bool m_UseLineIndex; //should GetPixel use the per-line index
+    mutable std::vector<LineIndexEntry> m_LineIndex; //one entry per RLLine
+    mutable std::atomic<itk::ModifiedTimeType> m_LineIndexTime; //MTime when the index was last reset
+    mutable std::mutex m_LineIndexMutex; //guards resetting the whole index
+
     RLEImage(const Self &);          //purposely not implemented
     void operator=(const Self &); //purposely not implemented
 
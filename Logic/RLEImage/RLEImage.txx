@@ -3,6 +3,7 @@
 
 #include "RLEImage.h"
 #include "itkImageRegionConstIterator.h"
+#include <algorithm>
 
 template< typename TPixel, unsigned int VImageDimension, typename CounterType >
 inline typename RLEImage<TPixel, VImageDimension, CounterType>::BufferType::IndexType
@@ -56,6 +57,7 @@ void RLEImage<TPixel, VImageDimension, CounterType>::Allocate(bool initialize)
         line[0] = segment;
         myBuffer->FillBuffer(line);
     }
+    DiscardLineIndex();
 }
 
 template< typename TPixel, unsigned int VImageDimension, typename CounterType >
@@ -66,6 +68,7 @@ void RLEImage<TPixel, VImageDimension, CounterType>
     RLLine line(1);
     line[0] = segment;
     myBuffer->FillBuffer(line);
+    DiscardLineIndex();
 }
 
 template< typename TPixel, unsigned int VImageDimension, typename CounterType >
@@ -81,6 +84,7 @@ void RLEImage<TPixel, VImageDimension, CounterType>::CleanUpLine(RLLine & line)
             out.back().first += line[x].first;
     } while (x < line.size());
     out.swap(line);
+    InvalidateLineIndex(line);
 }
 
 template< typename TPixel, unsigned int VImageDimension, typename CounterType >
@@ -105,7 +109,8 @@ SetPixel(RLLine & line, IndexValueType & segmentRemainder, IndexValueType & real
         "BufferedRegion must contain complete run-length lines!");
     if (line[realIndex].second == value) //already correct value
         return 0;
-    else if (line[realIndex].first == 1) //single pixel segment
+    InvalidateLineIndex(line);
+    if (line[realIndex].first == 1) //single pixel segment
     {
         line[realIndex].second = value;
         if (m_OnTheFlyCleanup)//now see if we can merge it into adjacent segments
@@ -209,6 +214,101 @@ SetPixel(const IndexType & index, const TPixel & value)
     throw itk::ExceptionObject(__FILE__, __LINE__, "Reached past the end of Run-Length line!", __FUNCTION__);
 }
 
+template< typename TPixel, unsigned int VImageDimension, typename CounterType >
+void RLEImage<TPixel, VImageDimension, CounterType>::
+GetLineSpan(const RLLine & line, IndexValueType start, SizeValueType length, TPixel *out)
+{
+    SizeValueType x = 0, t = 0;
+    while (t + line[x].first <= SizeValueType(start)) //find the segment containing start
+        t += line[x++].first;
+    SizeValueType remainder = t + line[x].first - start;
+    while (length > 0)
+    {
+        SizeValueType n = std::min(remainder, length);
+        std::fill(out, out + n, line[x].second);
+        out += n;
+        length -= n;
+        if (length > 0)
+            remainder = line[++x].first;
+    }
+}
+
+template< typename TPixel, unsigned int VImageDimension, typename CounterType >
+template< class TFunctor >
+void RLEImage<TPixel, VImageDimension, CounterType>::
+MergeLineSpan(RLLine & line, IndexValueType start, SizeValueType length, TFunctor f)
+{
+    //complete Run-Length Lines have to be buffered
+    itkAssertOrThrowMacro(this->GetBufferedRegion().GetSize(0)
+        == this->GetLargestPossibleRegion().GetSize(0),
+        "BufferedRegion must contain complete run-length lines!");
+
+    RLLine out;
+    out.reserve(line.size() + 2);
+
+    //append a run, merging it into the previous one if the value is the same
+    auto emit = [&out](SizeValueType n, const TPixel & value)
+    {
+        if (n == 0)
+            return;
+        if (!out.empty() && out.back().second == value)
+            out.back().first += n;
+        else
+            out.push_back(RLSegment(CounterType(n), value));
+    };
+
+    //current segment of the old line and pixels remaining in it
+    SizeValueType x = 0, remainder = line[0].first;
+    auto advance = [&line, &x, &remainder](SizeValueType n)
+    {
+        remainder -= n;
+        if (remainder == 0 && ++x < line.size())
+            remainder = line[x].first;
+    };
+
+    //copy the segments before the span
+    for (SizeValueType k = start; k > 0;)
+    {
+        SizeValueType n = std::min(k, remainder);
+        emit(n, line[x].second);
+        advance(n);
+        k -= n;
+    }
+
+    //the span itself
+    for (SizeValueType i = 0; i < length; i++)
+    {
+        emit(1, f(i, line[x].second));
+        advance(1);
+    }
+
+    //copy the segments after the span
+    while (x < line.size())
+    {
+        emit(remainder, line[x].second);
+        advance(remainder);
+    }
+
+    line.swap(out);
+    InvalidateLineIndex(line);
+}
+
+template< typename TPixel, unsigned int VImageDimension, typename CounterType >
+void RLEImage<TPixel, VImageDimension, CounterType>::
+SetLineSpan(RLLine & line, IndexValueType start, SizeValueType length, const TPixel *values)
+{
+    MergeLineSpan(line, start, length,
+        [values](SizeValueType i, const TPixel &) { return values[i]; });
+}
+
+template< typename TPixel, unsigned int VImageDimension, typename CounterType >
+void RLEImage<TPixel, VImageDimension, CounterType>::
+SetLineSpan(const IndexType & index, SizeValueType length, const TPixel *values)
+{
+    RLLine & line = myBuffer->GetPixel(truncateIndex(index));
+    SetLineSpan(line, index[0] - this->GetBufferedRegion().GetIndex(0), length, values);
+}
+
 template< typename TPixel, unsigned int VImageDimension, typename CounterType >
 const TPixel & RLEImage<TPixel, VImageDimension, CounterType>::
 GetPixel(const IndexType & index) const
@@ -220,6 +320,8 @@ GetPixel(const IndexType & index) const
     IndexValueType bri0 = this->GetBufferedRegion().GetIndex(0);
     typename BufferType::IndexType bi = truncateIndex(index);
     RLLine & line = myBuffer->GetPixel(bi);
+    if (m_UseLineIndex)
+        return GetPixelIndexed(line, index[0] - bri0);
     IndexValueType t = 0;
     for (IndexValueType x = 0; x < line.size(); x++)
     {
@@ -230,6 +332,58 @@ GetPixel(const IndexType & index) const
     throw itk::ExceptionObject(__FILE__, __LINE__, "Reached past the end of Run-Length line!", __FUNCTION__);
 }
 
+template< typename TPixel, unsigned int VImageDimension, typename CounterType >
+const TPixel & RLEImage<TPixel, VImageDimension, CounterType>::
+GetPixelIndexed(const RLLine & line, IndexValueType x) const
+{
+    //lines written directly through GetBuffer() are only signaled by Modified(),
+    //in which case the index of every line is discarded. The time is stored
+    //after the reset, so readers that see the current time see a reset index
+    itk::ModifiedTimeType mtime = std::max(this->GetMTime(), myBuffer->GetMTime());
+    if (mtime != m_LineIndexTime.load(std::memory_order_acquire))
+    {
+        std::lock_guard<std::mutex> guard(m_LineIndexMutex);
+        if (mtime != m_LineIndexTime.load(std::memory_order_relaxed))
+        {
+            SizeValueType nLines = myBuffer->GetPixelContainer()->Size();
+            if (m_LineIndex.size() != nLines)
+                std::vector<LineIndexEntry>(nLines).swap(m_LineIndex);
+            else
+                for (SizeValueType i = 0; i < nLines; i++)
+                    m_LineIndex[i].State.store(LineIndexStale, std::memory_order_relaxed);
+            m_LineIndexTime.store(mtime, std::memory_order_release);
+        }
+    }
+
+    //build the index of this line if needed. If another thread is building
+    //it, scan the line instead of waiting
+    LineIndexEntry & entry = m_LineIndex[&line - myBuffer->GetBufferPointer()];
+    if (entry.State.load(std::memory_order_acquire) != LineIndexValid)
+    {
+        int expected = LineIndexStale;
+        if (!entry.State.compare_exchange_strong(expected, LineIndexBuilding, std::memory_order_acquire))
+        {
+            IndexValueType t = 0;
+            for (SizeValueType s = 0; s < line.size(); s++)
+                if ((t += line[s].first) > x)
+                    return line[s].second;
+            throw itk::ExceptionObject(__FILE__, __LINE__, "Reached past the end of Run-Length line!", __FUNCTION__);
+        }
+        entry.Ends.resize(line.size());
+        IndexValueType t = 0;
+        for (SizeValueType s = 0; s < line.size(); s++)
+            entry.Ends[s] = (t += line[s].first);
+        entry.State.store(LineIndexValid, std::memory_order_release);
+    }
+
+    //first segment which ends past x
+    typename std::vector<IndexValueType>::const_iterator it =
+        std::upper_bound(entry.Ends.begin(), entry.Ends.end(), x);
+    if (it == entry.Ends.end())
+        throw itk::ExceptionObject(__FILE__, __LINE__, "Reached past the end of Run-Length line!", __FUNCTION__);
+    return line[it - entry.Ends.begin()].second;
+}
+
 template< typename TPixel, unsigned int VImageDimension, typename CounterType >
 void RLEImage<TPixel, VImageDimension, CounterType>
 ::PrintSelf(std::ostream & os, itk::Indent indent) const
@@ -251,6 +405,7 @@ void RLEImage<TPixel, VImageDimension, CounterType>
         / (this->GetOffsetTable()[VImageDimension] * sizeof(PixelType));
 
     os << indent << "OnTheFlyCleanup: " << (m_OnTheFlyCleanup ? "On" : "Off") << std::endl;
+    os << indent << "UseLineIndex: " << (m_UseLineIndex ? "On" : "Off") << std::endl;
     os << indent << "RLEImage compressed pixel count: " << c << std::endl;
     int prec = os.precision(3);
     os << indent << "Compressed size in relation to original size: "<< cr*100 <<"%" << std::endl;
@@ -49,6 +49,7 @@
 #include "IRISSlicer.h"
 #include "NonOrthogonalSlicer.h"
 #include "SNAPCommon.h"
+#include <list>
 
 class ImageCoordinateTransform;
 
@@ -159,6 +160,16 @@ public:
   /** Access the internal oblique slicer */
   itkGetMacro(ObliqueSlicer, NonOrthogonalSlicerType *)
 
+  /**
+   * Number of recently extracted orthogonal slices that are kept, so that
+   * returning to a recent slice does not require slicing the image again.
+   * Slices are keyed by the slice index and the MTime of the input, so any
+   * change to the image (including a change of time point) makes them stale.
+   * Setting the size to zero disables the cache.
+   */
+  void SetSliceCacheSize(unsigned int size);
+  itkGetMacro(SliceCacheSize, unsigned int)
+
 protected:
 
   AdaptiveSlicingPipeline();
@@ -184,6 +195,28 @@ protected:
   IndexType m_SliceIndex;
 
   void MapInputsToSlicers();  
+
+  // A slice in the cache
+  struct CachedSlice
+  {
+    unsigned int SliceIndex;
+    itk::ModifiedTimeType InputMTime;
+    OutputImagePointer Slice;
+  };
+
+  // Cache of recently extracted orthogonal slices, most recent first
+  std::list<CachedSlice> m_SliceCache;
+  unsigned int m_SliceCacheSize;
+
+  // Orientation of the orthogonal slicer for which the cache is valid
+  unsigned int m_SliceCacheOrientation;
+
+  // Find a slice in the cache, moving it to the front of the list
+  OutputImageType *FindCachedSlice(unsigned int index, itk::ModifiedTimeType mtime);
+
+  // Store a slice in the cache. The slice must be disconnected from the
+  // slicer, which would otherwise overwrite it
+  void CacheSlice(unsigned int index, itk::ModifiedTimeType mtime, OutputImageType *slice);
 };
 
 
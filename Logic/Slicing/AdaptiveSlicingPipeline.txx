@@ -56,6 +56,10 @@ AdaptiveSlicingPipeline<TInputImage, TOutputImage, TPreviewImage>
 
   // Initially use the ortho
   m_UseOrthogonalSlicing = true;
+
+  // Slice cache
+  m_SliceCacheSize = 8;
+  m_SliceCacheOrientation = 0;
 }
 
 template<typename TInputImage, typename TOutputImage, typename TPreviewImage>
@@ -205,8 +209,42 @@ AdaptiveSlicingPipeline<TInputImage, TOutputImage, TPreviewImage>
   // Get the outer filter's output
   OutputImageType *output = this->GetOutput();
 
-  // Use appropriate sub-pipeline
-  if(m_UseOrthogonalSlicing)
+  // Use appropriate sub-pipeline. The slice cache is not used with the
+  // preview input, which changes while it is being computed
+  if(m_UseOrthogonalSlicing && m_SliceCacheSize > 0 && !this->GetPreviewImage())
+    {
+    // A change in the orientation of the slicer makes all cached slices invalid
+    unsigned int orientation =
+        m_OrthogonalSlicer->GetSliceDirectionImageAxis()
+        + 3 * m_OrthogonalSlicer->GetLineDirectionImageAxis()
+        + 9 * m_OrthogonalSlicer->GetPixelDirectionImageAxis()
+        + 27 * m_OrthogonalSlicer->GetLineTraverseForward()
+        + 54 * m_OrthogonalSlicer->GetPixelTraverseForward();
+    if(orientation != m_SliceCacheOrientation)
+      {
+      m_SliceCache.clear();
+      m_SliceCacheOrientation = orientation;
+      }
+
+    unsigned int index = m_OrthogonalSlicer->GetSliceIndex();
+    itk::ModifiedTimeType mtime = this->GetInput()->GetMTime();
+    OutputImageType *cached = this->FindCachedSlice(index, mtime);
+    if(cached)
+      {
+      output->Graft(cached);
+      }
+    else
+      {
+      // The cache takes over the slicer's output, and the slicer creates a
+      // new output for the next slice, so the slice is shared, not copied
+      m_OrthogonalSlicer->Update();
+      OutputImagePointer slice = m_OrthogonalSlicer->GetOutput();
+      slice->DisconnectPipeline();
+      output->Graft(slice);
+      this->CacheSlice(index, mtime, slice);
+      }
+    }
+  else if(m_UseOrthogonalSlicing)
     {
     m_OrthogonalSlicer->Update();
     output->Graft(m_OrthogonalSlicer->GetOutput());
@@ -218,4 +256,55 @@ AdaptiveSlicingPipeline<TInputImage, TOutputImage, TPreviewImage>
     }
 }
 
+template<typename TInputImage, typename TOutputImage, typename TPreviewImage>
+void
+AdaptiveSlicingPipeline<TInputImage, TOutputImage, TPreviewImage>
+::SetSliceCacheSize(unsigned int size)
+{
+  m_SliceCacheSize = size;
+  while(m_SliceCache.size() > m_SliceCacheSize)
+    m_SliceCache.pop_back();
+}
+
+template<typename TInputImage, typename TOutputImage, typename TPreviewImage>
+typename AdaptiveSlicingPipeline<TInputImage, TOutputImage, TPreviewImage>::OutputImageType *
+AdaptiveSlicingPipeline<TInputImage, TOutputImage, TPreviewImage>
+::FindCachedSlice(unsigned int index, itk::ModifiedTimeType mtime)
+{
+  for(auto it = m_SliceCache.begin(); it != m_SliceCache.end(); ++it)
+    {
+    if(it->SliceIndex == index && it->InputMTime == mtime)
+      {
+      // Move the slice to the front of the list as the most recently used
+      m_SliceCache.splice(m_SliceCache.begin(), m_SliceCache, it);
+      return m_SliceCache.front().Slice;
+      }
+    }
+  return NULL;
+}
+
+template<typename TInputImage, typename TOutputImage, typename TPreviewImage>
+void
+AdaptiveSlicingPipeline<TInputImage, TOutputImage, TPreviewImage>
+::CacheSlice(unsigned int index, itk::ModifiedTimeType mtime, OutputImageType *slice)
+{
+  // Slices of an older version of the input will never be used again
+  for(auto it = m_SliceCache.begin(); it != m_SliceCache.end(); )
+    {
+    if(it->SliceIndex == index || it->InputMTime != mtime)
+      it = m_SliceCache.erase(it);
+    else
+      ++it;
+    }
+
+  CachedSlice entry;
+  entry.SliceIndex = index;
+  entry.InputMTime = mtime;
+  entry.Slice = slice;
+  m_SliceCache.push_front(entry);
+
+  while(m_SliceCache.size() > m_SliceCacheSize)
+    m_SliceCache.pop_back();
+}
+
 #endif // ADAPTIVESLICINGPIPELINE_TXX
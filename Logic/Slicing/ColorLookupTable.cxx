@@ -1,5 +1,33 @@
 #include "ColorLookupTable.h"
 #include "itkRGBAPixel.h"
+#include "itkNumericTraitsRGBAPixel.h"
+#include <cstring>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+
+// Load eight integer intensities, widened to 32 bits
+inline __m256i LoadIntensitiesAVX2(const unsigned char *p)
+{ return _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) p)); }
+
+inline __m256i LoadIntensitiesAVX2(const char *p)
+{ return _mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i *) p)); }
+
+inline __m256i LoadIntensitiesAVX2(const unsigned short *p)
+{ return _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *) p)); }
+
+inline __m256i LoadIntensitiesAVX2(const short *p)
+{ return _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *) p)); }
+
+// Reinterpret a four-byte display pixel as an integer
+template <class TDisplayPixel>
+inline int DisplayPixelBitsAVX2(const TDisplayPixel &pixel)
+{
+  int bits;
+  memcpy(&bits, &pixel, sizeof(int));
+  return bits;
+}
+#endif
 
 template<class TInputPixel, class TDisplayPixel>
 void ColorLookupTable<TInputPixel, TDisplayPixel>
@@ -26,6 +54,75 @@ void ColorLookupTable<TInputPixel, TDisplayPixel>
   }
 }
 
+template<class TInputPixel, class TDisplayPixel>
+void ColorLookupTable<TInputPixel, TDisplayPixel>
+::MapIntensitiesToDisplay(const TInputPixel *in, TDisplayPixel *out,
+                          size_t n, bool zero_out_of_range) const
+{
+  size_t i = 0;
+
+#ifdef __AVX2__
+  // The vector kernels gather whole four-byte (RGBA) table entries
+  if constexpr(sizeof(TDisplayPixel) == sizeof(int) && std::is_integral<TInputPixel>::value
+               && sizeof(TInputPixel) <= 2)
+    {
+    const int *lut = reinterpret_cast<const int *>(m_LUT.data());
+    __m256i start = _mm256_set1_epi32((int) m_StartValue);
+    __m256i zero = _mm256_setzero_si256();
+    __m256i all = _mm256_set1_epi32(-1);
+    for(; i + 8 <= n; i += 8)
+      {
+      __m256i x = LoadIntensitiesAVX2(in + i);
+
+      // Zero intensities that fall outside of the table are not looked up
+      __m256i mask = zero_out_of_range
+                     ? _mm256_andnot_si256(_mm256_cmpeq_epi32(x, zero), all) : all;
+      __m256i v = _mm256_mask_i32gather_epi32(zero, lut, _mm256_sub_epi32(x, start), mask, 4);
+      _mm256_storeu_si256((__m256i *)(out + i), v);
+      }
+    }
+  else if constexpr(sizeof(TDisplayPixel) == sizeof(int) && std::is_same<TInputPixel, float>::value)
+    {
+    const int *lut = reinterpret_cast<const int *>(m_LUT.data());
+    __m128 start = _mm_set1_ps(m_StartValue), end = _mm_set1_ps(m_EndValue), zero = _mm_setzero_ps();
+    __m256d scale = _mm256_set1_pd(m_IntensityToLUTIndexScaleFactor);
+    __m128i below = _mm_set1_epi32(DisplayPixelBitsAVX2(m_ColorBelow));
+    __m128i above = _mm_set1_epi32(DisplayPixelBitsAVX2(m_ColorAbove));
+    __m128i nan = _mm_set1_epi32(DisplayPixelBitsAVX2(m_ColorNaN));
+    for(; i + 4 <= n; i += 4)
+      {
+      __m128 x = _mm_loadu_ps(in + i);
+
+      // The index is computed in double precision, as in MapIntensityToDisplay
+      __m128i idx = _mm256_cvttpd_epi32(_mm256_mul_pd(_mm256_cvtps_pd(_mm_sub_ps(x, start)), scale));
+
+      // Only the values in range are looked up, the rest get special colors
+      __m128 in_range = _mm_and_ps(_mm_cmpge_ps(x, start), _mm_cmple_ps(x, end));
+      __m128i v = _mm_mask_i32gather_epi32(_mm_setzero_si128(), lut, idx, _mm_castps_si128(in_range), 4);
+      v = _mm_blendv_epi8(v, above, _mm_castps_si128(_mm_cmpgt_ps(x, end)));
+      v = _mm_blendv_epi8(v, below, _mm_castps_si128(_mm_cmplt_ps(x, start)));
+      v = _mm_blendv_epi8(v, nan, _mm_castps_si128(_mm_cmpunord_ps(x, x)));
+      if(zero_out_of_range)
+        v = _mm_andnot_si128(_mm_castps_si128(_mm_cmpeq_ps(x, zero)), v);
+      _mm_storeu_si128((__m128i *)(out + i), v);
+      }
+    }
+#endif
+
+  // Scalar code for the remaining pixels, with the zero test outside of the loop
+  if(zero_out_of_range)
+    {
+    TDisplayPixel zero = itk::NumericTraits<TDisplayPixel>::ZeroValue();
+    for(; i < n; i++)
+      out[i] = (in[i] == 0) ? zero : MapIntensityToDisplay(in[i]);
+    }
+  else
+    {
+    for(; i < n; i++)
+      out[i] = MapIntensityToDisplay(in[i]);
+    }
+}
+
 // Template instantiation
 #define ColorLookupTableInstantiateMacro(type) \
   template class ColorLookupTable<type, itk::RGBAPixel<unsigned char> >; \
@@ -52,6 +52,17 @@ public:
       }
     }
 
+  /**
+   * Map a contiguous array of intensities to the display type. This is the
+   * same as calling MapIntensityToDisplay for each intensity, except that if
+   * zero_out_of_range is set, zero intensities map to a zero display value.
+   * When compiled with AVX2, the range checks and the table lookups for
+   * RGBA output are done eight (integer input) or four (float input) pixels
+   * at a time using vector gather instructions.
+   */
+  void MapIntensitiesToDisplay(const TInputPixel *in, TDisplayPixel *out,
+                               size_t n, bool zero_out_of_range) const;
+
   /** Perform a range check (is intensity in the mapped range) - normally not required */
   bool CheckRange(const TInputPixel &x) const
     {
@@ -362,6 +362,21 @@ private:
   // Whether the main input should always be bypassed
   bool m_BypassMainInput;
 
+  // Position of the slice within each RLE line: the segment containing the
+  // slice and the first pixel of that segment. When slicing along x, these
+  // are kept between calls so that moving to a nearby slice only needs to
+  // step over a few segments instead of decoding every line from the start.
+  struct LineCursor
+  {
+    unsigned int Segment;
+    long Start;
+  };
+  std::vector<LineCursor> m_LineCursors;
+
+  // The input for which the line cursors were computed, and its MTime
+  const InputImageType *m_LineCursorImage;
+  itk::ModifiedTimeType m_LineCursorMTime;
+
 };
 
 #ifndef ITK_MANUAL_INSTANTIATION
@@ -38,6 +38,7 @@
 #include "itkImage.h"
 #include "itkVectorImage.h"
 #include "itkVectorImageToImageAdaptor.h"
+#include "itkMultiThreaderBase.h"
 
 //now goes version specialized for RLEImage
 template< typename TPixel, typename CounterType, class TOutputImage, class TPreviewImage>
@@ -64,6 +65,10 @@ IRISSlicer<RLEImage<TPixel, 3, CounterType>, TOutputImage, TPreviewImage>
 
   // Initialize to a zero slice index
   m_SliceIndex = 0;
+
+  // No line cursors have been computed yet
+  m_LineCursorImage = NULL;
+  m_LineCursorMTime = 0;
 }
 
 template< typename TPixel, typename CounterType, class TOutputImage, class TPreviewImage>
@@ -239,79 +244,100 @@ void IRISSlicer<RLEImage<TPixel, 3, CounterType>, TOutputImage, TPreviewImage>
 
   typename OutputImageType::PixelType *outSlice = &outputPtr->GetPixel(oStartInd);
 
+  // The output rows are split between the threads of the ITK pool
+  itk::MultiThreaderBase::Pointer mt = itk::MultiThreaderBase::New();
+
   if (m_SliceDirectionImageAxis == 2) //slicing along z
     {
-#pragma omp parallel for
-    for (int y = 0; y < szVol[1]; y++)
+    if (m_LineDirectionImageAxis != 1 && m_LineDirectionImageAxis != 0)
+      throw itk::ExceptionObject(__FILE__, __LINE__, "SliceDirectionImageAxis and SliceDirectionImageAxis cannot both have a value of 2!", __FUNCTION__);
+
+    mt->ParallelizeArray(0, szVol[1], [&](itk::SizeValueType y)
       {
-      typename InputImageType::BufferType::IndexType lineIndex = { { y, (int) m_SliceIndex } };
+      typename InputImageType::BufferType::IndexType lineIndex = { { (long) y, (long) m_SliceIndex } };
       const typename InputImageType::RLLine & line = inputPtr->GetBuffer()->GetPixel(lineIndex);
       if (m_LineDirectionImageAxis == 1) //y is line coordinate
         {
         assert(m_PixelDirectionImageAxis == 0); //x is pixel coordinate
-        uncompressLine(line, outSlice + s_line*y*szVol[0], s_pixel * 1);
+        uncompressLine(line, outSlice + s_line*(long)y*szVol[0], s_pixel * 1);
         }
-      else if (m_LineDirectionImageAxis == 0) //x is line coordinate
+      else //x is line coordinate
         {
         assert(m_PixelDirectionImageAxis == 1); //y is pixel coordinate
-        uncompressLine(line, outSlice + s_pixel*y, s_line*szVol[1]);
+        uncompressLine(line, outSlice + s_pixel*(long)y, s_line*szVol[1]);
         }
-      else
-        throw itk::ExceptionObject(__FILE__, __LINE__, "SliceDirectionImageAxis and SliceDirectionImageAxis cannot both have a value of 2!", __FUNCTION__);
-      }
+      }, nullptr);
     }
   else if (m_SliceDirectionImageAxis == 1) //slicing along y
     {
-#pragma omp parallel for
-    for (int z = 0; z < szVol[2]; z++)
+    if (m_LineDirectionImageAxis != 2 && m_LineDirectionImageAxis != 0)
+      throw itk::ExceptionObject(__FILE__, __LINE__, "SliceDirectionImageAxis and SliceDirectionImageAxis cannot both have a value of 1!", __FUNCTION__);
+
+    mt->ParallelizeArray(0, szVol[2], [&](itk::SizeValueType z)
       {
-      typename InputImageType::BufferType::IndexType lineIndex = { { (int) m_SliceIndex, z } };
+      typename InputImageType::BufferType::IndexType lineIndex = { { (long) m_SliceIndex, (long) z } };
       const typename InputImageType::RLLine & line = inputPtr->GetBuffer()->GetPixel(lineIndex);
       if (m_LineDirectionImageAxis == 2) //z is line coordinate
         {
         assert(m_PixelDirectionImageAxis == 0); //x is pixel coordinate
-        uncompressLine(line, outSlice + s_line*z*szVol[0], s_pixel * 1);
+        uncompressLine(line, outSlice + s_line*(long)z*szVol[0], s_pixel * 1);
         }
-      else if (m_LineDirectionImageAxis == 0) //x is line coordinate
+      else //x is line coordinate
         {
         assert(m_PixelDirectionImageAxis == 2); //z is pixel coordinate
-        uncompressLine(line, outSlice + s_pixel*z, s_line*szVol[2]);
+        uncompressLine(line, outSlice + s_pixel*(long)z, s_line*szVol[2]);
         }
-      else
-        throw itk::ExceptionObject(__FILE__, __LINE__, "SliceDirectionImageAxis and SliceDirectionImageAxis cannot both have a value of 1!", __FUNCTION__);
-      }
+      }, nullptr);
     }
   else //slicing along x, the low-preformance case
     {
     assert(m_SliceDirectionImageAxis == 0);
-#pragma omp parallel for
-    for (int z = 0; z < szVol[2]; z++)
-      for (int y = 0; y < szVol[1]; y++)
+    if (m_LineDirectionImageAxis != 2 && m_LineDirectionImageAxis != 1)
+      throw itk::ExceptionObject(__FILE__, __LINE__, "SliceDirectionImageAxis and SliceDirectionImageAxis cannot both have a value of 0!", __FUNCTION__);
+
+    // The cursors from the previous call are reused if the input has not
+    // changed since. Otherwise, all lines are searched from the start.
+    size_t nLines = szVol[1] * szVol[2];
+    if (m_LineCursorImage != inputPtr || m_LineCursorMTime != inputPtr->GetMTime()
+        || m_LineCursors.size() != nLines)
+      {
+      LineCursor start = { 0, 0 };
+      m_LineCursors.assign(nLines, start);
+      m_LineCursorImage = inputPtr;
+      m_LineCursorMTime = inputPtr->GetMTime();
+      }
+
+    long k = m_SliceIndex;
+    mt->ParallelizeArray(0, szVol[2], [&](itk::SizeValueType zv)
+      {
+      long z = zv;
+      for (long y = 0; y < szVol[1]; y++)
         {
         typename InputImageType::BufferType::IndexType lineIndex = { { y, z } };
         const typename InputImageType::RLLine & line = inputPtr->GetBuffer()->GetPixel(lineIndex);
-        int t = 0;
-        for (int x = 0; x < line.size(); x++)
+
+        // Step the cursor backward or forward to the segment containing k
+        LineCursor &c = m_LineCursors[z * szVol[1] + y];
+        if (c.Segment >= line.size())
+          c.Segment = 0, c.Start = 0;
+        while (c.Start > k)
+          c.Start -= line[--c.Segment].first;
+        while (c.Start + line[c.Segment].first <= k)
+          c.Start += line[c.Segment++].first;
+
+        const TPixel &value = line[c.Segment].second;
+        if (m_LineDirectionImageAxis == 2) //z is line coordinate
+          {
+          assert(m_PixelDirectionImageAxis == 1); //y is pixel coordinate
+          *(outSlice + s_line*z*szVol[1] + s_pixel *y) = value;
+          }
+        else //y is line coordinate
           {
-          t += line[x].first;
-          if (t > m_SliceIndex)
-            {
-            if (m_LineDirectionImageAxis == 2) //z is line coordinate
-              {
-              assert(m_PixelDirectionImageAxis == 1); //y is pixel coordinate
-              *(outSlice + s_line*z*szVol[1] + s_pixel *y) = line[x].second;;
-              }
-            else if (m_LineDirectionImageAxis == 1) //y is line coordinate
-              {
-              assert(m_PixelDirectionImageAxis == 2); //z is pixel coordinate
-              *(outSlice + s_pixel*z + s_line *y*szVol[2]) = line[x].second;
-              }
-            else
-              throw itk::ExceptionObject(__FILE__, __LINE__, "SliceDirectionImageAxis and SliceDirectionImageAxis cannot both have a value of 0!", __FUNCTION__);
-            break;
-            }
+          assert(m_PixelDirectionImageAxis == 2); //z is pixel coordinate
+          *(outSlice + s_pixel*z + s_line *y*szVol[2]) = value;
           }
         }
+      }, nullptr);
     }
 }
 
@@ -7,6 +7,8 @@
 #include "itkVectorImage.h"
 #include "VectorToScalarImageAccessor.h"
 #include "itkMultiThreaderBase.h"
+#include <limits>
+#include <algorithm>
 
 /* ===============================================================
     AbstractLookupTableImageFilter implementation
@@ -101,24 +103,117 @@ IntensityToColorLookupTableImageFilter<TInputImage, TColorMapTraits>
   // Range of the curve (a pair)
   auto [tmin, tmax] = curve->GetRange();
 
-  // Initialize the LUT
+  // Current control points of the curve
+  ControlPointList cp(curve->GetControlPointCount());
+  for(unsigned int k = 0; k < cp.size(); k++)
+    curve->GetControlPoint(k, cp[k].first, cp[k].second);
+
+  // The LUT can be updated incrementally if only the control points have moved.
+  // For floating point images the curve range also determines the LUT domain.
+  itk::ModifiedTimeType cm_time = colormap ? colormap->GetMTime() : 0;
+  bool incremental =
+      m_LastUpdateValid
+      && this->GetMTime() == m_LastFilterMTime
+      && cm_time == m_LastColorMapMTime
+      && imin == m_LastImageMin && imax == m_LastImageMax
+      && cp.size() == m_LastControlPoints.size()
+      && (!std::is_floating_point<ComponentType>::value
+          || (tmin == m_LastCurveMin && tmax == m_LastCurveMax));
+
+  m_RebuildTimeProbe.Start();
+
+  // Initialize the LUT (this retains the entries if the size is unchanged)
   LookupTableType *lut = this->GetLookupTable();
   lut->Initialize(imin, imax, tmin, tmax);
 
-  // Get the region representing the LUT, for multithreading
-  unsigned int lut_size = lut->GetSize();
+  // Range of LUT entries to compute
+  unsigned int i0 = 0, i1 = lut->GetSize();
+  if(incremental)
+    this->ComputeDirtyRange(lut, cp, i0, i1);
 
-  // Multi-threaded computation
-  itk::MultiThreaderBase::Pointer mt = itk::MultiThreaderBase::New();
-  itk::ImageRegion<1> lut_region;
-  lut_region.SetSize(0, lut_size);
-  mt->ParallelizeImageRegion<1>(lut_region,
-        [this, curve, colormap, lut](const auto &thread_region)
+  this->ComputeLUTEntries(lut, curve, colormap, i0, i1);
+
+  m_RebuildTimeProbe.Stop();
+  m_LastRebuildSize = i1 - i0;
+
+  // Remember the state for the next update
+  m_LastControlPoints = cp;
+  m_LastImageMin = imin;
+  m_LastImageMax = imax;
+  m_LastCurveMin = tmin;
+  m_LastCurveMax = tmax;
+  m_LastFilterMTime = this->GetMTime();
+  m_LastColorMapMTime = cm_time;
+  m_LastUpdateValid = true;
+
+  // Set outside/nan colors
+  DisplayPixelType color_below, color_above, color_nan;
+  TColorMapTraits::get_outside_and_nan_values(colormap, m_IgnoreAlpha, color_below, color_above, color_nan);
+  lut->SetColorBelow(color_below);
+  lut->SetColorAbove(color_above);
+  lut->SetColorNaN(color_nan);
+  }
+
+template <class TInputImage, class TColorMapTraits>
+void
+IntensityToColorLookupTableImageFilter<TInputImage, TColorMapTraits>
+::ComputeDirtyRange(const LookupTableType *lut, const ControlPointList &cp,
+                    unsigned int &i0, unsigned int &i1)
+{
+  // Moving a control point changes the spline tangents at its neighbors, so
+  // the curve changes between the second neighbors on either side. Moving an
+  // end point also changes where the curve is clamped, so the range extends
+  // to the end of the LUT.
+  const double inf = std::numeric_limits<double>::infinity();
+  double ta = inf, tb = -inf;
+  int n = (int) cp.size();
+  for(int k = 0; k < n; k++)
     {
-    // Iterate over the range of LUT entries we are computing
-    int i0 = (int) thread_region.GetIndex()[0];
-    int i1 = i0 + (int) thread_region.GetSize()[0];
-    for(int i = i0; i < i1; i++)
+    if(cp[k] != m_LastControlPoints[k])
+      {
+      ta = std::min(ta, k >= 2 ? std::min(cp[k-2].first, m_LastControlPoints[k-2].first) : -inf);
+      tb = std::max(tb, k + 2 < n ? std::max(cp[k+2].first, m_LastControlPoints[k+2].first) : inf);
+      }
+    }
+
+  // Nothing moved
+  if(ta > tb)
+    {
+    i0 = i1 = 0;
+    return;
+    }
+
+  // The curve domain value increases with the LUT index, so the affected
+  // entries can be found by binary search
+  unsigned int size = lut->GetSize();
+  auto first_at_or_above = [lut, size](double t, bool inclusive)
+    {
+    unsigned int lo = 0, hi = size;
+    while(lo < hi)
+      {
+      unsigned int mid = lo + (hi - lo) / 2;
+      double tm = lut->GetIntensityCurveDomainValueForIndex(mid);
+      if(inclusive ? tm < t : tm <= t)
+        lo = mid + 1;
+      else
+        hi = mid;
+      }
+    return lo;
+    };
+
+  i0 = first_at_or_above(ta, true);
+  i1 = first_at_or_above(tb, false);
+}
+
+template <class TInputImage, class TColorMapTraits>
+void
+IntensityToColorLookupTableImageFilter<TInputImage, TColorMapTraits>
+::ComputeLUTEntries(LookupTableType *lut, const IntensityCurveInterface *curve,
+                    const ColorMap *colormap, unsigned int i0, unsigned int i1)
+{
+  auto compute = [this, curve, colormap, lut](int k0, int k1)
+    {
+    for(int i = k0; i < k1; i++)
       {
       // This is the t coordinate of the intensity curve to loop up
       double t = lut->GetIntensityCurveDomainValueForIndex(i);
@@ -133,15 +228,30 @@ IntensityToColorLookupTableImageFilter<TInputImage, TColorMapTraits>
       // Assign to colormap
       lut->SetLUTValue(i, rgb);
       }
-    }, nullptr);
+    };
 
-  // Set outside/nan colors
-  DisplayPixelType color_below, color_above, color_nan;
-  TColorMapTraits::get_outside_and_nan_values(colormap, m_IgnoreAlpha, color_below, color_above, color_nan);
-  lut->SetColorBelow(color_below);
-  lut->SetColorAbove(color_above);
-  lut->SetColorNaN(color_nan);
-  }
+  // Small updates, typical when dragging a control point, are not worth
+  // dispatching to the thread pool
+  if(i1 - i0 < 4096)
+    {
+    compute(i0, i1);
+    return;
+    }
+
+  // Multi-threaded computation
+  itk::MultiThreaderBase::Pointer mt = itk::MultiThreaderBase::New();
+  itk::ImageRegion<1> lut_region;
+  lut_region.SetIndex(0, i0);
+  lut_region.SetSize(0, i1 - i0);
+  mt->ParallelizeImageRegion<1>(lut_region,
+        [compute](const auto &thread_region)
+    {
+    // Iterate over the range of LUT entries we are computing
+    int k0 = (int) thread_region.GetIndex()[0];
+    int k1 = k0 + (int) thread_region.GetSize()[0];
+    compute(k0, k1);
+    }, nullptr);
+}
 
 template<class TInputImage, class TColorMapTraits>
 typename IntensityToColorLookupTableImageFilter<TInputImage, TColorMapTraits>::DataObjectPointer
@@ -5,6 +5,7 @@
 #include <itkImageToImageFilter.h>
 #include <itkVectorImage.h>
 #include <itkSimpleDataObjectDecorator.h>
+#include <itkTimeProbe.h>
 #include "ColorMap.h"
 
 class ColorMap;
@@ -79,6 +80,12 @@ public:
  * and objects representing the image min/max intensities. The image may be a
  * vector image, a regular image, or an ImageAdaptor.
  *
+ * The LUT is updated incrementally when possible. If only the control points
+ * of the intensity curve have changed since the last update, only the entries
+ * whose curve domain values lie within two control points of a moved point
+ * are recomputed (the Kochanek spline is local to that extent). Changes to the
+ * image range, color map or filter settings cause a full rebuild.
+ *
  * TODO: the current approach is to map the entire range between the image
  * minimum and maximum to the color map. However, since the user only sees
  * the intensities between the intensity curve min and max, this means that
@@ -181,6 +188,11 @@ public:
 
   virtual DataObjectPointer MakeOutput(const DataObjectIdentifierType &name) override;
 
+  /** Time probe measuring the LUT updates performed by this filter */
+  const itk::TimeProbe &GetRebuildTimeProbe() const { return m_RebuildTimeProbe; }
+
+  /** Number of LUT entries recomputed by the last update */
+  itkGetConstMacro(LastRebuildSize, unsigned int)
 
 protected:
 
@@ -195,6 +207,29 @@ protected:
 
   // Whether transparency is used or ignored
   bool m_IgnoreAlpha = false;
+
+  // Compute LUT entries in the range [i0, i1)
+  void ComputeLUTEntries(LookupTableType *lut, const IntensityCurveInterface *curve,
+                         const ColorMap *colormap, unsigned int i0, unsigned int i1);
+
+  // Control points (t, x) of the intensity curve
+  using ControlPointList = std::vector<std::pair<double, double>>;
+
+  // Find the range [i0, i1) of LUT entries affected by the change of control
+  // points since the last update
+  void ComputeDirtyRange(const LookupTableType *lut, const ControlPointList &cp,
+                         unsigned int &i0, unsigned int &i1);
+
+  // State of the inputs at the last update, used for incremental updates
+  ControlPointList m_LastControlPoints;
+  ComponentType m_LastImageMin, m_LastImageMax;
+  double m_LastCurveMin, m_LastCurveMax;
+  itk::ModifiedTimeType m_LastFilterMTime = 0, m_LastColorMapMTime = 0;
+  bool m_LastUpdateValid = false;
+
+  // Timing of the LUT updates
+  itk::TimeProbe m_RebuildTimeProbe;
+  unsigned int m_LastRebuildSize = 0;
 };
 
 #endif // INTENSITYTOCOLORLOOKUPTABLEIMAGEFILTER_H
@@ -24,10 +24,6 @@ LookupTableIntensityMappingFilter<TInputImage, TOutputImage>
   // Get the range of intensities mapped that the LUT handles
   const LookupTableType *lut = this->GetLookupTable();
 
-  // Define the iterators
-  itk::ImageRegionConstIterator<TInputImage> inputIt(input, region);
-  itk::ImageRegionIterator<TOutputImage> outputIt(output, region);
-
   // Does zero map out of the LUT's range? We may get inputs of zero from
   // the non-orthogonal slicer (data outside of image range) that would fall
   // outside of the colormap. This is really a poor way to handle this but
@@ -35,27 +31,47 @@ LookupTableIntensityMappingFilter<TInputImage, TOutputImage>
   // TODO: fix this.
   bool zero_out_of_range = !lut->CheckRange(0);
 
-  // Perform the intensity mapping using the LUT (no bounds checking!)
-  while( !inputIt.IsAtEnd() )
+  if constexpr(!InputIsVector::value)
     {
-    // Get the input intensity
-    InputPixelType xin = inputIt.Get();
-    OutputPixelType xout;
-
-    if(zero_out_of_range && xin == 0)
+    // Map the region one row at a time, using the LUT's array kernel
+    typename OutputRegionType::IndexType idx = region.GetIndex();
+    size_t nx = region.GetSize(0);
+    for(unsigned int y = 0; y < region.GetSize(1); y++)
       {
-      // Special case: intensity is actually outside of the min/max range
-      xout.Fill(0);
+      idx[1] = region.GetIndex(1) + y;
+      const InputPixelType *pin = input->GetBufferPointer() + input->ComputeOffset(idx);
+      OutputPixelType *pout = output->GetBufferPointer() + output->ComputeOffset(idx);
+      lut->MapIntensitiesToDisplay(pin, pout, nx, zero_out_of_range);
       }
-    else
+    }
+  else
+    {
+    // Define the iterators
+    itk::ImageRegionConstIterator<TInputImage> inputIt(input, region);
+    itk::ImageRegionIterator<TOutputImage> outputIt(output, region);
+
+    // Perform the intensity mapping using the LUT (no bounds checking!)
+    while( !inputIt.IsAtEnd() )
       {
-      xout = lut->MapIntensityToDisplay(xin);
+      // Get the input intensity
+      InputPixelType xin = inputIt.Get();
+      OutputPixelType xout;
+
+      if(zero_out_of_range && xin == 0)
+        {
+        // Special case: intensity is actually outside of the min/max range
+        xout.Fill(0);
+        }
+      else
+        {
+        xout = lut->MapIntensityToDisplay(xin);
+        }
+
+      outputIt.Set(xout);
+
+      ++inputIt;
+      ++outputIt;
       }
-
-    outputIt.Set(xout);
-
-    ++inputIt;
-    ++outputIt;
     }
 }
 
@@ -70,22 +70,31 @@ RGBALookupTableIntensityMappingFilter<TInputImage>
     }
     else
     {
-        // Get normalized vectors
-        float x_norm = lut->MapIntensityToDisplay(xin0) / 255. - 0.5;
-        float y_norm = lut->MapIntensityToDisplay(xin1) / 255. - 0.5;
-
-        // Compute the phase
-        float phase = ::atan2(y_norm, x_norm), mag = ::sqrt(x_norm*x_norm + y_norm*y_norm);
-        float r,g,b;
-        vtkMath::HSVToRGB(0.5 + phase / 6.28318530718, 1.0, ::fminf(1.0f, mag), &r, &g, &b);
-
-        xout[0] = (unsigned char) (255 * r);
-        xout[1] = (unsigned char) (255 * g);
-        xout[2] = (unsigned char) (255 * b);
-        xout[3] = 255; // alpha = 1
+        this->MapMappedXYtoHSV(
+              lut->MapIntensityToDisplay(xin0), lut->MapIntensityToDisplay(xin1), xout);
     }
 }
 
+template<class TInputImage>
+void
+RGBALookupTableIntensityMappingFilter<TInputImage>
+::MapMappedXYtoHSV(OutputComponentType x, OutputComponentType y, OutputPixelType &xout)
+{
+    // Get normalized vectors
+    float x_norm = x / 255. - 0.5;
+    float y_norm = y / 255. - 0.5;
+
+    // Compute the phase
+    float phase = ::atan2(y_norm, x_norm), mag = ::sqrt(x_norm*x_norm + y_norm*y_norm);
+    float r,g,b;
+    vtkMath::HSVToRGB(0.5 + phase / 6.28318530718, 1.0, ::fminf(1.0f, mag), &r, &g, &b);
+
+    xout[0] = (unsigned char) (255 * r);
+    xout[1] = (unsigned char) (255 * g);
+    xout[2] = (unsigned char) (255 * b);
+    xout[3] = 255; // alpha = 1
+}
+
 template<class TInputImage>
 void
 RGBALookupTableIntensityMappingFilter<TInputImage>
@@ -104,64 +113,59 @@ RGBALookupTableIntensityMappingFilter<TInputImage>
   // TODO: fix this.
   bool zero_out_of_range = !lut->CheckRange(0);
 
-  itk::ImageRegionIterator<OutputImageType> outputIt(output, region);
-
-  if(this->m_TwoChannelHueValueMode)
-  {
-      // Standard XY to Hue/Value mapping mode
-
-      // Get all the inputs
-      std::vector<const InputImageType *> inputs(2);
-      for(int d = 0; d < 2; d++)
-          inputs[d] = this->GetInput(d);
-
-      // Define the iterators
-      typedef itk::ImageRegionConstIterator<InputImageType> InputIteratorType;
-      InputIteratorType it0(inputs[0], region);
-      InputIteratorType it1(inputs[1], region);
-
-      // Perform the intensity mapping using the LUT (no bounds checking!)
-      while( !outputIt.IsAtEnd() )
+  // Number of channels in the current mode
+  int nc = this->m_TwoChannelHueValueMode ? 2 : 3;
+  std::vector<const InputImageType *> inputs(nc);
+  for(int d = 0; d < nc; d++)
+    inputs[d] = this->GetInput(d);
+
+  // Each row of each channel is mapped through the LUT with the array kernel.
+  // Zeros are mapped like any other intensity here, because a pixel is only
+  // set to zero below when all of its channels are zero.
+  size_t nx = region.GetSize(0);
+  std::vector<OutputComponentType> mapped(3 * nx);
+  typename OutputImageRegionType::IndexType idx = region.GetIndex();
+  for(unsigned int y = 0; y < region.GetSize(1); y++)
+    {
+    idx[1] = region.GetIndex(1) + y;
+    const InputPixelType *pin[3] = { NULL, NULL, NULL };
+    for(int d = 0; d < nc; d++)
       {
-          OutputPixelType xout;
-
-          InputPixelType xin0 = it0.Get();
-          InputPixelType xin1 = it1.Get();
-          this->MapPixelXYtoHSV(xin0, xin1, lut, zero_out_of_range, xout);
-          outputIt.Set(xout);
-          ++it0; ++it1;
-          ++outputIt;
+      pin[d] = inputs[d]->GetBufferPointer() + inputs[d]->ComputeOffset(idx);
+      lut->MapIntensitiesToDisplay(pin[d], &mapped[d * nx], nx, false);
       }
 
-  }
-  else
-  {
-      // Standard XYZ to RGB mapping mode
-
-      // Get all the inputs
-      std::vector<const InputImageType *> inputs(3);
-      for(int d = 0; d < 3; d++)
-          inputs[d] = this->GetInput(d);
-
-      // Define the iterators
-      typedef itk::ImageRegionConstIterator<InputImageType> InputIteratorType;
-      InputIteratorType it0(inputs[0], region);
-      InputIteratorType it1(inputs[1], region);
-      InputIteratorType it2(inputs[2], region);
-
-      // Perform the intensity mapping using the LUT (no bounds checking!)
-      while( !outputIt.IsAtEnd() )
+    OutputPixelType *pout = output->GetBufferPointer() + output->ComputeOffset(idx);
+    if(this->m_TwoChannelHueValueMode)
       {
-          OutputPixelType xout;
-          InputPixelType xin0 = it0.Get();
-          InputPixelType xin1 = it1.Get();
-          InputPixelType xin2 = it2.Get();
-          this->MapPixelXYZtoRGB(xin0, xin1, xin2, lut, zero_out_of_range, xout);
-          outputIt.Set(xout);
-          ++it0; ++it1; ++it2;
-          ++outputIt;
+      // Standard XY to Hue/Value mapping mode
+      for(size_t x = 0; x < nx; x++)
+        {
+        if(zero_out_of_range && pin[0][x] == 0 && pin[1][x] == 0)
+          pout[x].Fill(0);
+        else
+          this->MapMappedXYtoHSV(mapped[x], mapped[nx + x], pout[x]);
+        }
+      }
+    else
+      {
+      // Standard XYZ to RGB mapping mode
+      for(size_t x = 0; x < nx; x++)
+        {
+        if(zero_out_of_range && pin[0][x] == 0 && pin[1][x] == 0 && pin[2][x] == 0)
+          {
+          pout[x].Fill(0);
+          }
+        else
+          {
+          pout[x][0] = mapped[x];
+          pout[x][1] = mapped[nx + x];
+          pout[x][2] = mapped[2 * nx + x];
+          pout[x][3] = 255; // alpha = 1
+          }
+        }
       }
-  }
+    }
 }
 
 template<class TInputImage>
@@ -70,6 +70,8 @@ protected:
   void MapPixelXYtoHSV(
       InputPixelType xin0, InputPixelType xin1,
       const LookupTableType *lut, bool zero_out_of_range, OutputPixelType &xout);
+  void MapMappedXYtoHSV(
+      OutputComponentType x, OutputComponentType y, OutputPixelType &xout);
 };
 
 
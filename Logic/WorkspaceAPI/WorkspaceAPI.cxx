@@ -1154,7 +1154,7 @@ void WorkspaceAPI::ExportWorkspace(const char *new_workspace,
     if(scramble_filenames)
       {
       // Use the hash as the basename
-      fn_layer_basename = io->GetNativeImageMD5Hash();
+      fn_layer_basename = io->GetNativeImageHash();
       }
 
     // Create a filename that combines the layer index with the hash code
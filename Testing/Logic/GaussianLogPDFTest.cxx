@@ -0,0 +1,115 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+
+#include "Gaussian.h"
+
+double uniform(double a, double b)
+{
+  return a + (b - a) * rand() / (double) RAND_MAX;
+}
+
+// Compare the log PDF of a batch of samples with the single sample version.
+// The samples are stored with a stride larger than their number, and the
+// number is not a multiple of any vector width
+bool compareLogPDF(Gaussian &g, int d, const std::vector<std::vector<double> > &samples,
+                   const char *what)
+{
+  int n = (int) samples.size(), stride = n + 5;
+  std::vector<double> x(d * stride, 0.0), log_pdf(n), scratch((d + 1) * n);
+  for(int s = 0; s < n; s++)
+    for(int k = 0; k < d; k++)
+      x[k * stride + s] = samples[s][k];
+
+  g.EvaluateLogPDF(x.data(), stride, n, log_pdf.data(), scratch.data());
+
+  int n_bad = 0, n_inf = 0;
+  for(int s = 0; s < n; s++)
+    {
+    std::vector<double> xs = samples[s];
+    double expected = g.EvaluateLogPDF(xs.data());
+    double actual = log_pdf[s];
+
+    bool match;
+    if(std::isinf(expected))
+      {
+      match = (actual == expected);
+      n_inf++;
+      }
+    else
+      {
+      match = std::fabs(actual - expected) <= 1e-9 * std::max(1.0, std::fabs(expected));
+      }
+
+    if(!match)
+      {
+      if(n_bad++ < 5)
+        printf("  %s: sample %d log PDF is %.17g, expected %.17g\n", what, s, actual, expected);
+      }
+    }
+
+  printf("%s, dimension %d: %d samples (%d with zero density), %d mismatches\n",
+         what, d, n, n_inf, n_bad);
+  return n_bad == 0;
+}
+
+// Check that the log PDF of many samples at once, which uses the Cholesky
+// factor of the covariance when it is positive definite, matches the single
+// sample version that uses the eigensystem
+int main(int argc, char *argv[])
+{
+  srand(2718);
+  int rc = EXIT_SUCCESS;
+  const int n = 1001;
+
+  for(int d = 1; d <= 6; d++)
+    {
+    // Positive definite covariance A * A' + I / 10, with a random mean
+    Gaussian::MatrixType a(d, d), cov(d, d);
+    Gaussian::VectorType mean(d);
+    for(int i = 0; i < d; i++)
+      {
+      mean[i] = uniform(-10, 10);
+      for(int j = 0; j < d; j++)
+        a(i, j) = uniform(-2, 2);
+      }
+    cov = a * a.transpose();
+    for(int i = 0; i < d; i++)
+      cov(i, i) += 0.1;
+
+    Gaussian g(d);
+    g.SetMean(mean);
+    g.SetCovariance(cov);
+
+    std::vector<std::vector<double> > samples(n, std::vector<double>(d));
+    for(int s = 0; s < n; s++)
+      for(int k = 0; k < d; k++)
+        samples[s][k] = mean[k] + uniform(-6, 6);
+
+    if(!compareLogPDF(g, d, samples, "Positive definite"))
+      rc = EXIT_FAILURE;
+
+    // Singular covariance, where the last component has zero variance. The
+    // density is zero unless that component equals the mean
+    Gaussian::MatrixType sing = cov;
+    for(int i = 0; i < d; i++)
+      {
+      sing(d - 1, i) = 0.0;
+      sing(i, d - 1) = 0.0;
+      }
+
+    Gaussian gs(d);
+    gs.SetMean(mean);
+    gs.SetCovariance(sing);
+
+    for(int s = 0; s < n; s += 2)
+      samples[s][d - 1] = mean[d - 1];
+
+    if(!compareLogPDF(gs, d, samples, "Singular"))
+      rc = EXIT_FAILURE;
+    }
+
+  return rc;
+}
@@ -0,0 +1,238 @@
+#include <iostream>
+#include <cstdlib>
+#include <algorithm>
+#include <array>
+#include <iterator>
+#include <map>
+#include <vector>
+
+#include "LabelSurfaceExtractor.h"
+#include "RLEImageRegionIterator.h"
+
+typedef LabelSurfaceExtractor::ImageType ImageType;
+typedef LabelSurfaceExtractor::CornerId CornerId;
+typedef itk::ImageRegionIterator<ImageType> IteratorType;
+
+// A face identified by its sorted corners and the axis and sign of its normal
+typedef std::array<long long, 6> FaceKey;
+typedef std::map<LabelType, std::vector<FaceKey> > FaceKeyMap;
+
+const long nx = 45, ny = 38, nz = 31;
+
+// Create a label image with overlapping boxes of several labels. The size is
+// not a multiple of the brick size, so the last bricks are partial
+ImageType::Pointer createLabelImage()
+{
+  ImageType::Pointer image = ImageType::New();
+  ImageType::RegionType region;
+  region.SetSize(0, nx);
+  region.SetSize(1, ny);
+  region.SetSize(2, nz);
+  image->SetRegions(region);
+  image->Allocate();
+
+  srand(4321);
+  for(int k = 0; k < 40; k++)
+    {
+    ImageType::RegionType box;
+    for(int d = 0; d < 3; d++)
+      {
+      long n = region.GetSize(d);
+      long i0 = rand() % n, len = 1 + rand() % (n / 3);
+      box.SetIndex(d, i0);
+      box.SetSize(d, std::min(len, n - i0));
+      }
+    LabelType label = (LabelType) (1 + rand() % 6);
+    for(IteratorType it(image, box); !it.IsAtEnd(); ++it)
+      it.Set(label);
+    }
+  return image;
+}
+
+FaceKey makeKey(CornerId c[4], int axis, int sign)
+{
+  std::sort(c, c + 4);
+  FaceKey key = {{ (long long) c[0], (long long) c[1], (long long) c[2],
+                   (long long) c[3], axis, sign }};
+  return key;
+}
+
+CornerId makeCorner(long x, long y, long z)
+{
+  return ((CornerId) z * (ny + 1) + y) * (nx + 1) + x;
+}
+
+// Faces of each label found by comparing every voxel with its six neighbors.
+// The normal of each face points out of the label
+FaceKeyMap bruteForceFaces(ImageType *image)
+{
+  FaceKeyMap faces;
+  for(IteratorType it(image, image->GetBufferedRegion()); !it.IsAtEnd(); ++it)
+    {
+    LabelType label = it.Get();
+    if(label == 0)
+      continue;
+
+    ImageType::IndexType idx = it.GetIndex();
+    for(int d = 0; d < 3; d++)
+      {
+      for(int sign = -1; sign <= 1; sign += 2)
+        {
+        ImageType::IndexType nbr = idx;
+        nbr[d] += sign;
+        bool inside = image->GetBufferedRegion().IsInside(nbr);
+        if(inside && image->GetPixel(nbr) == label)
+          continue;
+
+        // The face lies in the plane between the voxel and its neighbor
+        int u = (d + 1) % 3, v = (d + 2) % 3;
+        long p[3] = { idx[0], idx[1], idx[2] };
+        if(sign > 0)
+          p[d]++;
+        CornerId c[4];
+        for(int k = 0; k < 4; k++)
+          {
+          long q[3] = { p[0], p[1], p[2] };
+          q[u] += (k & 1);
+          q[v] += (k >> 1);
+          c[k] = makeCorner(q[0], q[1], q[2]);
+          }
+        faces[label].push_back(makeKey(c, d, sign));
+        }
+      }
+    }
+  return faces;
+}
+
+// Keys of the extracted faces. Returns false if a face is not a unit square
+bool extractedFaces(const LabelSurfaceExtractor::SurfaceMap &surfaces, FaceKeyMap &faces)
+{
+  for(auto &sit : surfaces)
+    {
+    for(auto &bit : sit.second)
+      {
+      for(const LabelSurfaceExtractor::Face &f : bit.second)
+        {
+        long x[4][3];
+        for(int k = 0; k < 4; k++)
+          {
+          CornerId c = f.Corners[k];
+          x[k][0] = c % (nx + 1);
+          x[k][1] = (c / (nx + 1)) % (ny + 1);
+          x[k][2] = c / ((nx + 1) * (ny + 1));
+          }
+
+        // The normal is (x1 - x0) x (x2 - x0), which must be a unit vector
+        // along one of the axes
+        long a[3], b[3], n[3];
+        for(int d = 0; d < 3; d++)
+          {
+          a[d] = x[1][d] - x[0][d];
+          b[d] = x[2][d] - x[0][d];
+          }
+        n[0] = a[1] * b[2] - a[2] * b[1];
+        n[1] = a[2] * b[0] - a[0] * b[2];
+        n[2] = a[0] * b[1] - a[1] * b[0];
+        int axis = -1;
+        for(int d = 0; d < 3; d++)
+          if(n[d] == 1 || n[d] == -1)
+            axis = d;
+        if(axis < 0 || std::abs(n[0]) + std::abs(n[1]) + std::abs(n[2]) != 1)
+          return false;
+
+        CornerId c[4] = { f.Corners[0], f.Corners[1], f.Corners[2], f.Corners[3] };
+        faces[sit.first].push_back(makeKey(c, axis, (int) n[axis]));
+        }
+      }
+    }
+  return true;
+}
+
+bool compareFaces(FaceKeyMap &expected, FaceKeyMap &actual, const char *what)
+{
+  bool ok = true;
+  for(LabelType label = 1; label <= 6; label++)
+    {
+    std::vector<FaceKey> &e = expected[label], &a = actual[label];
+    std::sort(e.begin(), e.end());
+    std::sort(a.begin(), a.end());
+    std::cout << "  " << what << ", label " << label << ": "
+              << a.size() << " faces, expected " << e.size() << std::endl;
+    if(e != a)
+      {
+      std::cout << "  Faces of label " << label << " do not match" << std::endl;
+      ok = false;
+      }
+    }
+  return ok;
+}
+
+std::vector<LabelType> allLabels()
+{
+  std::vector<LabelType> labels;
+  for(LabelType label = 1; label <= 6; label++)
+    labels.push_back(label);
+  return labels;
+}
+
+// Check the discrete surface extractor against a brute-force comparison of
+// every voxel with its neighbors, after a full and after an incremental update
+int main(int argc, char *argv[])
+{
+  ImageType::Pointer image = createLabelImage();
+  int rc = EXIT_SUCCESS;
+
+  // Full extraction with small bricks
+  LabelSurfaceExtractor extractor(image, 8);
+  LabelSurfaceExtractor::SurfaceMap surfaces;
+  extractor.Extract(allLabels(), NULL, surfaces);
+
+  FaceKeyMap expected = bruteForceFaces(image), actual;
+  if(!extractedFaces(surfaces, actual))
+    {
+    std::cout << "  Extracted face is not a unit square" << std::endl;
+    return EXIT_FAILURE;
+    }
+  if(!compareFaces(expected, actual, "Full"))
+    rc = EXIT_FAILURE;
+
+  // Edit a box of the image, and extract the faces again only in the bricks
+  // whose checksums changed, grown by one brick, as MultiLabelMeshPipeline does
+  std::vector<unsigned long> sums_before, sums_after;
+  extractor.ComputeBrickCheckSums(sums_before);
+
+  ImageType::RegionType edit;
+  edit.SetIndex(0, 17); edit.SetIndex(1, 9); edit.SetIndex(2, 20);
+  edit.SetSize(0, 6); edit.SetSize(1, 11); edit.SetSize(2, 5);
+  for(IteratorType it(image, edit); !it.IsAtEnd(); ++it)
+    it.Set(it.GetIndex()[0] % 3 ? 5 : 0);
+  image->Modified();
+
+  extractor.ComputeBrickCheckSums(sums_after);
+  LabelSurfaceExtractor::BrickMask dirty(extractor.GetNumberOfBricks());
+  for(unsigned int b = 0; b < dirty.size(); b++)
+    dirty[b] = (sums_before[b] != sums_after[b]);
+  extractor.DilateBrickMask(dirty);
+
+  for(auto &sit : surfaces)
+    for(auto bit = sit.second.begin(); bit != sit.second.end(); )
+      bit = dirty[bit->first] ? sit.second.erase(bit) : std::next(bit);
+
+  LabelSurfaceExtractor::SurfaceMap update;
+  extractor.Extract(allLabels(), &dirty, update);
+  for(auto &sit : update)
+    for(auto &bit : sit.second)
+      surfaces[sit.first][bit.first].swap(bit.second);
+
+  expected = bruteForceFaces(image);
+  actual.clear();
+  if(!extractedFaces(surfaces, actual))
+    {
+    std::cout << "  Extracted face is not a unit square" << std::endl;
+    return EXIT_FAILURE;
+    }
+  if(!compareFaces(expected, actual, "Incremental"))
+    rc = EXIT_FAILURE;
+
+  return rc;
+}
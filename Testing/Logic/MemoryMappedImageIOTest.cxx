@@ -0,0 +1,223 @@
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "GuidedNativeImageIO.h"
+#include "MemoryMappedFile.h"
+#include "Registry.h"
+#include "IRISException.h"
+#include "itkImageFileWriter.h"
+#include "itkImageRegionIterator.h"
+#include "itksys/SystemTools.hxx"
+
+typedef itk::Image<short, 3> ImageType;
+typedef itk::Image<short, 4> Image4DType;
+typedef itk::VectorImage<short, 4> NativeImageType;
+typedef MappedImageContainer<NativeImageType::PixelContainer::ElementIdentifier, short>
+  MappedContainerType;
+
+template <class TImage>
+typename TImage::Pointer createImage(short seed)
+{
+  typename TImage::Pointer image = TImage::New();
+  typename TImage::RegionType region;
+  for(unsigned int d = 0; d < TImage::ImageDimension; d++)
+    region.SetSize(d, 40 - 10 * d);
+  image->SetRegions(region);
+  image->Allocate();
+
+  short value = seed;
+  for(itk::ImageRegionIterator<TImage> it(image, region); !it.IsAtEnd(); ++it)
+    it.Set(value = (short) (value * 31 + 7));
+  return image;
+}
+
+// Compare the voxels of the native image with an image
+template <class TImage>
+bool sameVoxels(GuidedNativeImageIO *io, TImage *image)
+{
+  NativeImageType *native = dynamic_cast<NativeImageType *>(io->GetNativeImage());
+  size_t n = image->GetBufferedRegion().GetNumberOfPixels();
+  if(!native || native->GetPixelContainer()->Size() != n)
+    return false;
+
+  const short *p = native->GetBufferPointer(), *q = image->GetBufferPointer();
+  for(size_t i = 0; i < n; i++)
+    if(p[i] != q[i])
+      return false;
+  return true;
+}
+
+const MemoryMappedFile *getMappedFile(GuidedNativeImageIO *io)
+{
+  NativeImageType *native = dynamic_cast<NativeImageType *>(io->GetNativeImage());
+  MappedContainerType *mapped =
+      native ? dynamic_cast<MappedContainerType *>(native->GetPixelContainer()) : NULL;
+  return mapped ? mapped->GetMappedFile() : NULL;
+}
+
+bool isMapped(GuidedNativeImageIO *io)
+{
+  return getMappedFile(io) != NULL;
+}
+
+bool testFile(const std::string &fn)
+{
+  bool ok = true;
+
+  ImageType::Pointer original = createImage<ImageType>(1), changed = createImage<ImageType>(2);
+  typedef itk::ImageFileWriter<ImageType> WriterType;
+  WriterType::Pointer writer = WriterType::New();
+  writer->SetInput(original);
+  writer->SetFileName(fn);
+  writer->Update();
+
+  // Without memory mapping the image is read into memory
+  SmartPtr<GuidedNativeImageIO> io_read = GuidedNativeImageIO::New();
+  Registry hints;
+  io_read->ReadNativeImage(fn.c_str(), hints);
+  if(isMapped(io_read) || !sameVoxels(io_read, original))
+    {
+    printf("%s: image read without memory mapping is wrong\n", fn.c_str());
+    ok = false;
+    }
+  io_read->DeallocateNativeImage();
+
+  // With memory mapping the pixel container is the mapped file
+  SmartPtr<GuidedNativeImageIO> io_map = GuidedNativeImageIO::New();
+  io_map->SetUseMemoryMapping(true);
+  io_map->ReadNativeImage(fn.c_str(), hints);
+  if(!isMapped(io_map) || !sameVoxels(io_map, original))
+    {
+    printf("%s: image is not memory mapped correctly\n", fn.c_str());
+    ok = false;
+    }
+
+  // Save a different image over the mapped file. The mapped image must keep
+  // its voxels, and the file must have the new ones
+  SmartPtr<GuidedNativeImageIO> io_save = GuidedNativeImageIO::New();
+  Registry save_hints;
+  io_save->SaveImage(fn.c_str(), save_hints, changed.GetPointer());
+
+  if(!sameVoxels(io_map, original))
+    {
+    printf("%s: mapped image changed when the file was saved over\n", fn.c_str());
+    ok = false;
+    }
+
+  std::string dir = itksys::SystemTools::GetFilenamePath(fn);
+  if(itksys::SystemTools::FileExists(dir + "/.itksnap_save_0"))
+    {
+    printf("%s: the staging directory was not removed\n", fn.c_str());
+    ok = false;
+    }
+
+  io_read->ReadNativeImage(fn.c_str(), hints);
+  if(!sameVoxels(io_read, changed))
+    {
+    printf("%s: saved file does not hold the new image\n", fn.c_str());
+    ok = false;
+    }
+
+  io_read->DeallocateNativeImage();
+  io_map->DeallocateNativeImage();
+  printf("%s: %s\n", fn.c_str(), ok ? "passed" : "FAILED");
+  return ok;
+}
+
+// A 4D image above the scratch file threshold is mapped from a scratch copy
+// when it is not mapped from its own file, whether or not it is compressed
+bool test4DFile(const std::string &fn, bool compressed)
+{
+  bool ok = true;
+
+  Image4DType::Pointer image = createImage<Image4DType>(3);
+  typedef itk::ImageFileWriter<Image4DType> WriterType;
+  WriterType::Pointer writer = WriterType::New();
+  writer->SetInput(image);
+  writer->SetFileName(fn);
+  writer->Update();
+
+  // Below the threshold, the image is read into memory
+  Registry hints;
+  SmartPtr<GuidedNativeImageIO> io = GuidedNativeImageIO::New();
+  io->SetScratchFileThreshold(0);
+  io->ReadNativeImage(fn.c_str(), hints);
+  if(isMapped(io) || !sameVoxels(io, image.GetPointer()))
+    {
+    printf("%s: 4D image read into memory is wrong\n", fn.c_str());
+    ok = false;
+    }
+  io->DeallocateNativeImage();
+
+  // Above the threshold, the image is mapped from a scratch copy
+  io->SetScratchFileThreshold(1);
+  io->ReadNativeImage(fn.c_str(), hints);
+  const MemoryMappedFile *mf = getMappedFile(io);
+  if(!mf || !mf->GetFileName().empty() || !sameVoxels(io, image.GetPointer()))
+    {
+    printf("%s: 4D image is not mapped from a scratch copy correctly\n", fn.c_str());
+    ok = false;
+    }
+  io->DeallocateNativeImage();
+
+  // Uncompressed files are mapped directly when memory mapping is on
+  if(!compressed)
+    {
+    io->SetUseMemoryMapping(true);
+    io->ReadNativeImage(fn.c_str(), hints);
+    mf = getMappedFile(io);
+    if(!mf || mf->GetFileName().empty() || !sameVoxels(io, image.GetPointer()))
+      {
+      printf("%s: 4D image is not mapped from its file\n", fn.c_str());
+      ok = false;
+      }
+    io->DeallocateNativeImage();
+    }
+
+  printf("%s: %s\n", fn.c_str(), ok ? "passed" : "FAILED");
+  return ok;
+}
+
+int usage()
+{
+  printf("MemoryMappedImageIOTest: read images by memory mapping and save over them\n");
+  printf("usage: MemoryMappedImageIOTest temp_dir\n");
+  return -1;
+}
+
+int main(int argc, char *argv[])
+{
+  if(argc < 2)
+    return usage();
+
+  std::string dir = argv[1];
+  const char *files[] = {
+    "/MemoryMappedImageIOTest.nii", "/MemoryMappedImageIOTest.mha",
+    "/MemoryMappedImageIOTest4D.nii", "/MemoryMappedImageIOTest4D.nii.gz" };
+
+  int rc = EXIT_SUCCESS;
+  for(int i = 0; i < 4; i++)
+    {
+    std::string fn = dir + files[i];
+    try
+      {
+      bool ok = (i < 2) ? testFile(fn) : test4DFile(fn, i == 3);
+      if(!ok)
+        rc = EXIT_FAILURE;
+      }
+    catch(itk::ExceptionObject &exc)
+      {
+      printf("%s: exception: %s\n", fn.c_str(), exc.what());
+      rc = EXIT_FAILURE;
+      }
+    catch(IRISException &exc)
+      {
+      printf("%s: exception: %s\n", fn.c_str(), exc.what());
+      rc = EXIT_FAILURE;
+      }
+    itksys::SystemTools::RemoveFile(fn);
+    }
+
+  return rc;
+}
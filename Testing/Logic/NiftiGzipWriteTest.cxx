@@ -0,0 +1,160 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "GuidedNativeImageIO.h"
+#include "ParallelGzipIO.h"
+#include "Registry.h"
+#include "IRISException.h"
+#include "itkImageFileReader.h"
+#include "itksys/SystemTools.hxx"
+
+// Create an image with a non-trivial spatial geometry. Each voxel has the
+// given number of components, which are filled with a simple pattern
+template <class TImage>
+typename TImage::Pointer createImage(const unsigned int *size, unsigned int n_comp)
+{
+  typename TImage::Pointer image = TImage::New();
+  typename TImage::RegionType region;
+  typename TImage::SpacingType spacing;
+  typename TImage::PointType origin;
+  typename TImage::DirectionType dir;
+  dir.SetIdentity();
+  for(unsigned int d = 0; d < TImage::ImageDimension; d++)
+    {
+    region.SetSize(d, size[d]);
+    spacing[d] = d < 3 ? 0.5 + 0.25 * d : 1.0;
+    origin[d] = d < 3 ? -10.0 * d + 3.0 : 0.0;
+    }
+
+  // Swap and flip the first two axes
+  dir(0, 0) = 0; dir(0, 1) = -1;
+  dir(1, 0) = 1; dir(1, 1) = 0;
+
+  image->SetRegions(region);
+  image->SetSpacing(spacing);
+  image->SetOrigin(origin);
+  image->SetDirection(dir);
+  image->SetNumberOfComponentsPerPixel(n_comp);
+  image->Allocate();
+
+  auto *p = image->GetBufferPointer();
+  size_t n = image->GetPixelContainer()->Size();
+  for(size_t i = 0; i < n; i++)
+    p[i] = (i * 37) % 101;
+  return image;
+}
+
+template <class TImage>
+bool sameImage(TImage *a, TImage *b)
+{
+  size_t n = a->GetPixelContainer()->Size();
+  if(a->GetLargestPossibleRegion() != b->GetLargestPossibleRegion()
+     || a->GetNumberOfComponentsPerPixel() != b->GetNumberOfComponentsPerPixel()
+     || n != b->GetPixelContainer()->Size())
+    return false;
+
+  for(unsigned int d = 0; d < TImage::ImageDimension; d++)
+    {
+    if(std::fabs(a->GetSpacing()[d] - b->GetSpacing()[d]) > 1e-5
+       || std::fabs(a->GetOrigin()[d] - b->GetOrigin()[d]) > 1e-4)
+      return false;
+    for(unsigned int k = 0; k < TImage::ImageDimension; k++)
+      if(std::fabs(a->GetDirection()(d, k) - b->GetDirection()(d, k)) > 1e-5)
+        return false;
+    }
+
+  const auto *p = a->GetBufferPointer(), *q = b->GetBufferPointer();
+  for(size_t i = 0; i < n; i++)
+    if(p[i] != q[i])
+      return false;
+  return true;
+}
+
+// Save the image as a gzipped NIfTI file and read it back with ITK. The file
+// must have been compressed by ParallelGzipWriter, which writes BGZF blocks
+template <class TImage>
+bool testFile(const std::string &fn, const unsigned int *size, unsigned int n_comp)
+{
+  typename TImage::Pointer image = createImage<TImage>(size, n_comp);
+  bool ok = true;
+
+  SmartPtr<GuidedNativeImageIO> io = GuidedNativeImageIO::New();
+  Registry hints;
+  io->SaveImage(fn.c_str(), hints, image.GetPointer());
+
+  ParallelGzipReader gz;
+  if(!gz.Open(fn.c_str()) || !gz.IsBlocked())
+    {
+    printf("%s: file was not compressed in blocks\n", fn.c_str());
+    ok = false;
+    }
+  gz.Close();
+
+  if(itksys::SystemTools::FileExists(fn + ".header.nii"))
+    {
+    printf("%s: the header stub was not removed\n", fn.c_str());
+    ok = false;
+    }
+
+  typedef itk::ImageFileReader<TImage> ReaderType;
+  typename ReaderType::Pointer reader = ReaderType::New();
+  reader->SetFileName(fn);
+  reader->Update();
+  if(!sameImage(image.GetPointer(), reader->GetOutput()))
+    {
+    printf("%s: image read back does not match the saved image\n", fn.c_str());
+    ok = false;
+    }
+
+  printf("%s: %s\n", fn.c_str(), ok ? "passed" : "FAILED");
+  return ok;
+}
+
+int usage()
+{
+  printf("NiftiGzipWriteTest: save gzipped NIfTI images and read them back\n");
+  printf("usage: NiftiGzipWriteTest temp_dir\n");
+  return -1;
+}
+
+int main(int argc, char *argv[])
+{
+  if(argc < 2)
+    return usage();
+
+  std::string dir = argv[1];
+  std::string files[] = {
+    dir + "/NiftiGzipWriteTest3D.nii.gz",
+    dir + "/NiftiGzipWriteTest4D.nii.gz",
+    dir + "/NiftiGzipWriteTestVector.nii.gz" };
+
+  const unsigned int size3[] = { 45, 31, 20 }, size4[] = { 20, 16, 12, 5 };
+
+  int rc = EXIT_SUCCESS;
+  try
+    {
+    if(!testFile<itk::Image<short, 3> >(files[0], size3, 1))
+      rc = EXIT_FAILURE;
+    if(!testFile<itk::Image<float, 4> >(files[1], size4, 1))
+      rc = EXIT_FAILURE;
+    if(!testFile<itk::VectorImage<unsigned char, 3> >(files[2], size3, 3))
+      rc = EXIT_FAILURE;
+    }
+  catch(itk::ExceptionObject &exc)
+    {
+    printf("Exception: %s\n", exc.what());
+    rc = EXIT_FAILURE;
+    }
+  catch(IRISException &exc)
+    {
+    printf("Exception: %s\n", exc.what());
+    rc = EXIT_FAILURE;
+    }
+
+  for(const std::string &fn : files)
+    itksys::SystemTools::RemoveFile(fn);
+
+  return rc;
+}
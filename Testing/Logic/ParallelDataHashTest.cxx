@@ -0,0 +1,71 @@
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "ParallelDataHash.h"
+
+// Reference digests of the test data below, computed with the xxHash
+// library (XXH64, seed 0 and seed 0x9E3779B97F4A7C15)
+struct TestVector
+{
+  size_t Length;
+  uint64_t Digest, SeededDigest;
+};
+
+const TestVector vectors[] = {
+  { 0,             0xEF46DB3751D8E999ULL, 0xC4349FC93C010000ULL },
+  { 31,            0xB74BAA9042B94DEEULL, 0x2C8FA6D44CA89E82ULL },
+  { 32,            0x4E13111CED6F735DULL, 0x3A5E73DDFE641A94ULL },
+  { (1 << 20) + 1, 0x41A52243E41DD1CDULL, 0x3BB07C7594DF74BFULL }
+};
+
+const uint64_t seed = 0x9E3779B97F4A7C15ULL;
+
+int main(int argc, char *argv[])
+{
+  // Bytes that are not a simple pattern, and are easy to reproduce
+  std::vector<unsigned char> data(3 * ParallelDataHash::LeafSize + 12345);
+  for(size_t i = 0; i < data.size(); i++)
+    data[i] = (unsigned char) ((i * 2654435761u) >> 13);
+
+  int rc = EXIT_SUCCESS;
+
+  // XXH64 must match the reference implementation. The lengths cover the
+  // short input path, the 32-byte stripes, and a tail of a single byte
+  for(const TestVector &v : vectors)
+    {
+    uint64_t h = ParallelDataHash::XXH64(data.data(), v.Length);
+    uint64_t hs = ParallelDataHash::XXH64(data.data(), v.Length, seed);
+    printf("XXH64 of %zu bytes: %016llx, seeded: %016llx\n", v.Length,
+           (unsigned long long) h, (unsigned long long) hs);
+    if(h != v.Digest || hs != v.SeededDigest)
+      {
+      printf("  Expected %016llx, seeded: %016llx\n",
+             (unsigned long long) v.Digest, (unsigned long long) v.SeededDigest);
+      rc = EXIT_FAILURE;
+      }
+    }
+
+  // The leaf hash must not depend on the number of threads, and must change
+  // when a single byte in the last leaf changes
+  uint64_t h1 = ParallelDataHash::Compute(data.data(), data.size(), 1);
+  for(unsigned int n_threads = 2; n_threads <= 8; n_threads *= 2)
+    {
+    uint64_t hn = ParallelDataHash::Compute(data.data(), data.size(), n_threads);
+    if(hn != h1)
+      {
+      printf("Hash with %u threads %016llx differs from hash with one thread %016llx\n",
+             n_threads, (unsigned long long) hn, (unsigned long long) h1);
+      rc = EXIT_FAILURE;
+      }
+    }
+
+  data.back() ^= 1;
+  if(ParallelDataHash::Compute(data.data(), data.size()) == h1)
+    {
+    printf("Hash did not change when the data changed\n");
+    rc = EXIT_FAILURE;
+    }
+
+  return rc;
+}
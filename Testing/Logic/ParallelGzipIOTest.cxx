@@ -0,0 +1,176 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <itk_zlib.h>
+#include "ParallelGzipIO.h"
+#include "IRISException.h"
+
+// Data that compresses to about half its size, so that the compressed file
+// spans several of the batches in which ParallelGzipReader reads it
+std::vector<char> makeData(size_t n)
+{
+  std::vector<char> data(n);
+  srand(1234);
+  for(size_t i = 0; i < n; i++)
+    data[i] = (char) ((i / 4096) % 2 ? rand() : i % 251);
+  return data;
+}
+
+// Read a whole gzip file with zlib
+bool readWithZlib(const std::string &fn, std::vector<char> &out, size_t n)
+{
+  gzFile gz = gzopen(fn.c_str(), "rb");
+  if(!gz)
+    return false;
+
+  out.resize(n + 1);
+  size_t total = 0;
+  int k;
+  while(total < out.size()
+        && (k = gzread(gz, out.data() + total, (unsigned) std::min(out.size() - total, (size_t) 1 << 20))) > 0)
+    total += k;
+  gzclose(gz);
+  out.resize(total);
+  return true;
+}
+
+// Write a gzip file with several ordinary members, as gzip and pigz produce
+// when files are concatenated, without the BGZF size field
+bool writeMultiMember(const std::string &fn, const std::vector<char> &data,
+                      const std::vector<size_t> &member_sizes)
+{
+  FILE *f = fopen(fn.c_str(), "wb");
+  if(!f)
+    return false;
+
+  size_t pos = 0;
+  std::vector<unsigned char> out;
+  for(size_t m = 0; m <= member_sizes.size(); m++)
+    {
+    size_t len = m < member_sizes.size() ? member_sizes[m] : data.size() - pos;
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    deflateInit2(&zs, 6, Z_DEFLATED, MAX_WBITS + 16, 8, Z_DEFAULT_STRATEGY);
+    out.resize(deflateBound(&zs, (uLong) len) + 64);
+    zs.next_in = (Bytef *) (data.data() + pos);
+    zs.avail_in = (uInt) len;
+    zs.next_out = out.data();
+    zs.avail_out = (uInt) out.size();
+    int rc = deflate(&zs, Z_FINISH);
+    size_t n_out = zs.total_out;
+    deflateEnd(&zs);
+    if(rc != Z_STREAM_END || fwrite(out.data(), 1, n_out, f) != n_out)
+      {
+      fclose(f);
+      return false;
+      }
+    pos += len;
+    }
+
+  fclose(f);
+  return true;
+}
+
+// Read ranges of the file with ParallelGzipReader and compare them to data
+bool checkRanges(const std::string &fn, const std::vector<char> &data,
+                 bool expect_blocked, const char *what)
+{
+  size_t n = data.size();
+  size_t ranges[][2] = {
+    { 0, n }, { 1, 100 }, { 65535, 65538 }, { 12345678, 9876543 },
+    { n / 2 - 1, n / 2 }, { n - 10, 10 }
+  };
+
+  bool ok = true;
+  for(auto &r : ranges)
+    {
+    ParallelGzipReader reader;
+    reader.SetNumberOfThreads(4);
+    if(!reader.Open(fn.c_str()))
+      {
+      printf("%s: could not open %s\n", what, fn.c_str());
+      return false;
+      }
+    if(reader.IsBlocked() != expect_blocked)
+      {
+      printf("%s: file is %sdetected as blocked\n", what, expect_blocked ? "not " : "");
+      ok = false;
+      }
+
+    std::vector<char> buffer(r[1]);
+    reader.Read(r[0], r[1], buffer.data());
+    reader.Close();
+
+    bool match = !memcmp(buffer.data(), data.data() + r[0], r[1]);
+    printf("%s: %zu bytes at offset %zu %s\n", what, r[1], r[0], match ? "match" : "DO NOT MATCH");
+    ok = ok && match;
+    }
+  return ok;
+}
+
+int usage()
+{
+  printf("ParallelGzipIOTest: round trip data through ParallelGzipWriter/Reader and zlib\n");
+  printf("usage: ParallelGzipIOTest temp_dir\n");
+  return -1;
+}
+
+int main(int argc, char *argv[])
+{
+  if(argc < 2)
+    return usage();
+
+  std::string fn_blocked = std::string(argv[1]) + "/ParallelGzipIOTest_blocked.gz";
+  std::string fn_members = std::string(argv[1]) + "/ParallelGzipIOTest_members.gz";
+
+  std::vector<char> data = makeData(40 * 1000 * 1000 + 17);
+  int rc = EXIT_SUCCESS;
+
+  try
+    {
+    // Write in pieces of uneven size, so that the buffered data does not
+    // line up with the blocks
+    ParallelGzipWriter writer;
+    writer.SetNumberOfThreads(4);
+    writer.Open(fn_blocked.c_str());
+    for(size_t pos = 0, len = 1; pos < data.size(); pos += len, len = len * 7 + 3)
+      writer.Write(data.data() + pos, std::min(len, data.size() - pos));
+    writer.Close();
+
+    // The output must be a valid gzip file for zlib
+    std::vector<char> inflated;
+    if(!readWithZlib(fn_blocked, inflated, data.size()) || inflated != data)
+      {
+      printf("ParallelGzipWriter output was not read back by zlib\n");
+      rc = EXIT_FAILURE;
+      }
+
+    // ... and be read by blocks by the parallel reader
+    if(!checkRanges(fn_blocked, data, true, "BGZF"))
+      rc = EXIT_FAILURE;
+
+    // Ordinary multi-member files are inflated sequentially, and the members
+    // do not line up with the ranges that are read
+    std::vector<size_t> members = { 1000000, 7000013, 3 };
+    if(!writeMultiMember(fn_members, data, members))
+      {
+      printf("Could not write %s\n", fn_members.c_str());
+      rc = EXIT_FAILURE;
+      }
+    else if(!checkRanges(fn_members, data, false, "Multi-member"))
+      rc = EXIT_FAILURE;
+    }
+  catch(IRISException &exc)
+    {
+    printf("Exception: %s\n", exc.what());
+    rc = EXIT_FAILURE;
+    }
+
+  remove(fn_blocked.c_str());
+  remove(fn_members.c_str());
+  return rc;
+}
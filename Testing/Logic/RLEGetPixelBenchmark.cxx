@@ -0,0 +1,142 @@
+#include <iostream>
+#include <cstdlib>
+#include <vector>
+#include <thread>
+
+#include <itkTimeProbe.h>
+#include "RLEImageRegionIterator.h"
+
+typedef unsigned short LabelType;
+typedef RLEImage<LabelType> LabelImageType;
+typedef itk::ImageRegionIterator<LabelImageType> IteratorType;
+
+// Create a cubic label image in which each line consists of many short runs
+LabelImageType::Pointer createLabelImage(unsigned int n, unsigned int run)
+{
+    LabelImageType::Pointer image = LabelImageType::New();
+    LabelImageType::RegionType region;
+    region.SetSize(0, n);
+    region.SetSize(1, n);
+    region.SetSize(2, n);
+    image->SetRegions(region);
+    image->Allocate();
+
+    for (IteratorType it(image, region); !it.IsAtEnd(); ++it)
+    {
+        LabelImageType::IndexType idx = it.GetIndex();
+        it.Set(LabelType((idx[0] / run + idx[1] + idx[2]) % 7));
+    }
+    return image;
+}
+
+// Random voxel indices at which the image is queried
+std::vector<LabelImageType::IndexType> randomIndices(unsigned int n, size_t count)
+{
+    std::vector<LabelImageType::IndexType> indices(count);
+    srand(1234);
+    for (size_t i = 0; i < count; i++)
+        for (int d = 0; d < 3; d++)
+            indices[i][d] = rand() % n;
+    return indices;
+}
+
+// Query all indices, returning a checksum of the values
+size_t queryImage(LabelImageType *image, const std::vector<LabelImageType::IndexType> &indices)
+{
+    size_t sum = 0;
+    for (size_t i = 0; i < indices.size(); i++)
+        sum += image->GetPixel(indices[i]);
+    return sum;
+}
+
+//measure GetPixel latency with and without the line index
+int main(int argc, char *argv[])
+{
+    unsigned int n = argc > 1 ? atoi(argv[1]) : 256;
+    unsigned int run = argc > 2 ? atoi(argv[2]) : 2;
+    size_t count = argc > 3 ? atoi(argv[3]) : 1000000;
+
+    std::cout << "Volume " << n << "^3, runs of " << run << " voxels, "
+        << count << " queries" << std::endl;
+
+    LabelImageType::Pointer image = createLabelImage(n, run);
+    std::vector<LabelImageType::IndexType> indices = randomIndices(n, count);
+
+    itk::TimeProbe tp;
+    tp.Start();
+    size_t linear = queryImage(image, indices);
+    tp.Stop();
+    std::cout << "  Linear scan: " << tp.GetMean() * 1000 << " ms" << std::endl;
+    tp.Reset();
+
+    image->SetUseLineIndex(true);
+    tp.Start();
+    size_t indexed = queryImage(image, indices);
+    tp.Stop();
+    std::cout << "  Indexed, first pass: " << tp.GetMean() * 1000 << " ms" << std::endl;
+    tp.Reset();
+
+    tp.Start();
+    indexed = queryImage(image, indices);
+    tp.Stop();
+    std::cout << "  Indexed, second pass: " << tp.GetMean() * 1000 << " ms" << std::endl;
+
+    int rc = EXIT_SUCCESS;
+    if (linear != indexed)
+    {
+        std::cout << "  Checksum mismatch: " << linear << " vs " << indexed << std::endl;
+        rc = EXIT_FAILURE;
+    }
+
+    // Query from several threads at once, starting from a discarded index so
+    // that the threads race to build the same lines
+    const unsigned int nThreads = 4;
+    std::vector<size_t> sums(nThreads);
+    std::vector<std::thread> threads;
+    image->Modified();
+    tp.Reset();
+    tp.Start();
+    for (unsigned int t = 0; t < nThreads; t++)
+        threads.push_back(std::thread([&, t]() { sums[t] = queryImage(image, indices); }));
+    for (unsigned int t = 0; t < nThreads; t++)
+        threads[t].join();
+    tp.Stop();
+    std::cout << "  Indexed, " << nThreads << " threads: " << tp.GetMean() * 1000 << " ms" << std::endl;
+    for (unsigned int t = 0; t < nThreads; t++)
+        if (sums[t] != linear)
+        {
+            std::cout << "  Checksum mismatch in thread " << t << ": " << sums[t] << std::endl;
+            rc = EXIT_FAILURE;
+        }
+
+    // Edit the image through its own methods and through the buffer, and
+    // make sure that the indexed lookups see the new values
+    LabelImageType::IndexType idx = indices[0];
+    image->SetPixel(idx, 100);
+    if (image->GetPixel(idx) != 100)
+    {
+        std::cout << "  Stale index after SetPixel" << std::endl;
+        rc = EXIT_FAILURE;
+    }
+
+    idx[0] = 0;
+    std::vector<LabelType> span(n, 101);
+    image->SetLineSpan(idx, n, span.data());
+    idx[0] = n - 1;
+    if (image->GetPixel(idx) != 101)
+    {
+        std::cout << "  Stale index after SetLineSpan" << std::endl;
+        rc = EXIT_FAILURE;
+    }
+
+    LabelImageType::RLLine &line = image->GetBuffer()->GetPixel(LabelImageType::truncateIndex(idx));
+    line.assign(1, LabelImageType::RLSegment(n, 102));
+    image->Modified();
+    if (image->GetPixel(idx) != 102)
+    {
+        std::cout << "  Stale index after Modified" << std::endl;
+        rc = EXIT_FAILURE;
+    }
+
+    return rc;
+}
@@ -186,6 +186,35 @@ Seg2DImageType::Pointer cropRLEiris(RLEImage3D::Pointer image)
     return roi->GetOutput();
 }
 
+//step through all slices along the axis with a single slicer, the way the
+//user scrolls through a view, and report the average time per slice.
+//Then step back to the requested slice, which is returned for comparison
+Seg2DImageType::Pointer sweepRLEiris(RLEImage3D::Pointer image)
+{
+    typedef IRISSlicer<RLEImage3D, Seg2DImageType, RLEImage3D> roiType;
+    roiType::Pointer roi = roiType::New();
+    roi->SetInput(image);
+    roi->SetSliceDirectionImageAxis(axis);
+    roi->SetLineDirectionImageAxis(axis == 2 ? 1 : 2);
+    roi->SetPixelDirectionImageAxis(axis == 0 ? 1 : 0);
+
+    unsigned int n = image->GetLargestPossibleRegion().GetSize(axis);
+    itk::TimeProbe tp;
+    for (unsigned int i = 0; i < n; i++)
+    {
+        roi->SetSliceIndex(i);
+        tp.Start();
+        roi->Update();
+        tp.Stop();
+    }
+    cout << "irisRLE sweep through " << n << " slices took: "
+        << tp.GetMean() * 1000 << " ms per slice" << endl;
+
+    roi->SetSliceIndex(sliceIndex);
+    roi->Update();
+    return roi->GetOutput();
+}
+
 Seg3DImageType::Pointer cropRLE(Label3DType::Pointer image)
 {
     typedef itk::ChangeRegionLabelMapFilter<Label3DType> roiLMType;
@@ -207,7 +236,7 @@ int main(int argc, char *argv[])
 {
     if (argc < 5)
     {
-        cout << "Usage:\n" << argv[0] << " InputImage3D.ext OutputSlice2D.ext X|Y|Z SliceNumber [RLE|RLI|IRIS|Normal]" << endl;
+        cout << "Usage:\n" << argv[0] << " InputImage3D.ext OutputSlice2D.ext X|Y|Z SliceNumber [RLE|RLI|IRIS|irisRLE|Normal] [MEM|SWEEP]" << endl;
         return 1;
     }
 
@@ -243,6 +272,10 @@ int main(int argc, char *argv[])
     if (argc>6)
         if (strcmp(argv[6], "MEM") == 0 || strcmp(argv[6], "mem") == 0)
             memCheck = true;
+    bool sweep = false;
+    if (argc>6)
+        if (strcmp(argv[6], "SWEEP") == 0 || strcmp(argv[6], "sweep") == 0)
+            sweep = true;
 
     Seg3DImageType::Pointer cropped, inImage = loadImage(argv[1]);
     Label3DType::Pointer inLabelMap;
@@ -307,6 +340,9 @@ int main(int argc, char *argv[])
 
     cout << " slicing took: " << tp.GetMean() * 1000 << " ms " << endl;
 
+    if (sweep && irisRLE)
+        cropped2D = sweepRLEiris(rleImage);
+
 
     if (!iris && !rli && !irisRLE)
     {
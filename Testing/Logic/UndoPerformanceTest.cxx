@@ -0,0 +1,244 @@
+#include <iostream>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <vector>
+
+#include <itkTimeProbe.h>
+#include "RLEImageRegionIterator.h"
+#include "UndoDataManager.h"
+#include "UndoDataManager.txx"
+
+typedef unsigned short LabelType;
+typedef RLEImage<LabelType> LabelImageType;
+typedef UndoDelta<LabelType> DeltaType;
+typedef itk::ImageRegionIterator<LabelImageType> IteratorType;
+typedef LabelImageType::RegionType RegionType;
+
+// Create a cubic label image with a few nested spherical labels
+LabelImageType::Pointer createLabelImage(unsigned int n)
+{
+  LabelImageType::Pointer image = LabelImageType::New();
+  RegionType region;
+  region.SetSize(0, n);
+  region.SetSize(1, n);
+  region.SetSize(2, n);
+  image->SetRegions(region);
+  image->Allocate();
+
+  double c = 0.5 * n;
+  for(IteratorType it(image, region); !it.IsAtEnd(); ++it)
+    {
+    LabelImageType::IndexType idx = it.GetIndex();
+    double r2 = 0;
+    for(int d = 0; d < 3; d++)
+      r2 += (idx[d] - c) * (idx[d] - c);
+    double r = sqrt(r2) / c;
+    it.Set(r < 0.3 ? 3 : (r < 0.6 ? 2 : (r < 0.9 ? 1 : 0)));
+    }
+  return image;
+}
+
+// A region of the image given by the start and end of each axis, as fractions
+// of the image size
+RegionType makeRegion(LabelImageType *image, const double start[3], const double end[3])
+{
+  RegionType region;
+  for(int d = 0; d < 3; d++)
+    {
+    long n = image->GetBufferedRegion().GetSize(d);
+    long i0 = (long) (start[d] * n), i1 = std::max(i0 + 1, (long) (end[d] * n));
+    region.SetIndex(d, i0);
+    region.SetSize(d, i1 - i0);
+    }
+  return region;
+}
+
+// Relabel a region of the image, recording the change as an undo delta in the
+// same way as SegmentationUpdateIterator
+DeltaType *relabel(LabelImageType *image, const RegionType &region,
+                   LabelType target, LabelType label)
+{
+  DeltaType *delta = new DeltaType();
+  delta->SetRegion(region);
+  for(IteratorType it(image, region); !it.IsAtEnd(); ++it)
+    {
+    LabelType old = it.Get();
+    if(old == target)
+      {
+      it.Set(label);
+      delta->Encode(label - old);
+      }
+    else
+      delta->Encode(0);
+    }
+  delta->FinishEncoding();
+  return delta;
+}
+
+// The voxel-by-voxel undo as it was implemented before the scanline engine
+void undoVoxelwise(LabelImageType *image, DeltaType *delta)
+{
+  IteratorType lit(image, delta->GetRegion());
+  for(size_t i = 0; i < delta->GetNumberOfRLEs(); i++)
+    {
+    size_t n = delta->GetRLELength(i);
+    LabelType d = delta->GetRLEValue(i);
+    for(size_t j = 0; j < n; j++)
+      {
+      if(d != 0)
+        lit.Set(lit.Get() - d);
+      ++lit;
+      }
+    }
+}
+
+// Count voxels that differ between two images
+size_t compareImages(LabelImageType *a, LabelImageType *b)
+{
+  size_t ndiff = 0;
+  IteratorType ia(a, a->GetBufferedRegion()), ib(b, b->GetBufferedRegion());
+  for(; !ia.IsAtEnd(); ++ia, ++ib)
+    if(ia.Get() != ib.Get())
+      ndiff++;
+  return ndiff;
+}
+
+// Relabel a region that covers only parts of the image lines, then check that
+// undo and redo of the delta restore the image voxel by voxel
+bool testPartialRegion(unsigned int n, const double start[3], const double end[3])
+{
+  LabelImageType::Pointer original = createLabelImage(n);
+  LabelImageType::Pointer edited = createLabelImage(n);
+  LabelImageType::Pointer relabeled = createLabelImage(n);
+
+  RegionType region = makeRegion(edited, start, end);
+  DeltaType *delta = relabel(edited, region, 2, 7);
+  DeltaType *dr = relabel(relabeled, region, 2, 7);
+
+  delta->ApplyToImage(edited, true);
+  size_t ndiff_undo = compareImages(original, edited);
+
+  delta->ApplyToImage(edited, false);
+  size_t ndiff_redo = compareImages(relabeled, edited);
+
+  std::cout << "  Region " << region.GetIndex() << " " << region.GetSize()
+            << ": voxels differing after undo " << ndiff_undo
+            << ", after redo " << ndiff_redo << std::endl;
+
+  delete delta;
+  delete dr;
+  return ndiff_undo == 0 && ndiff_redo == 0;
+}
+
+//measure undo latency as a function of the volume size
+int main(int argc, char *argv[])
+{
+  std::vector<unsigned int> sizes;
+  for(int i = 1; i < argc; i++)
+    sizes.push_back(atoi(argv[i]));
+  if(sizes.empty())
+    {
+    sizes.push_back(64);
+    sizes.push_back(128);
+    sizes.push_back(256);
+    }
+
+  int rc = EXIT_SUCCESS;
+  for(size_t k = 0; k < sizes.size(); k++)
+    {
+    unsigned int n = sizes[k];
+    std::cout << "Volume " << n << "^3" << std::endl;
+
+    LabelImageType::Pointer reference = createLabelImage(n);
+    LabelImageType::Pointer voxelwise = createLabelImage(n);
+    LabelImageType::Pointer scanline = createLabelImage(n);
+
+    // Relabel a full width slab of the image
+    const double slab_start[] = { 0.0, 0.0, 0.25 }, slab_end[] = { 1.0, 1.0, 0.75 };
+    RegionType slab = makeRegion(reference, slab_start, slab_end);
+    DeltaType *dv = relabel(voxelwise, slab, 1, 5);
+    DeltaType *ds = relabel(scanline, slab, 1, 5);
+    std::cout << "  Delta RLEs: " << ds->GetNumberOfRLEs() << std::endl;
+
+    itk::TimeProbe tp;
+    tp.Start();
+    undoVoxelwise(voxelwise, dv);
+    tp.Stop();
+    std::cout << "  Voxelwise undo: " << tp.GetMean() * 1000 << " ms" << std::endl;
+    tp.Reset();
+
+    tp.Start();
+    ds->ApplyToImage(scanline, true);
+    tp.Stop();
+    std::cout << "  Scanline undo: " << tp.GetMean() * 1000 << " ms" << std::endl;
+    tp.Reset();
+
+    size_t ndiff = compareImages(reference, scanline);
+    std::cout << "  Voxels differing after undo: " << ndiff << std::endl;
+    if(ndiff)
+      rc = EXIT_FAILURE;
+
+    // Redo should bring back the relabeled image
+    tp.Start();
+    ds->ApplyToImage(scanline, false);
+    tp.Stop();
+    std::cout << "  Scanline redo: " << tp.GetMean() * 1000 << " ms" << std::endl;
+
+    DeltaType *dr = relabel(reference, slab, 1, 5);
+    ndiff = compareImages(reference, scanline);
+    std::cout << "  Voxels differing after redo: " << ndiff << std::endl;
+    if(ndiff)
+      rc = EXIT_FAILURE;
+
+    // Pack the delta, spill it to the swap file, and page it back in. The
+    // restored delta should undo the change just like the original one
+    size_t rawSize = ds->GetMemoryInUse();
+    tp.Reset();
+    tp.Start();
+    ds->Pack();
+    tp.Stop();
+    std::cout << "  Packing: " << rawSize << " -> " << ds->GetMemoryInUse()
+              << " bytes in " << tp.GetMean() * 1000 << " ms" << std::endl;
+    tp.Reset();
+
+    ds->Spill();
+
+    // A copy of a spilled delta gets its own packed data. Deleting it must
+    // not release the swap block that the original delta still uses
+    DeltaType *copy = new DeltaType(*ds);
+    if(copy->IsSpilled() || copy->GetNumberOfRLEs() != ds->GetNumberOfRLEs())
+      {
+      std::cout << "  Copy of a spilled delta is wrong" << std::endl;
+      rc = EXIT_FAILURE;
+      }
+    delete copy;
+
+    tp.Start();
+    ds->Unpack();
+    tp.Stop();
+    std::cout << "  Unpacking from swap: " << tp.GetMean() * 1000 << " ms" << std::endl;
+
+    ds->ApplyToImage(scanline, true);
+    ndiff = compareImages(voxelwise, scanline);
+    std::cout << "  Voxels differing after undo with unpacked delta: " << ndiff << std::endl;
+    if(ndiff)
+      rc = EXIT_FAILURE;
+
+    delete dv;
+    delete ds;
+    delete dr;
+
+    // Edits that cover only part of each line: an interior block, a block
+    // that reaches the end of the lines, and a single column of voxels
+    const double box_start[] = { 0.25, 0.3, 0.2 }, box_end[] = { 0.7, 0.6, 0.8 };
+    const double tail_start[] = { 0.6, 0.1, 0.4 }, tail_end[] = { 1.0, 0.9, 0.6 };
+    const double column_start[] = { 0.5, 0.2, 0.3 }, column_end[] = { 0.0, 0.8, 0.7 };
+    if(!testPartialRegion(n, box_start, box_end) ||
+       !testPartialRegion(n, tail_start, tail_end) ||
+       !testPartialRegion(n, column_start, column_end))
+      rc = EXIT_FAILURE;
+    }
+
+  return rc;
+}